@@ -1,6 +1,9 @@
 #ifndef COLORS_H
 #define COLORS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 enum color_t {
     RED_TEXT    ,
     GREEN_TEXT  ,
@@ -29,10 +32,31 @@ enum boldness_t {
     NORMAL_TEXT,
 };
 
+//state of one call site of COLOR_PRINTF_LIMITED
+struct color_rate_limit_t {
+    uint64_t window_start_ns;
+    size_t   printed;
+    size_t   suppressed;
+};
+
+//prints not more than __max_per_second messages from this place in code,
+//number of dropped messages is printed with next message which gets through
+#define COLOR_PRINTF_LIMITED(__max_per_second, ...) {                  \
+    static color_rate_limit_t __color_rate_limit = {};                 \
+    color_printf_limited(&__color_rate_limit, (__max_per_second),      \
+                         __VA_ARGS__);                                 \
+}
+
 int color_printf(color_t      color,
                  boldness_t   is_bold,
                  background_t background,
                  const char * format, ...);
+int color_printf_limited(color_rate_limit_t *limit,
+                         size_t              max_per_second,
+                         color_t             color,
+                         boldness_t          is_bold,
+                         background_t        background,
+                         const char *        format, ...);
 void patriot(void);
 
 #endif
@@ -1,20 +1,54 @@
 #ifndef CUSTOM_ASSERT_H
 #define CUSTOM_ASSERT_H
 
-#ifndef NDEBUG
-#define C_ASSERT(expression, operand) {\
-    if(expression) {(void)0;}                               \
-    else {                                                  \
-        print_assert_error(#expression, __LINE__, __FILE__);\
-        operand;                                            \
-        }                                                   \
+#include "colors.h"
+
+//==============================================================================
+//ASSERTION TIERS, ASSERT_LEVEL SELECTS WHICH ARE COMPILED (-DASSERT_LEVEL=2):
+//0 - C_ASSERT_ALWAYS ONLY, CHECKS WHICH PROTECT FROM CRASHES IN PRODUCTION
+//1 - ALSO C_ASSERT, DEFAULT WITHOUT NDEBUG
+//2 - ALSO C_ASSERT_PARANOID, EXPENSIVE OR INTERNAL INVARIANTS
+//==============================================================================
+#ifndef ASSERT_LEVEL
+    #ifdef NDEBUG
+        #define ASSERT_LEVEL 0
+    #else
+        #define ASSERT_LEVEL 1
+    #endif
+#endif
+
+//every assertion has its own failures counter and reports rate
+struct assert_site_t {
+    size_t             failures;
+    color_rate_limit_t reports;
+};
+
+#define ASSERT_CHECK(expression, operand) {                                 \
+    if(__builtin_expect(!(expression), 0)) {                                \
+        static assert_site_t __assert_site = {};                            \
+        print_assert_error(&__assert_site, #expression, __LINE__, __FILE__);\
+        operand;                                                            \
+        }                                                                   \
     }
+
+#define C_ASSERT_ALWAYS(expression, operand) ASSERT_CHECK(expression, operand)
+
+#if ASSERT_LEVEL >= 1
+    #define C_ASSERT(expression, operand) ASSERT_CHECK(expression, operand)
+#else
+    #define C_ASSERT(expression, return_value) ((void)0);
+#endif
+
+#if ASSERT_LEVEL >= 2
+    #define C_ASSERT_PARANOID(expression, operand) ASSERT_CHECK(expression, operand)
 #else
-#define C_ASSERT(expression, return_value) ((void)0);
+    #define C_ASSERT_PARANOID(expression, return_value) ((void)0);
 #endif
 
-void print_assert_error(const char *string,
-                        int         line_number,
-                        const char *filename);
+__attribute__((cold, noinline))
+void print_assert_error(assert_site_t *site,
+                        const char *   string,
+                        int            line_number,
+                        const char *   filename);
 
 #endif
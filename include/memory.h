@@ -10,6 +10,15 @@ void *_recalloc         (void * memory_cell,
                          size_t element_size);
 void *_calloc           (size_t number,
                          size_t element_size);
+//memory is aligned to alignment, which is power of two not less than pointer
+void *_aligned_calloc   (size_t number,
+                         size_t element_size,
+                         size_t alignment);
+void *_aligned_recalloc (void * memory_cell,
+                         size_t old_size,
+                         size_t new_size,
+                         size_t element_size,
+                         size_t alignment);
 void _free              (void *memory_cell);
 void _memory_destroy_log(void);
 
@@ -0,0 +1,38 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdio.h>
+
+#include "stack.h"
+
+//==============================================================================
+//BOUNDED FIFO QUEUE FOR ONE PRODUCER THREAD AND ONE CONSUMER THREAD
+//PROTECTED WITH SAME MODES AS STACK, CAPACITY IS ROUNDED UP TO POWER OF TWO
+//QUEUE IS NOT DESTROYED ON ERRORS, OTHER THREAD MAY STILL USE IT
+//==============================================================================
+struct queue_t;
+
+queue_t *     queue_init         (STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                      const char *initialized_file,
+                                                      const char *initialized_varname,
+                                                      const char *initialized_function,
+                                                      size_t      initialized_line,
+                                                      int       (*print_func)(FILE *, void *),)
+                                  size_t capacity,
+                                  size_t element_size);
+//producer side, returns STACK_FULL if there is no place
+stack_error_t queue_enqueue      (queue_t *queue, const void *element);
+stack_error_t queue_enqueue_batch(queue_t *   queue,
+                                  const void *elements,
+                                  size_t      count,
+                                  size_t *    enqueued);
+//consumer side, returns STACK_EMPTY if there is nothing to dequeue
+stack_error_t queue_dequeue      (queue_t *queue, void *output);
+stack_error_t queue_dequeue_batch(queue_t *queue,
+                                  void *   output,
+                                  size_t   count,
+                                  size_t * dequeued);
+size_t        queue_size         (queue_t *queue);
+stack_error_t queue_destroy      (queue_t **queue);
+
+#endif
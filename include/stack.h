@@ -3,9 +3,19 @@
 
 #include <stdio.h>
 
-#define STACK_HASH_PROTECTION
-#define STACK_CANARY_PROTECTION
-#define STACK_WRITE_DUMP
+//modes are turned off with -DSTACK_NO_<MODE> to compare configurations
+#ifndef STACK_NO_HASH_PROTECTION
+    #define STACK_HASH_PROTECTION
+#endif
+#ifndef STACK_NO_CANARY_PROTECTION
+    #define STACK_CANARY_PROTECTION
+#endif
+#ifndef STACK_NO_WRITE_DUMP
+    #define STACK_WRITE_DUMP
+#endif
+#ifndef STACK_NO_STRONG_GUARANTEE
+    #define STACK_STRONG_GUARANTEE
+#endif
 
 #ifdef STACK_WRITE_DUMP
     #define STACK_WRITE_DUMP_ON(...) __VA_ARGS__
@@ -40,10 +50,17 @@ enum stack_error_t {
     STACK_UNEXPECTED_DATA_RIGHT_CANARY = 15,
     STACK_UNEXPECTED_STRUCTURE_HASH    = 16,
     STACK_UNEXPECTED_DATA_HASH         = 17,
+    STACK_FULL                         = 18,
+    STACK_IO_ERROR                     = 19,
+    STACK_TIMEOUT                      = 20,
+    STACK_NOT_FOUND                    = 21,
 };
 
 struct stack_t;
 
+//largest alignment of stack data, stack_init_aligned accepts powers of two up to it
+const size_t STACK_MAX_ALIGNMENT = 4096;
+
 stack_t *stack_init        (STACK_WRITE_DUMP_ON(const char *dump_filename,
                                                 const char *initialized_file,
                                                 const char *initialized_varname,
@@ -53,8 +70,133 @@ stack_t *stack_init        (STACK_WRITE_DUMP_ON(const char *dump_filename,
                             size_t capacity,
                             size_t element_size);
 
+stack_t *stack_open_mapped (STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                const char *initialized_file,
+                                                const char *initialized_varname,
+                                                const char *initialized_function,
+                                                size_t      initialized_line,
+                                                int       (*print_func)(FILE *, void *),)
+                            const char *path,
+                            size_t      capacity,
+                            size_t      element_size);
+
 stack_error_t stack_push   (stack_t **stack, void *element);
 stack_error_t stack_pop    (stack_t **stack, void *output);
 stack_error_t stack_destroy(stack_t **stack);
 
+//stack of elements with different sizes, capacity is in bytes
+stack_t *stack_init_bytes  (STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                const char *initialized_file,
+                                                const char *initialized_varname,
+                                                const char *initialized_function,
+                                                size_t      initialized_line,
+                                                int       (*print_func)(FILE *, void *),)
+                            size_t capacity);
+stack_error_t stack_push_bytes(stack_t **stack, void *element, size_t length);
+//length is size of output before call and size of element after it, if output
+//is too small nothing is popped and STACK_INVALID_OUTPUT is returned
+stack_error_t stack_pop_bytes (stack_t **stack, void *output, size_t *length);
+
+//first element is aligned to alignment, so are all elements which size
+//is multiple of it, memory after stack data is not shared with other stacks
+stack_t *stack_init_aligned(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                const char *initialized_file,
+                                                const char *initialized_varname,
+                                                const char *initialized_function,
+                                                size_t      initialized_line,
+                                                int       (*print_func)(FILE *, void *),)
+                            size_t capacity,
+                            size_t element_size,
+                            size_t alignment);
+
+//memory of stack comes from allocator (arena, NUMA node, hugepage pool...),
+//memory returned by allocate and reallocate does not have to be zeroed,
+//reallocate keeps first old_size bytes and returns NULL if it fails, it may be
+//NULL, then allocate, copy and release are used, release may do nothing,
+//callbacks are called under lock of stack registry and must not call stack
+//functions, stack_destroy is needed before memory of allocator is reset
+struct stack_allocator_t {
+    void *(*allocate)  (void *context, size_t size, size_t alignment);
+    void *(*reallocate)(void *context, void *memory, size_t old_size,
+                        size_t new_size, size_t alignment);
+    void  (*release)   (void *context, void *memory);
+    void *  context;
+};
+
+//allocator is copied to stack, NULL allocator is same as stack_init
+stack_t *stack_init_allocator(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                  const char *initialized_file,
+                                                  const char *initialized_varname,
+                                                  const char *initialized_function,
+                                                  size_t      initialized_line,
+                                                  int       (*print_func)(FILE *, void *),)
+                              size_t                   capacity,
+                              size_t                   element_size,
+                              const stack_allocator_t *allocator);
+
+//combine must be associative, result may not be same as first or second
+typedef void (*stack_combine_t)(void *result, const void *first, const void *second);
+
+//stack which keeps combine of all its elements (min, max, sum...)
+stack_t *stack_init_aggregate(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                  const char *initialized_file,
+                                                  const char *initialized_varname,
+                                                  const char *initialized_function,
+                                                  size_t      initialized_line,
+                                                  int       (*print_func)(FILE *, void *),)
+                              size_t          capacity,
+                              size_t          element_size,
+                              stack_combine_t combine);
+//writes combine of all elements from bottom to top, STACK_EMPTY if no elements
+stack_error_t stack_aggregate(stack_t **stack, void *output);
+
+//read-only elements of stack from bottom to top, valid until stack is changed
+struct stack_span_t {
+    const char *data;
+    size_t      size;
+    size_t      element_size;
+};
+
+enum stack_find_t {
+    STACK_FIND_FIRST, //closest to bottom
+    STACK_FIND_LAST , //closest to top
+};
+
+stack_error_t stack_view    (stack_t **stack, stack_span_t *span);
+//returns NULL if index is out of span
+const void *  stack_span_at (const stack_span_t *span, size_t index);
+stack_error_t stack_find    (stack_t **   stack,
+                             const void * element,
+                             stack_find_t direction,
+                             size_t *     index);
+stack_error_t stack_count   (stack_t **   stack,
+                             const void * element,
+                             size_t *     count);
+
+//depth of stack which stack_rollback returns to, in stack of elements with
+//different sizes it must be end of record, other marks get STACK_INVALID_INPUT
+typedef size_t stack_mark_t;
+
+stack_error_t stack_mark    (stack_t **stack, stack_mark_t *mark);
+stack_error_t stack_rollback(stack_t **stack, stack_mark_t  mark);
+
+stack_error_t stack_set_max_bytes(stack_t **stack, size_t max_bytes);
+//shrinks stack to its size or initial capacity at once, stack may be moved
+stack_error_t stack_trim         (stack_t **stack);
+stack_error_t stack_set_growth_policy(stack_t **stack,
+                                      size_t    grow_factor,
+                                      size_t    shrink_threshold,
+                                      size_t    shrink_factor);
+
+stack_error_t stack_save   (stack_t **stack, int fd);
+//element_size = 0 loads stack which was created with stack_init_bytes
+stack_t *stack_load        (STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                const char *initialized_file,
+                                                const char *initialized_varname,
+                                                const char *initialized_function,
+                                                size_t      initialized_line,
+                                                int       (*print_func)(FILE *, void *),)
+                            int    fd,
+                            size_t element_size);
+
 #endif
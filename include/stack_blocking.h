@@ -0,0 +1,51 @@
+#ifndef STACK_BLOCKING_H
+#define STACK_BLOCKING_H
+
+#include <stdio.h>
+
+#include "stack.h"
+
+//==============================================================================
+//BOUNDED STACK FOR HANDOFF BETWEEN THREADS
+//WAITING THREADS SLEEP ON FUTEX, WAITING COROUTINES ARE QUEUED (stack_coro.h)
+//==============================================================================
+struct stack_blocking_t;
+
+//------------------------------------------------------------------------------
+//COROUTINE (OR ANY OTHER) WAITER, wake IS CALLED WHEN OPERATION IS DONE
+//------------------------------------------------------------------------------
+struct stack_waiter_t {
+    void *          element;
+    stack_error_t   result;
+    void          (*wake)(stack_waiter_t *waiter);
+    void *          context;
+    stack_waiter_t *next;
+};
+
+//timeout_ms < 0 waits forever, timeout_ms = 0 does not wait at all
+const long STACK_WAIT_FOREVER = -1;
+
+stack_blocking_t *stack_blocking_init   (STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                             const char *initialized_file,
+                                                             const char *initialized_varname,
+                                                             const char *initialized_function,
+                                                             size_t      initialized_line,
+                                                             int       (*print_func)(FILE *, void *),)
+                                         size_t capacity,
+                                         size_t bound,
+                                         size_t element_size);
+stack_error_t     stack_push_wait       (stack_blocking_t *stack,
+                                         void *            element,
+                                         long              timeout_ms);
+stack_error_t     stack_pop_wait        (stack_blocking_t *stack,
+                                         void *            output,
+                                         long              timeout_ms);
+stack_error_t     stack_blocking_destroy(stack_blocking_t **stack);
+
+//returns false if operation is already done and waiter will not be woken
+bool              stack_push_enqueue    (stack_blocking_t *stack,
+                                         stack_waiter_t *  waiter);
+bool              stack_pop_enqueue     (stack_blocking_t *stack,
+                                         stack_waiter_t *  waiter);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef STACK_COMBINING_H
+#define STACK_COMBINING_H
+
+#include <stdio.h>
+
+#include "stack.h"
+
+//==============================================================================
+//FLAT-COMBINING STACK FOR MANY THREADS
+//THREADS PUBLISH REQUESTS IN SLOTS, ONE OF THEM (COMBINER) APPLIES ALL
+//PUBLISHED REQUESTS AS ONE BATCH WITH ONE VERIFY, ONE GROW AND ONE REHASH
+//==============================================================================
+struct stack_combining_t;
+
+stack_combining_t *stack_combining_init   (STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                               const char *initialized_file,
+                                                               const char *initialized_varname,
+                                                               const char *initialized_function,
+                                                               size_t      initialized_line,
+                                                               int       (*print_func)(FILE *, void *),)
+                                           size_t capacity,
+                                           size_t element_size);
+stack_error_t      stack_combining_push   (stack_combining_t *stack,
+                                           void *             element);
+stack_error_t      stack_combining_pop    (stack_combining_t *stack,
+                                           void *             output);
+//no thread may use stack while it is destroyed
+stack_error_t      stack_combining_destroy(stack_combining_t **stack);
+
+#endif
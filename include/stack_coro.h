@@ -0,0 +1,57 @@
+#ifndef STACK_CORO_H
+#define STACK_CORO_H
+
+#include <coroutine>
+
+#include "stack_blocking.h"
+
+//==============================================================================
+//AWAITABLE PUSH AND POP OF BLOCKING STACK FOR C++20 COROUTINES
+//SUSPENDED COROUTINE COSTS NOTHING, IT IS RESUMED ON THREAD WHICH MADE
+//OPERATION POSSIBLE: co_await stack_pop_async(stack, &element)
+//==============================================================================
+class stack_operation_awaitable {
+    public:
+        stack_operation_awaitable(stack_blocking_t *stack,
+                                  void *            element,
+                                  bool              is_push) :
+            stack_  (stack  ),
+            is_push_(is_push),
+            waiter_ ({element, STACK_SUCCESS, resume_waiter, NULL, NULL}) {}
+
+        bool await_ready(void) const {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            waiter_.context = handle.address();
+            if(is_push_)
+                return stack_push_enqueue(stack_, &waiter_);
+            return stack_pop_enqueue(stack_, &waiter_);
+        }
+
+        stack_error_t await_resume(void) const {
+            return waiter_.result;
+        }
+
+    private:
+        static void resume_waiter(stack_waiter_t *waiter) {
+            std::coroutine_handle<>::from_address(waiter->context).resume();
+        }
+
+        stack_blocking_t *stack_;
+        bool              is_push_;
+        stack_waiter_t    waiter_;
+};
+
+inline stack_operation_awaitable stack_push_async(stack_blocking_t *stack,
+                                                  void *            element) {
+    return stack_operation_awaitable(stack, element, true);
+}
+
+inline stack_operation_awaitable stack_pop_async(stack_blocking_t *stack,
+                                                 void *            output) {
+    return stack_operation_awaitable(stack, output, false);
+}
+
+#endif
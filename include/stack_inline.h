@@ -0,0 +1,113 @@
+#ifndef STACK_INLINE_H
+#define STACK_INLINE_H
+
+#include <string.h>
+
+#include "stack.h"
+#include "stack_internal.h"
+#include "stack_trace.h"
+
+//==============================================================================
+//PUSH AND POP WHICH ARE INLINED IN CALLER
+//ONLY ELEMENT COPY AND SIZE CHANGE ARE DONE HERE, EVERYTHING ELSE (GROWTH,
+//SHRINK, TRACE, AGGREGATES, HASH AND DUMP MODES) GOES TO stack_push/stack_pop
+//WITH HASH OR DUMP MODE ON THEY ARE JUST CALLS OF stack_push/stack_pop,
+//BECAUSE THESE MODES READ OR WRITE WHOLE STACK ON EVERY OPERATION
+//==============================================================================
+#if defined(STACK_HASH_PROTECTION) || defined(STACK_WRITE_DUMP)
+    inline stack_error_t stack_push_inline(stack_t **stack, void *element) {
+        return stack_push(stack, element);
+    }
+
+    inline stack_error_t stack_pop_inline(stack_t **stack, void *output) {
+        return stack_pop(stack, output);
+    }
+#else
+    //--------------------------------------------------------------------------
+    //TRUE IF STACK CAN BE CHANGED WITHOUT stack.cpp, BROKEN CANARIES ARE
+    //REPORTED BY stack_push/stack_pop
+    //--------------------------------------------------------------------------
+    inline bool stack_inline_allowed(const stack_t *stack) {
+        if(stack == NULL || stack->variable_size || stack->combine != NULL ||
+           stack_trace_file != NULL)
+            return false;
+
+        #ifdef STACK_CANARY_PROTECTION
+            const char *start = (const char *)stack;
+            if(stack->structure_left_canary !=
+               ((canary_t)((const char *)&stack->structure_left_canary - start) ^
+                CANARY_HEX_SPEAK) ||
+               stack->structure_right_canary !=
+               ((canary_t)((const char *)&stack->structure_right_canary - start) ^
+                CANARY_HEX_SPEAK) ||
+               *stack->data_left_canary !=
+               ((canary_t)((const char *)stack->data_left_canary - start) ^
+                CANARY_HEX_SPEAK) ||
+               *stack->data_right_canary !=
+               ((canary_t)((const char *)stack->data_right_canary - start) ^
+                CANARY_HEX_SPEAK))
+                return false;
+        #endif
+
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+    //PUSHES ELEMENT IF STACK HAS PLACE FOR IT
+    //--------------------------------------------------------------------------
+    inline stack_error_t stack_push_inline(stack_t **stack, void *element) {
+        stack_t *fast_stack = *stack;
+        if(element == NULL || !stack_inline_allowed(fast_stack) ||
+           fast_stack->size >= fast_stack->capacity)
+            return stack_push(stack, element);
+
+        //version is changed and trimmer is waited for as in
+        //stack_write_begin/stack_write_end
+        __atomic_store_n(&fast_stack->version, fast_stack->version + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+        if(__atomic_load_n(&fast_stack->trimming, __ATOMIC_ACQUIRE))
+            stack_wait_trim(fast_stack);
+
+        fast_stack->kernel->copy_in(fast_stack->data +
+                                    fast_stack->size * fast_stack->element_size,
+                                    element,
+                                    fast_stack->element_size);
+        fast_stack->size++;
+
+        __atomic_store_n(&fast_stack->version, fast_stack->version + 1, __ATOMIC_RELEASE);
+        return STACK_SUCCESS;
+    }
+
+    //--------------------------------------------------------------------------
+    //POPS ELEMENT IF STACK IS NOT EMPTY AND WOULD NOT SHRINK
+    //--------------------------------------------------------------------------
+    inline stack_error_t stack_pop_inline(stack_t **stack, void *output) {
+        stack_t *fast_stack = *stack;
+        if(output == NULL || !stack_inline_allowed(fast_stack) ||
+           fast_stack->size == 0)
+            return stack_pop(stack, output);
+
+        //same condition as in stack_check_size
+        if(fast_stack->shrink_threshold != 0                                        &&
+           fast_stack->size * fast_stack->shrink_threshold <= fast_stack->capacity &&
+           fast_stack->init_capacity != fast_stack->capacity)
+            return stack_pop(stack, output);
+
+        __atomic_store_n(&fast_stack->version, fast_stack->version + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+        if(__atomic_load_n(&fast_stack->trimming, __ATOMIC_ACQUIRE))
+            stack_wait_trim(fast_stack);
+
+        fast_stack->size--;
+        char *element = fast_stack->data + fast_stack->size * fast_stack->element_size;
+        fast_stack->kernel->copy_out(output, element, fast_stack->element_size);
+        fast_stack->kernel->clear   (element, fast_stack->element_size);
+
+        __atomic_store_n(&fast_stack->version, fast_stack->version + 1, __ATOMIC_RELEASE);
+        return STACK_SUCCESS;
+    }
+#endif
+
+#endif
@@ -0,0 +1,316 @@
+#ifndef STACK_INTERNAL_H
+#define STACK_INTERNAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "stack.h"
+#include "stack_registry.h"
+
+//==============================================================================
+//TYPES OF PROTECTION VALUES
+//==============================================================================
+typedef uint64_t hash_t;
+
+#ifdef STACK_CANARY_PROTECTION
+    typedef uint64_t canary_t;
+
+    const canary_t CANARY_HEX_SPEAK = 0xC0FFEEC0FFEE;
+#endif
+
+//==============================================================================
+//WHERE STACK MEMORY COMES FROM
+//==============================================================================
+enum stack_storage_t {
+    STACK_STORAGE_HEAP  ,
+    STACK_STORAGE_MAPPED,
+};
+
+//==============================================================================
+//DUMP FILE SHARED BY ALL STACKS WITH SAME DUMP FILENAME
+//==============================================================================
+struct stack_dump_sink_t;
+
+//==============================================================================
+//PLACE OF STACK IN REGISTRY, IT IS NOT MOVED WITH STACK (stack_registry.cpp)
+//==============================================================================
+struct stack_registry_slot_t;
+
+//==============================================================================
+//FIELDS WHICH EVERY PUSH AND POP USES ARE IN FIRST CACHE LINE OF STACK
+//==============================================================================
+const size_t STACK_CACHE_LINE = 64;
+
+//==============================================================================
+//ALIGNMENT OF DATA IN STACKS CREATED WITHOUT stack_init_aligned
+//==============================================================================
+const size_t STACK_DEFAULT_ALIGNMENT = alignof(max_align_t);
+
+//==============================================================================
+//ELEMENT COPY AND CLEAR CHOSEN BY ELEMENT SIZE WHEN STACK IS INITIALIZED,
+//size IS element_size OF STACK, FIXED SIZE KERNELS IGNORE IT
+//==============================================================================
+typedef void (*stack_copy_t) (void *destination, const void *source, size_t size);
+typedef void (*stack_clear_t)(void *destination, size_t size);
+
+struct stack_kernel_t {
+    stack_copy_t  copy_in;  //from caller to stack
+    stack_copy_t  copy_out; //from stack to caller
+    stack_clear_t clear;
+};
+
+#ifdef STACK_WRITE_DUMP
+    //==========================================================================
+    //DIAGNOSTIC METADATA, IT IS ALLOCATED SEPARATELY AND IS NOT MOVED WITH STACK
+    //==========================================================================
+    struct stack_cold_t {
+        stack_dump_sink_t *dump_sink;
+        const char *       dump_filename;
+        const char *       initialized_file;
+        const char *       initialized_varname;
+        const char *       initialized_function;
+        size_t             initialized_line;
+        int              (*print_func)(FILE *, void *);
+        size_t             dirty_low;         //slots changed since last dump
+        size_t             dirty_high;        //are [dirty_low, dirty_high)
+        size_t             dumps_to_keyframe; //0 means next dump writes all slots
+        size_t             corrupted_low;     //elements of chunks which failed
+        size_t             corrupted_high;    //last data hash check
+    };
+#endif
+
+//==============================================================================
+//THE DEFINITION OF STACK STRUCTURE
+//==============================================================================
+struct alignas(STACK_CACHE_LINE) stack_t {
+    //hot header
+    #ifdef STACK_CANARY_PROTECTION
+        canary_t structure_left_canary;
+    #endif
+
+    size_t size;
+    size_t capacity;
+    size_t element_size;
+    char * data;
+    size_t version;       //odd while stack is being changed
+    bool   variable_size; //elements are pushed by stack_push_bytes
+    bool   trimming;      //stack_trim_all releases pages, writers wait
+
+    //hash mode checks structure hash first on every operation, so it is last
+    //hot field, other hash fields and kernel are read after whole stack is
+    //checked, without hash mode kernel is last hot field
+    #ifdef STACK_HASH_PROTECTION
+        hash_t  structure_hash;
+        hash_t  data_hash;       //hash of chunk_hashes and aggregates
+        size_t  hash_dirty_low;  //slots changed since chunks were rehashed
+        size_t  hash_dirty_high; //are [hash_dirty_low, hash_dirty_high)
+        hash_t *chunk_hashes;    //hashes of data chunks, see stack_hash.cpp
+        size_t  chunk_count;     //allocated entries of chunk_hashes
+    #endif
+
+    const stack_kernel_t *kernel; //copy and clear of one element
+
+    //used when stack is checked or changes capacity
+    stack_combine_t   combine;    //NULL if stack does not keep aggregates
+    char *            aggregates; //aggregates[i] is combine of elements [0, i]
+    stack_allocator_t allocator;  //NULL allocate means memory.cpp
+    size_t            alignment;  //of data, power of two
+    size_t            init_capacity;
+    size_t            max_bytes;
+    size_t            grow_factor;
+    size_t            shrink_threshold;
+    size_t            shrink_factor;
+
+    #ifdef STACK_CANARY_PROTECTION
+        canary_t *data_left_canary;
+        canary_t *data_right_canary;
+        size_t    alignment_offset;
+    #endif
+
+    //cold, it is not covered by structure hash
+    stack_storage_t        storage;
+    int                    storage_fd;
+    size_t                 id;
+    stack_registry_slot_t *registry_slot; //NULL if stack is not registered
+    size_t                 trim_version;  //version seen by last stack_trim_all
+    uint64_t               idle_since_ns; //when trim_version was seen first
+    bool                   trimmed;       //pages are released at trim_version
+
+    #ifdef STACK_WRITE_DUMP
+        stack_cold_t *cold;
+    #endif
+
+    #ifdef STACK_CANARY_PROTECTION
+        canary_t structure_right_canary;
+    #endif
+};
+
+//==============================================================================
+//PUSH OR POP APPLIED BY stack_apply_batch, element IS INPUT OR OUTPUT
+//==============================================================================
+struct stack_batch_operation_t {
+    bool          is_push;
+    void *        element;
+    stack_error_t result;
+};
+
+//==============================================================================
+//FUNCTIONS SHARED BETWEEN STACK MODULES
+//==============================================================================
+stack_error_t stack_init_header        (stack_t *stack,
+                                        STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                            const char *initialized_file,
+                                                            const char *initialized_varname,
+                                                            const char *initialized_function,
+                                                            size_t      initialized_line,
+                                                            int       (*print_func)(FILE *, void *),)
+                                        size_t   capacity,
+                                        size_t   element_size,
+                                        size_t   alignment,
+                                        bool     variable_size);
+stack_error_t stack_verify             (stack_t *stack);
+stack_error_t stack_verify_full        (stack_t *stack,
+                                        size_t * corrupted_low,
+                                        size_t * corrupted_high);
+stack_error_t stack_verify_structure   (stack_t *stack);
+void          stack_write_begin        (stack_t *stack);
+void          stack_write_end          (stack_t *stack);
+size_t        calculate_allocation_size(size_t capacity,
+                                        size_t element_size,
+                                        size_t alignment);
+size_t        stack_data_offset        (size_t alignment);
+size_t        stack_new_id             (void);
+//if stack can not grow for all pushes nothing is applied and error is returned
+stack_error_t stack_apply_batch        (stack_t **               stack,
+                                        stack_batch_operation_t *operations,
+                                        size_t                   count);
+
+hash_t        hash_function            (const void *start,
+                                        const void *end);
+
+#ifdef STACK_HASH_PROTECTION
+    stack_error_t stack_update_hash       (stack_t *stack);
+    stack_error_t stack_verify_pending_hash(stack_t *stack);
+#endif
+
+#ifdef STACK_WRITE_DUMP
+    stack_error_t stack_attach_dump(stack_t *   stack,
+                                    const char *dump_filename,
+                                    const char *initialized_file,
+                                    const char *initialized_varname,
+                                    const char *initialized_function,
+                                    size_t      initialized_line,
+                                    int       (*print_func)(FILE *, void *));
+    stack_error_t stack_dump       (stack_t *     stack,
+                                    const char *  file_name,
+                                    const char *  function_name,
+                                    size_t        line,
+                                    stack_error_t call_reason);
+    stack_error_t stack_dump_corrupted(stack_t *     stack,
+                                       const char *  file_name,
+                                       const char *  function_name,
+                                       size_t        line,
+                                       stack_error_t call_reason,
+                                       size_t        corrupted_low,
+                                       size_t        corrupted_high,
+                                       bool          keyframe);
+    stack_error_t stack_dump_keyframe (stack_t *     stack,
+                                       const char *  file_name,
+                                       const char *  function_name,
+                                       size_t        line);
+    const char *  get_error_text   (stack_error_t error);
+#endif
+
+#ifdef STACK_CANARY_PROTECTION
+    stack_error_t stack_update_canary  (stack_t *stack);
+    void          stack_locate_canaries(stack_t *stack);
+#endif
+
+//------------------------------------------------------------------------------
+//MEMORY OF STACK, ITS AGGREGATES AND CHUNK HASHES (stack.cpp)
+//------------------------------------------------------------------------------
+void *stack_memory_allocate  (const stack_allocator_t *allocator,
+                              size_t                   size,
+                              size_t                   alignment);
+void *stack_memory_reallocate(const stack_allocator_t *allocator,
+                              void *                   memory,
+                              size_t                   old_size,
+                              size_t                   new_size,
+                              size_t                   alignment);
+void  stack_memory_release   (const stack_allocator_t *allocator,
+                              void *                   memory);
+
+//------------------------------------------------------------------------------
+//ELEMENT COPY KERNELS (stack_copy.cpp)
+//------------------------------------------------------------------------------
+const stack_kernel_t *stack_select_kernel(size_t element_size,
+                                          size_t alignment);
+
+//------------------------------------------------------------------------------
+//REGISTRY OF LIVE STACKS AND SHARED DUMP FILES (stack_registry.cpp)
+//------------------------------------------------------------------------------
+stack_error_t stack_registry_add   (stack_t *stack);
+size_t        stack_registry_remove(stack_t *stack);
+void          stack_registry_lock  (void);
+void          stack_registry_unlock(void);
+void          stack_registry_lock_stack  (const stack_t *stack);
+void          stack_registry_unlock_stack(const stack_t *stack);
+void          stack_registry_update(stack_t *stack); //slot of stack must be locked
+void          stack_registry_for_each_locked(stack_visitor_t visitor,
+                                             void *          context);
+stack_error_t stack_registry_visit (size_t          position,
+                                    stack_visitor_t visitor,
+                                    void *          context);
+size_t        stack_registry_peek  (stack_registry_slot_t *const **slots); //without lock
+stack_t *     stack_registry_slot_stack(stack_registry_slot_t *const *slots,
+                                        size_t                        index);
+
+//------------------------------------------------------------------------------
+//CHUNKED DATA HASH (stack_hash.cpp)
+//------------------------------------------------------------------------------
+#ifdef STACK_HASH_PROTECTION
+    size_t        stack_hash_chunk_count (const stack_t *stack,
+                                          size_t         capacity);
+    stack_error_t stack_hash_resize      (stack_t *      stack,
+                                          size_t         capacity);
+    void          stack_hash_touch       (stack_t *      stack,
+                                          size_t         first,
+                                          size_t         last);
+    void          stack_hash_invalidate  (stack_t *      stack); //all data is rehashed
+    bool          stack_hash_pending     (const stack_t *stack); //invalidated
+    void          stack_hash_chunks      (stack_t *      stack); //touched chunks
+    hash_t        stack_hash_root        (const stack_t *stack);
+    //false if some chunk is changed, [first, last) are elements of changed chunks
+    bool          stack_hash_check_chunks(const stack_t *stack,
+                                          size_t *       first,
+                                          size_t *       last);
+#endif
+
+//------------------------------------------------------------------------------
+//BACKGROUND VERIFICATION (stack_scrubber.cpp)
+//------------------------------------------------------------------------------
+bool stack_scrubber_active(void);
+
+#ifdef STACK_WRITE_DUMP
+    stack_dump_sink_t *stack_dump_sink_acquire(const char *       filename);
+    void               stack_dump_sink_release(stack_dump_sink_t *sink);
+    FILE *             stack_dump_sink_lock   (stack_dump_sink_t *sink);
+    void               stack_dump_sink_unlock (stack_dump_sink_t *sink,
+                                               bool               flush);
+#endif
+
+//------------------------------------------------------------------------------
+//RELEASE OF IDLE MEMORY (stack_trim.cpp)
+//------------------------------------------------------------------------------
+void stack_wait_trim(stack_t *stack);
+
+//------------------------------------------------------------------------------
+//MAPPED STORAGE (stack_mapped.cpp)
+//------------------------------------------------------------------------------
+void *stack_mapped_reallocate(stack_t *stack,
+                              size_t   old_size,
+                              size_t   new_size);
+void  stack_mapped_release   (stack_t *stack);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef STACK_REGISTRY_H
+#define STACK_REGISTRY_H
+
+#include "stack.h"
+
+//callback only reads stack, registry and slot of visited stack are locked while
+//it runs, so it must not push, pop or otherwise change stacks (growth of visited
+//stack waits for its slot), initialize or destroy them (both wait for registry)
+typedef stack_error_t (*stack_visitor_t)(stack_t *stack, void *context);
+
+size_t        stack_registry_count   (void);
+stack_error_t stack_registry_for_each(stack_visitor_t visitor, void *context);
+stack_error_t stack_registry_flush   (void);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef STACK_SCRUBBER_H
+#define STACK_SCRUBBER_H
+
+#include "stack.h"
+
+//==============================================================================
+//BACKGROUND THREAD WHICH VERIFIES DATA HASHES OF REGISTERED STACKS
+//WHILE IT IS RUNNING stack_push/stack_pop CHECK ONLY STRUCTURE AND CANARIES
+//==============================================================================
+
+//called from scrubber thread with registry locked, must not init or destroy stacks
+//elements of chunks which failed data hash check are [corrupted_low,
+//corrupted_high), range is empty if only structure is broken
+typedef void (*stack_corruption_handler_t)(stack_t *     stack,
+                                           stack_error_t error,
+                                           size_t        corrupted_low,
+                                           size_t        corrupted_high,
+                                           void *        context);
+
+stack_error_t stack_scrubber_start(size_t                     stacks_per_second,
+                                   stack_corruption_handler_t handler,
+                                   void *                     context);
+stack_error_t stack_scrubber_stop (void);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef STACK_SHARED_H
+#define STACK_SHARED_H
+
+#include <stdio.h>
+
+#include "stack.h"
+
+//==============================================================================
+//STACK IN SHARED MEMORY SEGMENT WHICH SEVERAL PROCESSES MAP AT ONCE
+//SEGMENT KEEPS OFFSETS INSTEAD OF POINTERS, SO EVERY PROCESS MAY MAP IT AT ITS
+//OWN ADDRESS, OPERATIONS ARE SERIALIZED WITH ROBUST PROCESS-SHARED MUTEX
+//CAPACITY NEVER CHANGES, PUSH RETURNS STACK_FULL IF THERE IS NO PLACE
+//==============================================================================
+struct stack_shared_t;
+
+//name is shm_open name ("/name"), segment is created if it does not exist,
+//existing segment which does not become ready in one second was left by
+//creator which died, it is unlinked and created again,
+//NULL name creates anonymous memfd segment, it is shared by fork or by its fd
+stack_shared_t *stack_shared_open  (STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                        const char *initialized_file,
+                                                        const char *initialized_varname,
+                                                        const char *initialized_function,
+                                                        size_t      initialized_line,
+                                                        int       (*print_func)(FILE *, void *),)
+                                    const char *name,
+                                    size_t      capacity,
+                                    size_t      element_size);
+//maps segment which other process has created, fd is not closed on error
+stack_shared_t *stack_shared_attach(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                        const char *initialized_file,
+                                                        const char *initialized_varname,
+                                                        const char *initialized_function,
+                                                        size_t      initialized_line,
+                                                        int       (*print_func)(FILE *, void *),)
+                                    int    fd,
+                                    size_t element_size);
+int             stack_shared_fd    (stack_shared_t *stack);
+
+stack_error_t   stack_shared_push  (stack_shared_t *stack, const void *element);
+stack_error_t   stack_shared_pop   (stack_shared_t *stack, void *output);
+//number of elements, it may be changed by other process at once
+size_t          stack_shared_size  (stack_shared_t *stack);
+
+//unmaps segment in this process, segment lives while it is mapped or named
+stack_error_t   stack_shared_close (stack_shared_t **stack);
+stack_error_t   stack_shared_unlink(const char *name);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef STACK_SIGNAL_H
+#define STACK_SIGNAL_H
+
+#include <stdint.h>
+
+#include "stack.h"
+
+//==============================================================================
+//DUMPS ON DEMAND AND ON CRASH, SO PROCESS MAY RUN WITHOUT DUMP OF EVERY
+//OPERATION AND STILL BE DEBUGGED
+//SIGUSR1 DUMPS KEYFRAMES OF ALL REGISTERED STACKS FROM BACKGROUND THREAD,
+//WITHOUT DUMP MODE IT WRITES SNAPSHOT OF THEIR HEADERS TO snapshot_path
+//SIGSEGV, SIGBUS, SIGFPE, SIGILL AND SIGABRT WRITE SNAPSHOT TO snapshot_path
+//WITH write ONLY, THEN PREVIOUS HANDLER OF SIGNAL GETS IT AGAIN
+//==============================================================================
+
+//snapshot is header followed by header.stacks records, all fields are in byte
+//order of process, values of modes which are off are zero
+const uint64_t STACK_SNAPSHOT_MAGIC = 0x544f4853504e5353; //"SSNPSHOT"
+
+const uint32_t STACK_SNAPSHOT_HASH   = 1;
+const uint32_t STACK_SNAPSHOT_CANARY = 2;
+const uint32_t STACK_SNAPSHOT_DUMP   = 4;
+
+struct stack_snapshot_header_t {
+    uint64_t magic;
+    uint32_t record_size;
+    uint32_t modes;       //STACK_SNAPSHOT_* which were compiled in
+    int32_t  signal;      //0 if snapshot was written by stack_signal_snapshot
+    int32_t  pid;
+    uint64_t stacks;
+};
+
+struct stack_snapshot_record_t {
+    uint64_t address;
+    uint64_t id;
+    uint64_t size;
+    uint64_t capacity;
+    uint64_t element_size;
+    uint64_t alignment;
+    uint64_t version;     //odd if stack was being changed
+    uint64_t structure_hash;
+    uint64_t data_hash;
+    uint64_t structure_left_canary;
+    uint64_t structure_right_canary;
+    uint64_t data_left_canary;  //zero if canary pointer is outside of stack
+    uint64_t data_right_canary;
+};
+
+//snapshot file is opened for append, it may be NULL if only SIGUSR1 dumps of
+//dump mode are wanted, handlers which were set before are restored by stop
+stack_error_t stack_signal_dumps_start(const char *snapshot_path);
+stack_error_t stack_signal_dumps_stop (void);
+
+//writes snapshot of all stacks to snapshot file at once
+stack_error_t stack_signal_snapshot   (void);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef STACK_TRACE_H
+#define STACK_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "stack.h"
+
+enum stack_trace_op_t {
+    STACK_TRACE_INIT       = 0, //element_size is 0 for stack_init_bytes
+    STACK_TRACE_PUSH       = 1,
+    STACK_TRACE_POP        = 2,
+    STACK_TRACE_DESTROY    = 3,
+    STACK_TRACE_PUSH_BYTES = 4,
+    STACK_TRACE_POP_BYTES  = 5,
+    STACK_TRACE_ROLLBACK   = 6, //element_size is mark
+};
+
+struct stack_trace_record_t {
+    stack_trace_op_t op;
+    uint64_t         stack_id;
+    uint64_t         element_size;
+    uint64_t         capacity;
+    uint64_t         delta_ns;
+};
+
+//NULL while tracing is off, inline operations leave traced calls to stack.cpp
+extern FILE *stack_trace_file;
+
+stack_error_t stack_trace_start (const char *filename);
+void          stack_trace_stop  (void);
+void          stack_trace_record(stack_trace_op_t op,
+                                 size_t           stack_id,
+                                 size_t           element_size,
+                                 size_t           capacity);
+
+stack_error_t stack_trace_open  (FILE *trace);
+stack_error_t stack_trace_read  (FILE *                trace,
+                                 stack_trace_record_t *record);
+
+#endif
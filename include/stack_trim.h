@@ -0,0 +1,29 @@
+#ifndef STACK_TRIM_H
+#define STACK_TRIM_H
+
+#include "stack.h"
+
+//==============================================================================
+//RELEASE OF MEMORY WHICH IDLE STACKS DO NOT USE
+//STACKS ARE NOT MOVED, PAGES AFTER THEIR SIZE (OR init_capacity) ARE GIVEN
+//BACK TO SYSTEM, OWNERS MAY USE STACKS AT SAME TIME
+//==============================================================================
+
+//releases pages of registered stacks which were not changed for idle_ms,
+//idle_ms = 0 releases pages of all stacks which are not being changed now
+stack_error_t stack_trim_all       (size_t  idle_ms,
+                                    size_t *released_bytes);
+
+//starts thread which calls stack_trim_all(idle_ms) every interval_ms,
+//if pressure_file is not NULL (/proc/pressure/memory or memory.pressure of
+//cgroup), pressure_trigger ("some 150000 1000000") is registered in it and
+//every pressure event trims all stacks regardless of idle time
+stack_error_t stack_trimmer_start  (size_t      idle_ms,
+                                    size_t      interval_ms,
+                                    const char *pressure_file,
+                                    const char *pressure_trigger);
+stack_error_t stack_trimmer_stop   (void);
+//reports memory pressure to running trimmer, async-signal-safe
+stack_error_t stack_memory_pressure(void);
+
+#endif
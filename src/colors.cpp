@@ -1,5 +1,9 @@
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "colors.h"
 #include "custom_assert.h"
@@ -34,6 +38,21 @@ static const char *bold = "1";
 //start of color code
 static const char *color_code_start = "\033[";
 
+//message is built in thread local buffer and written with one write(), so
+//messages from different threads are not mixed, longer messages are cut
+static const size_t COLOR_BUFFER_SIZE   = 4096;
+static const size_t COLOR_RESET_RESERVE = 8;
+
+struct color_buffer_t {
+    char   text[COLOR_BUFFER_SIZE];
+    size_t length;
+};
+
+static thread_local color_buffer_t color_buffer = {};
+
+//-1 until output is checked, then 1 if it is terminal and 0 if it is not
+static int output_is_terminal = -1;
+
 static printing_state_t reset_color(void);
 static printing_state_t print_color_code(color_t      color,
                                          boldness_t   is_bold,
@@ -41,6 +60,13 @@ static printing_state_t print_color_code(color_t      color,
 static void print_color_line(size_t height, background_t background);
 static const char *background_code(background_t background);
 static const char *color_code(color_t color);
+static int  buffer_vprintf(const char *format, va_list args);
+static int  buffer_printf(const char *format, ...);
+static void buffer_putchar(char symbol);
+static printing_state_t flush_buffer(void);
+static size_t strip_escape_codes(char *text, size_t length);
+static bool terminal_output(void);
+static uint64_t monotonic_ns(void);
 
 int color_printf(color_t      color,
                  boldness_t   is_bold,
@@ -48,54 +74,105 @@ int color_printf(color_t      color,
                  const char * format, ...) {
     C_ASSERT(format != NULL, return -1);
 
+    color_buffer.length = 0;
     print_color_code(color, is_bold, background);
 
     va_list args;
     va_start(args, format);
-    int printed_symbols = vprintf(format, args);
+    int printed_symbols = buffer_vprintf(format, args);
+    va_end(args);
 
     reset_color();
+    flush_buffer();
+    return printed_symbols;
+}
+
+int color_printf_limited(color_rate_limit_t *limit,
+                         size_t              max_per_second,
+                         color_t             color,
+                         boldness_t          is_bold,
+                         background_t        background,
+                         const char *        format, ...) {
+    C_ASSERT(limit  != NULL, return -1);
+    C_ASSERT(format != NULL, return -1);
+
+    const uint64_t second = 1000000000;
+    size_t suppressed = 0;
+
+    uint64_t now          = monotonic_ns();
+    uint64_t window_start = __atomic_load_n(&limit->window_start_ns, __ATOMIC_RELAXED);
+    if((window_start == 0 || now - window_start >= second) &&
+       __atomic_compare_exchange_n(&limit->window_start_ns, &window_start, now,
+                                   false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        suppressed = __atomic_exchange_n(&limit->suppressed, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&limit->printed, 0, __ATOMIC_RELAXED);
+    }
+
+    if(__atomic_fetch_add(&limit->printed, 1, __ATOMIC_RELAXED) >= max_per_second) {
+        __atomic_fetch_add(&limit->suppressed, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    color_buffer.length = 0;
+    print_color_code(color, is_bold, background);
+    if(suppressed != 0)
+        buffer_printf("(%zu similar messages suppressed)\n", suppressed);
+
+    va_list args;
+    va_start(args, format);
+    int printed_symbols = buffer_vprintf(format, args);
     va_end(args);
+
+    reset_color();
+    flush_buffer();
     return printed_symbols;
 }
 
 printing_state_t print_color_code(color_t      color,
                                   boldness_t   is_bold,
                                   background_t background) {
-    printf("%s", color_code_start);
+    buffer_printf("%s", color_code_start);
     if(is_bold == BOLD_TEXT) {
-        printf("%s", bold);
+        buffer_printf("%s", bold);
         if(color != DEFAULT_TEXT || background != DEFAULT_BACKGROUND)
-            putchar(';');
+            buffer_putchar(';');
 
         else {
-            putchar('m');
+            buffer_putchar('m');
             return PRINTING_SUCCESS;
         }
     }
     if(color != DEFAULT_TEXT) {
         const char *code = color_code(color);
         C_ASSERT(code != NULL, );
-        printf("%s", code);
+        buffer_printf("%s", code);
         if(background != DEFAULT_BACKGROUND)
-            putchar(';');
+            buffer_putchar(';');
         else {
-            putchar('m');
+            buffer_putchar('m');
             return PRINTING_SUCCESS;
         }
     }
     if(background != DEFAULT_BACKGROUND) {
         const char *code = background_code(background);
         C_ASSERT(code != NULL, );
-        printf("%sm", code);
+        buffer_printf("%sm", code);
         return PRINTING_SUCCESS;
     }
     return reset_color();
 }
 
 printing_state_t reset_color(void){
-    if(printf("%s0m", color_code_start) <= 0)
+    //reset code always fits, it has reserved place in buffer
+    size_t space = COLOR_BUFFER_SIZE - color_buffer.length;
+    int printed = snprintf(color_buffer.text + color_buffer.length,
+                           space,
+                           "%s0m",
+                           color_code_start);
+    if(printed <= 0 || (size_t)printed >= space)
         return PRINTING_FAILURE;
+
+    color_buffer.length += (size_t)printed;
     return PRINTING_SUCCESS;
 }
 
@@ -149,15 +226,104 @@ const char *background_code(background_t background) {
 
 void patriot() {
     const size_t line_height = 2;
+    color_buffer.length = 0;
     print_color_line(line_height, WHITE_BACKGROUND);
     print_color_line(line_height, BLUE_BACKGROUND );
     print_color_line(line_height, RED_BACKGROUND  );
-    putchar('\n');
+    buffer_putchar('\n');
+    flush_buffer();
 }
 
 void print_color_line(size_t height, background_t background) {
     print_color_code(DEFAULT_TEXT, NORMAL_TEXT, background);
     for(size_t h = 0; h < height; h++)
-        putchar('\n');
+        buffer_putchar('\n');
     reset_color();
 }
+
+//returns length of formatted text even if it was cut, as vprintf does
+int buffer_vprintf(const char *format, va_list args) {
+    size_t space = COLOR_BUFFER_SIZE - COLOR_RESET_RESERVE - color_buffer.length;
+    int printed = vsnprintf(color_buffer.text + color_buffer.length,
+                            space,
+                            format,
+                            args);
+    if(printed < 0)
+        return printed;
+
+    if((size_t)printed < space)
+        color_buffer.length += (size_t)printed;
+    else
+        color_buffer.length += space - 1;
+    return printed;
+}
+
+int buffer_printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int printed = buffer_vprintf(format, args);
+    va_end(args);
+    return printed;
+}
+
+void buffer_putchar(char symbol) {
+    if(color_buffer.length + COLOR_RESET_RESERVE + 1 < COLOR_BUFFER_SIZE)
+        color_buffer.text[color_buffer.length++] = symbol;
+}
+
+//writes whole buffer to stdout with one system call, without escape codes
+//if stdout is not a terminal
+printing_state_t flush_buffer(void) {
+    if(!terminal_output())
+        color_buffer.length = strip_escape_codes(color_buffer.text,
+                                                 color_buffer.length);
+
+    //text printed with printf before must appear before this message
+    fflush(stdout);
+
+    const char *text = color_buffer.text;
+    size_t      left = color_buffer.length;
+    color_buffer.length = 0;
+
+    while(left != 0) {
+        ssize_t written = write(STDOUT_FILENO, text, left);
+        if(written < 0) {
+            if(errno == EINTR)
+                continue;
+            return PRINTING_FAILURE;
+        }
+        text += written;
+        left -= (size_t)written;
+    }
+    return PRINTING_SUCCESS;
+}
+
+//removes "ESC [ parameters final-byte" sequences, returns new length
+size_t strip_escape_codes(char *text, size_t length) {
+    size_t stripped_length = 0;
+    for(size_t symbol = 0; symbol < length; symbol++) {
+        if(text[symbol] == '\033' && symbol + 1 < length && text[symbol + 1] == '[') {
+            symbol += 2;
+            while(symbol < length && (text[symbol] < 0x40 || text[symbol] > 0x7E))
+                symbol++;
+            continue;
+        }
+        text[stripped_length++] = text[symbol];
+    }
+    return stripped_length;
+}
+
+bool terminal_output(void) {
+    int is_terminal = __atomic_load_n(&output_is_terminal, __ATOMIC_RELAXED);
+    if(is_terminal < 0) {
+        is_terminal = isatty(STDOUT_FILENO) ? 1 : 0;
+        __atomic_store_n(&output_is_terminal, is_terminal, __ATOMIC_RELAXED);
+    }
+    return is_terminal == 1;
+}
+
+uint64_t monotonic_ns(void) {
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
@@ -3,12 +3,19 @@
 #include "custom_assert.h"
 #include "colors.h"
 
-void print_assert_error(const char *expression,
-                        int         line_number,
-                        const char *filename) {
-    color_printf(RED_TEXT, BOLD_TEXT, DEFAULT_BACKGROUND,
-                 "-<<CUSTOM ASSERT>>-\n"
-                 "Caught error on line %d of file \"%s\"\n"
-                 "Expression: %s\n",
-                 line_number, filename, expression);
+//assertion failing in hot loop is reported few times per second
+static const size_t ASSERT_REPORTS_PER_SECOND = 4;
+
+void print_assert_error(assert_site_t *site,
+                        const char *   expression,
+                        int            line_number,
+                        const char *   filename) {
+    size_t failures = __atomic_add_fetch(&site->failures, 1, __ATOMIC_RELAXED);
+    color_printf_limited(&site->reports, ASSERT_REPORTS_PER_SECOND,
+                         RED_TEXT, BOLD_TEXT, DEFAULT_BACKGROUND,
+                         "-<<CUSTOM ASSERT>>-\n"
+                         "Caught error on line %d of file \"%s\"\n"
+                         "Expression: %s\n"
+                         "Failures here: %zu\n",
+                         line_number, filename, expression, failures);
 }
@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <malloc.h>
 
 #include "memory.h"
 #include "colors.h"
@@ -50,6 +52,54 @@ void *_calloc(size_t number,
     return memory_cell;
 }
 
+void *_aligned_calloc(size_t number,
+                      size_t element_size,
+                      size_t alignment) {
+    void *memory_cell = NULL;
+    if(posix_memalign(&memory_cell, alignment, number * element_size) != 0)
+        return NULL;
+
+    memset(memory_cell, 0, number * element_size);
+    MEMORY_LOG(MEMORY_ALLOCATION, memory_cell, number, element_size);
+    return memory_cell;
+}
+
+void *_aligned_recalloc(void * memory_cell,
+                        size_t old_size,
+                        size_t new_size,
+                        size_t element_size,
+                        size_t alignment) {
+    if(memory_cell == NULL)
+        return _aligned_calloc(new_size, element_size, alignment);
+
+    //realloc keeps malloc alignment, and block which already has room for
+    //new size is not moved, only then block is not copied here, realloc
+    //which moves block to less aligned address frees old one, so failed
+    //aligned allocation after it would lose elements which caller still has
+    size_t new_bytes = new_size * element_size;
+    if(new_bytes != 0 && alignment <= alignof(max_align_t))
+        return _recalloc(memory_cell, old_size, new_size, element_size);
+
+    if(new_size > old_size && new_bytes <= malloc_usable_size(memory_cell)) {
+        MEMORY_LOG(MEMORY_REALLOCATION, memory_cell, old_size, memory_cell, new_size);
+        memset((char *)memory_cell + old_size * element_size,
+               0,
+               (new_size - old_size) * element_size);
+        return memory_cell;
+    }
+
+    //old block stays untouched if allocation fails
+    void *new_memory_cell = _aligned_calloc(new_size, element_size, alignment);
+    if(new_memory_cell == NULL)
+        return NULL;
+
+    memcpy(new_memory_cell,
+           memory_cell,
+           (old_size < new_size ? old_size : new_size) * element_size);
+    _free(memory_cell);
+    return new_memory_cell;
+}
+
 void _free(void *memory_cell) {
     MEMORY_LOG(MEMORY_FREE, memory_cell);
     free(memory_cell);
@@ -60,7 +110,7 @@ void _free(void *memory_cell) {
         if(log_file == NULL) {
             log_file = fopen(LOG_FILE_NAME, "wb");
             if(log_file == NULL) {
-                color_printf(RED_TEXT, BOLD_TEXT, DEFAULT_BACKGROUND,
+                COLOR_PRINTF_LIMITED(1, RED_TEXT, BOLD_TEXT, DEFAULT_BACKGROUND,
                 "Error opening memory dump file.\n");
                 return ;
             }
@@ -146,7 +196,10 @@ void _free(void *memory_cell) {
 
 void _memory_destroy_log(void) {
     #ifndef NDEBUG
+        if(log_file == NULL)
+            return ;
         MEMORY_LOG(MEMORY_LOG_CLOSE, NULL);
         fclose(log_file);
+        log_file = NULL;
     #endif
 }
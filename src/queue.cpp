@@ -0,0 +1,569 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "stack.h"
+#include "stack_internal.h"
+#include "queue.h"
+#include "memory.h"
+#include "colors.h"
+#include "custom_assert.h"
+
+//==============================================================================
+//QUEUE MEMORY IS ONE BLOCK:
+//[queue_t][left canary][elements][hashes of elements][right canary]
+//head AND tail ARE NEVER WRAPPED, SLOT IS position & mask
+//==============================================================================
+struct queue_t {
+    #ifdef STACK_CANARY_PROTECTION
+        canary_t  structure_left_canary;
+        canary_t *data_left_canary;
+        canary_t *data_right_canary;
+    #endif
+
+    #ifdef STACK_HASH_PROTECTION
+        hash_t    structure_hash;
+        hash_t *  slot_hashes;
+    #endif
+
+    #ifdef STACK_WRITE_DUMP
+        stack_dump_sink_t *dump_sink;
+        const char *       initialized_file;
+        const char *       initialized_varname;
+        const char *       initialized_function;
+        size_t             initialized_line;
+        int              (*print_func)(FILE *, void *);
+    #endif
+
+    size_t id;
+    char * data;
+
+    //fields from capacity to head_padding are covered by structure hash
+    size_t capacity;
+    size_t mask;
+    size_t element_size;
+
+    //producer and consumer positions are on different cache lines
+    char   head_padding[STACK_CACHE_LINE];
+    size_t head;        //written by consumer
+    size_t cached_tail; //consumer's copy of tail
+    char   tail_padding[STACK_CACHE_LINE];
+    size_t tail;        //written by producer
+    size_t cached_head; //producer's copy of head
+    char   end_padding[STACK_CACHE_LINE];
+
+    #ifdef STACK_CANARY_PROTECTION
+        canary_t structure_right_canary;
+    #endif
+};
+
+//==============================================================================
+//OFFSETS OF QUEUE PARTS FROM START OF QUEUE MEMORY
+//==============================================================================
+struct queue_layout_t {
+    size_t data;
+    size_t hashes;
+    size_t right_canary;
+    size_t total;
+};
+
+//==============================================================================
+//MACRO TO WRITE DUMP OF QUEUE WITH ERROR
+//==============================================================================
+#ifdef STACK_WRITE_DUMP
+    #define QUEUE_DUMP(__queue, __error)     \
+        queue_dump((__queue),                \
+                   __FILE_NAME__,            \
+                   __PRETTY_FUNCTION__,      \
+                   __LINE__,                 \
+                   (__error))
+#else
+    #define QUEUE_DUMP(...)
+#endif
+
+//==============================================================================
+//FUNCTIONS PROTOTYPES
+//==============================================================================
+static queue_layout_t queue_calculate_layout(size_t capacity,
+                                             size_t element_size);
+static size_t         align_up              (size_t value,
+                                             size_t alignment);
+static stack_error_t  queue_verify          (queue_t *queue);
+static stack_error_t  queue_store_slots     (queue_t *   queue,
+                                             const char *elements,
+                                             size_t      position,
+                                             size_t      count);
+static stack_error_t  queue_load_slots      (queue_t *queue,
+                                             char *   output,
+                                             size_t   position,
+                                             size_t   count);
+
+#ifdef STACK_HASH_PROTECTION
+    static hash_t queue_structure_hash(const queue_t *queue);
+#endif
+
+#ifdef STACK_CANARY_PROTECTION
+    static canary_t queue_canary_value(const queue_t *queue,
+                                       const void *   canary);
+#endif
+
+#ifdef STACK_WRITE_DUMP
+    static stack_error_t queue_dump(queue_t *     queue,
+                                    const char *  file_name,
+                                    const char *  function_name,
+                                    size_t        line,
+                                    stack_error_t call_reason);
+#endif
+
+//==============================================================================
+//GLOBAL FUNCTION
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//INITIALIZES QUEUE, CAPACITY NEVER CHANGES
+//------------------------------------------------------------------------------
+queue_t *queue_init(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                        const char *initialized_file,
+                                        const char *initialized_varname,
+                                        const char *initialized_function,
+                                        size_t      initialized_line,
+                                        int       (*print_func)(FILE *, void *),)
+                    size_t capacity,
+                    size_t element_size) {
+    C_ASSERT_ALWAYS(element_size != 0, return NULL);
+
+    size_t rounded_capacity = 1;
+    while(rounded_capacity < capacity)
+        rounded_capacity <<= 1;
+
+    queue_layout_t layout = queue_calculate_layout(rounded_capacity, element_size);
+    queue_t *queue = (queue_t *)_calloc(layout.total, 1);
+    if(queue == NULL)
+        return NULL;
+
+    queue->id           = stack_new_id();
+    queue->capacity     = rounded_capacity;
+    queue->mask         = rounded_capacity - 1;
+    queue->element_size = element_size;
+    queue->data         = (char *)queue + layout.data;
+
+    #ifdef STACK_HASH_PROTECTION
+        queue->slot_hashes    = (hash_t *)((char *)queue + layout.hashes);
+        queue->structure_hash = queue_structure_hash(queue);
+    #endif
+
+    #ifdef STACK_CANARY_PROTECTION
+        queue->data_left_canary       = (canary_t *)(queue + 1);
+        queue->data_right_canary      = (canary_t *)((char *)queue + layout.right_canary);
+        *(queue->data_left_canary)    = queue_canary_value(queue,
+                                                           queue->data_left_canary);
+        *(queue->data_right_canary)   = queue_canary_value(queue,
+                                                           queue->data_right_canary);
+        queue->structure_left_canary  = queue_canary_value(queue,
+                                                           &queue->structure_left_canary);
+        queue->structure_right_canary = queue_canary_value(queue,
+                                                           &queue->structure_right_canary);
+    #endif
+
+    #ifdef STACK_WRITE_DUMP
+        C_ASSERT(initialized_file     != NULL, {_free(queue); return NULL;});
+        C_ASSERT(initialized_varname  != NULL, {_free(queue); return NULL;});
+        C_ASSERT(initialized_function != NULL, {_free(queue); return NULL;});
+        C_ASSERT(print_func           != NULL, {_free(queue); return NULL;});
+
+        queue->initialized_file     = initialized_file;
+        queue->initialized_varname  = initialized_varname;
+        queue->initialized_function = initialized_function;
+        queue->initialized_line     = initialized_line;
+        queue->print_func           = print_func;
+        queue->dump_sink            = stack_dump_sink_acquire(dump_filename);
+        if(queue->dump_sink == NULL) {
+            _free(queue);
+            return NULL;
+        }
+    #endif
+
+    if(queue_verify(queue) != STACK_SUCCESS) {
+        queue_destroy(&queue);
+        return NULL;
+    }
+    return queue;
+}
+
+//------------------------------------------------------------------------------
+//ADDS ELEMENT TO THE END OF QUEUE
+//------------------------------------------------------------------------------
+stack_error_t queue_enqueue(queue_t *queue, const void *element) {
+    size_t enqueued = 0;
+    stack_error_t enqueue_state = queue_enqueue_batch(queue, element, 1, &enqueued);
+    if(enqueue_state != STACK_SUCCESS)
+        return enqueue_state;
+
+    return enqueued == 1 ? STACK_SUCCESS : STACK_FULL;
+}
+
+//------------------------------------------------------------------------------
+//ADDS UP TO count ELEMENTS, enqueued IS NUMBER OF ADDED ONES
+//------------------------------------------------------------------------------
+stack_error_t queue_enqueue_batch(queue_t *   queue,
+                                  const void *elements,
+                                  size_t      count,
+                                  size_t *    enqueued) {
+    C_ASSERT(queue    != NULL                 , return STACK_NULL          );
+    C_ASSERT(elements != NULL || count == 0   , return STACK_INVALID_INPUT );
+    C_ASSERT(enqueued != NULL                 , return STACK_INVALID_OUTPUT);
+
+    *enqueued = 0;
+    stack_error_t verify_state = queue_verify(queue);
+    if(verify_state != STACK_SUCCESS)
+        return verify_state;
+
+    size_t tail = queue->tail;
+    size_t free = queue->capacity - (tail - queue->cached_head);
+    if(free < count) {
+        queue->cached_head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        free = queue->capacity - (tail - queue->cached_head);
+    }
+
+    size_t batch = count < free ? count : free;
+    if(batch == 0)
+        return STACK_SUCCESS;
+
+    stack_error_t store_state = queue_store_slots(queue,
+                                                  (const char *)elements,
+                                                  tail,
+                                                  batch);
+    if(store_state != STACK_SUCCESS)
+        return store_state;
+
+    __atomic_store_n(&queue->tail, tail + batch, __ATOMIC_RELEASE);
+    *enqueued = batch;
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//TAKES ELEMENT FROM THE BEGINNING OF QUEUE
+//------------------------------------------------------------------------------
+stack_error_t queue_dequeue(queue_t *queue, void *output) {
+    size_t dequeued = 0;
+    stack_error_t dequeue_state = queue_dequeue_batch(queue, output, 1, &dequeued);
+    if(dequeue_state != STACK_SUCCESS)
+        return dequeue_state;
+
+    return dequeued == 1 ? STACK_SUCCESS : STACK_EMPTY;
+}
+
+//------------------------------------------------------------------------------
+//TAKES UP TO count ELEMENTS, dequeued IS NUMBER OF TAKEN ONES
+//ELEMENTS ARE CHECKED WITH THEIR HASHES BEFORE THEY ARE GIVEN AWAY
+//------------------------------------------------------------------------------
+stack_error_t queue_dequeue_batch(queue_t *queue,
+                                  void *   output,
+                                  size_t   count,
+                                  size_t * dequeued) {
+    C_ASSERT(queue    != NULL              , return STACK_NULL          );
+    C_ASSERT(output   != NULL || count == 0, return STACK_INVALID_OUTPUT);
+    C_ASSERT(dequeued != NULL              , return STACK_INVALID_OUTPUT);
+
+    *dequeued = 0;
+    stack_error_t verify_state = queue_verify(queue);
+    if(verify_state != STACK_SUCCESS)
+        return verify_state;
+
+    size_t head  = queue->head;
+    size_t ready = queue->cached_tail - head;
+    if(ready < count) {
+        queue->cached_tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+        ready = queue->cached_tail - head;
+    }
+
+    size_t batch = count < ready ? count : ready;
+    if(batch == 0)
+        return STACK_SUCCESS;
+
+    stack_error_t load_state = queue_load_slots(queue, (char *)output, head, batch);
+    if(load_state != STACK_SUCCESS)
+        return load_state;
+
+    __atomic_store_n(&queue->head, head + batch, __ATOMIC_RELEASE);
+    *dequeued = batch;
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//RETURNS NUMBER OF ELEMENTS, IT MAY BE CHANGED BY OTHER THREAD AT ONCE
+//------------------------------------------------------------------------------
+size_t queue_size(queue_t *queue) {
+    C_ASSERT(queue != NULL, return 0);
+
+    size_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    size_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    return tail - head;
+}
+
+//------------------------------------------------------------------------------
+//DESTROYS QUEUE, NEITHER PRODUCER NOR CONSUMER MUST USE IT
+//------------------------------------------------------------------------------
+stack_error_t queue_destroy(queue_t **queue) {
+    C_ASSERT(queue != NULL, return STACK_NULL);
+    if(*queue == NULL)
+        return STACK_NULL;
+
+    #ifdef STACK_WRITE_DUMP
+        if((*queue)->dump_sink != NULL)
+            stack_dump_sink_release((*queue)->dump_sink);
+    #endif
+
+    _free(*queue);
+    *queue = NULL;
+    return STACK_SUCCESS;
+}
+
+//==============================================================================
+//STATIC FUNCTIONS
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//COUNTS WHERE PARTS OF QUEUE ARE PLACED
+//------------------------------------------------------------------------------
+queue_layout_t queue_calculate_layout(size_t capacity,
+                                      size_t element_size) {
+    queue_layout_t layout = {};
+    layout.data = sizeof(queue_t);
+
+    #ifdef STACK_CANARY_PROTECTION
+        layout.data += sizeof(canary_t);
+    #endif
+
+    layout.hashes       = align_up(layout.data + capacity * element_size,
+                                   sizeof(uint64_t));
+    layout.right_canary = layout.hashes;
+
+    #ifdef STACK_HASH_PROTECTION
+        layout.right_canary += capacity * sizeof(hash_t);
+    #endif
+
+    layout.total = layout.right_canary;
+
+    #ifdef STACK_CANARY_PROTECTION
+        layout.total += sizeof(canary_t);
+    #endif
+
+    return layout;
+}
+
+//------------------------------------------------------------------------------
+//ROUNDS VALUE UP TO MULTIPLE OF ALIGNMENT
+//------------------------------------------------------------------------------
+size_t align_up(size_t value,
+                size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+//------------------------------------------------------------------------------
+//CHECKS FIELDS WHICH DO NOT CHANGE AFTER INIT, WRITES DUMP ON ERROR
+//------------------------------------------------------------------------------
+stack_error_t queue_verify(queue_t *queue) {
+    stack_error_t error = STACK_SUCCESS;
+
+    queue_layout_t layout = queue_calculate_layout(queue->capacity,
+                                                   queue->element_size);
+
+    if(queue->data == NULL)
+        error = STACK_NULL_DATA;
+    else if(queue->capacity == 0 || (queue->capacity & queue->mask) != 0 ||
+            queue->mask != queue->capacity - 1)
+        error = STACK_INVALID_CAPACITY;
+    else if(queue->data != (char *)queue + layout.data)
+        error = STACK_INVALID_DATA;
+
+    #ifdef STACK_CANARY_PROTECTION
+        else if(queue->structure_left_canary !=
+                queue_canary_value(queue, &queue->structure_left_canary))
+            error = STACK_UNEXPECTED_LEFT_CANARY;
+        else if(queue->structure_right_canary !=
+                queue_canary_value(queue, &queue->structure_right_canary))
+            error = STACK_UNEXPECTED_RIGHT_CANARY;
+        else if(*(queue->data_left_canary) !=
+                queue_canary_value(queue, queue->data_left_canary))
+            error = STACK_UNEXPECTED_DATA_LEFT_CANARY;
+        else if(*(queue->data_right_canary) !=
+                queue_canary_value(queue, queue->data_right_canary))
+            error = STACK_UNEXPECTED_DATA_RIGHT_CANARY;
+    #endif
+
+    #ifdef STACK_HASH_PROTECTION
+        else if(queue->structure_hash != queue_structure_hash(queue))
+            error = STACK_UNEXPECTED_STRUCTURE_HASH;
+    #endif
+
+    if(error != STACK_SUCCESS) {
+        QUEUE_DUMP(queue, error);
+    }
+    return error;
+}
+
+//------------------------------------------------------------------------------
+//COPIES ELEMENTS TO SLOTS FROM position, BUFFER END IS WRAPPED
+//------------------------------------------------------------------------------
+stack_error_t queue_store_slots(queue_t *   queue,
+                                const char *elements,
+                                size_t      position,
+                                size_t      count) {
+    size_t slot       = position & queue->mask;
+    size_t first_part = queue->capacity - slot;
+    if(first_part > count)
+        first_part = count;
+
+    memcpy(queue->data + slot * queue->element_size,
+           elements,
+           first_part * queue->element_size);
+    memcpy(queue->data,
+           elements + first_part * queue->element_size,
+           (count - first_part) * queue->element_size);
+
+    #ifdef STACK_HASH_PROTECTION
+        for(size_t index = 0; index < count; index++) {
+            const char *element = queue->data +
+                                  ((position + index) & queue->mask) *
+                                  queue->element_size;
+            queue->slot_hashes[(position + index) & queue->mask] =
+                hash_function(element, element + queue->element_size);
+        }
+    #endif
+
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//CHECKS AND COPIES ELEMENTS FROM SLOTS FROM position, BUFFER END IS WRAPPED
+//------------------------------------------------------------------------------
+stack_error_t queue_load_slots(queue_t *queue,
+                               char *   output,
+                               size_t   position,
+                               size_t   count) {
+    #ifdef STACK_HASH_PROTECTION
+        for(size_t index = 0; index < count; index++) {
+            const char *element = queue->data +
+                                  ((position + index) & queue->mask) *
+                                  queue->element_size;
+            if(queue->slot_hashes[(position + index) & queue->mask] !=
+               hash_function(element, element + queue->element_size)) {
+                QUEUE_DUMP(queue, STACK_UNEXPECTED_DATA_HASH);
+                return STACK_UNEXPECTED_DATA_HASH;
+            }
+        }
+    #endif
+
+    size_t slot       = position & queue->mask;
+    size_t first_part = queue->capacity - slot;
+    if(first_part > count)
+        first_part = count;
+
+    memcpy(output,
+           queue->data + slot * queue->element_size,
+           first_part * queue->element_size);
+    memcpy(output + first_part * queue->element_size,
+           queue->data,
+           (count - first_part) * queue->element_size);
+    return STACK_SUCCESS;
+}
+
+#ifdef STACK_HASH_PROTECTION
+    //------------------------------------------------------------------------------
+    //HASH OF FIELDS WHICH DO NOT CHANGE AFTER INIT
+    //------------------------------------------------------------------------------
+    hash_t queue_structure_hash(const queue_t *queue) {
+        return hash_function(&queue->capacity,
+                             &queue->head_padding);
+    }
+#endif
+
+#ifdef STACK_CANARY_PROTECTION
+    //------------------------------------------------------------------------------
+    //CANARY VALUE DEPENDS ON ITS OFFSET FROM QUEUE START, AS IN STACK
+    //------------------------------------------------------------------------------
+    canary_t queue_canary_value(const queue_t *queue,
+                                const void *   canary) {
+        return (canary_t)((const char *)canary -
+                          (const char *)queue) ^ CANARY_HEX_SPEAK;
+    }
+#endif
+
+#ifdef STACK_WRITE_DUMP
+    //------------------------------------------------------------------------------
+    //WRITES QUEUE INFORMATION IN SHARED DUMP FILE, SAME FORMAT AS STACK DUMP
+    //ELEMENTS ARE WRITTEN FROM HEAD TO TAIL
+    //------------------------------------------------------------------------------
+    stack_error_t queue_dump(queue_t *     queue,
+                             const char *  file_name,
+                             const char *  function_name,
+                             size_t        line,
+                             stack_error_t call_reason) {
+        FILE *dump_file = NULL;
+        if(queue->dump_sink == NULL ||
+           (dump_file = stack_dump_sink_lock(queue->dump_sink)) == NULL) {
+            color_printf(RED_TEXT, BOLD_TEXT, DEFAULT_BACKGROUND,
+                         "MEMORY DUMP FILE ERROR\r\n"
+                         "called from: %s:%zu\r\n",
+                         file_name,
+                         line);
+            return STACK_DUMP_ERROR;
+        }
+
+        const char *error_definition = get_error_text(call_reason);
+        if(error_definition == NULL)
+            error_definition = "'unknown error'";
+
+        size_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        size_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+        stack_error_t dump_state = STACK_SUCCESS;
+        if(fprintf(dump_file,
+                   "queue_t #%zu [0x%p] initialized in %s:%zu as "
+                   "'queue_t %s' in function '%s'\r\n"
+                   "dump called from %s:%zu '%s'\r\n"
+                   "ERROR = '%s'\r\n"
+                   "{\r\n"
+                   "\t\t---DEFAULT_INFO---\r\n"
+                   "\thead              =   %zu;\r\n"
+                   "\ttail              =   %zu;\r\n"
+                   "\tcapacity          =   %zu;\r\n"
+                   "\telement_size      =   %zu;\r\n"
+                   "\t\t---MEMBERS---\r\n",
+                   queue->id,
+                   queue,
+                   queue->initialized_file,
+                   queue->initialized_line,
+                   queue->initialized_varname,
+                   queue->initialized_function,
+                   file_name,
+                   line,
+                   function_name,
+                   error_definition,
+                   head,
+                   tail,
+                   queue->capacity,
+                   queue->element_size) < 0)
+            dump_state = STACK_DUMP_ERROR;
+
+        for(size_t position = head;
+            dump_state == STACK_SUCCESS && position != tail &&
+            position - head < queue->capacity;
+            position++) {
+            if(fprintf(dump_file, "\t    [%zu] = ", position & queue->mask) < 0 ||
+               queue->print_func(dump_file,
+                                 queue->data +
+                                 (position & queue->mask) *
+                                 queue->element_size) < 0 ||
+               fprintf(dump_file, ";\r\n") < 0)
+                dump_state = STACK_DUMP_ERROR;
+        }
+
+        if(dump_state == STACK_SUCCESS && fprintf(dump_file, "}\r\n\r\n") < 0)
+            dump_state = STACK_DUMP_ERROR;
+
+        stack_dump_sink_unlock(queue->dump_sink, true);
+        return dump_state;
+    }
+#endif
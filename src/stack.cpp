@@ -2,8 +2,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <sched.h>
 
 #include "stack.h"
+#include "stack_internal.h"
+#include "stack_trace.h"
 #include "memory.h"
 #include "colors.h"
 #include "custom_assert.h"
@@ -11,9 +15,18 @@
 //==============================================================================
 //PROTECTION MODES ON
 //==============================================================================
-#define STACK_HASH_PROTECTION
-#define STACK_CANARY_PROTECTION
-#define STACK_WRITE_DUMP
+#ifndef STACK_NO_HASH_PROTECTION
+    #define STACK_HASH_PROTECTION
+#endif
+#ifndef STACK_NO_CANARY_PROTECTION
+    #define STACK_CANARY_PROTECTION
+#endif
+#ifndef STACK_NO_WRITE_DUMP
+    #define STACK_WRITE_DUMP
+#endif
+#ifndef STACK_NO_STRONG_GUARANTEE
+    #define STACK_STRONG_GUARANTEE
+#endif
 
 //==============================================================================
 //OPERATIONS WITH STACK
@@ -21,6 +34,7 @@
 enum stack_operation_t {
     STACK_OPERATION_PUSH,
     STACK_OPERATION_POP ,
+    STACK_OPERATION_TRIM, //shrink to size or init_capacity at once
 };
 
 //==============================================================================
@@ -33,12 +47,17 @@ enum stack_operation_t {
 
 //==============================================================================
 //MACRO TO CHECK IF STACK SIZE IS SUFFICIENT AND EXPAND IT IF NEEDED
+//RECOVERABLE ERRORS (STACK_FULL, FAILED GROW) ARE RETURNED WITHOUT DESTROYING
 //==============================================================================
-#define STACK_CHECK_SIZE(__stack_pointer, __operation) {            \
+#define STACK_CHECK_SIZE(__stack_pointer, __operation, __count) {   \
     stack_error_t __error_code = stack_check_size((__stack_pointer),\
-                                                  (__operation));   \
-    if((__error_code) != STACK_SUCCESS)                             \
+                                                  (__operation),    \
+                                                  (__count));       \
+    if((__error_code) != STACK_SUCCESS) {                           \
+        if(stack_error_is_recoverable(__error_code))                \
+            return (__error_code);                                  \
         STACK_RETURN_ERROR(*(__stack_pointer), (__error_code));     \
+    }                                                               \
 }
 
 //==============================================================================
@@ -54,12 +73,49 @@ enum stack_operation_t {
     }                                                          \
 }
 
+//==============================================================================
+//PUSH AND POP READ ONLY FIRST CACHE LINE OF STACK STRUCTURE
+//==============================================================================
+#ifdef STACK_HASH_PROTECTION
+    static_assert(offsetof(stack_t, structure_hash) + sizeof(hash_t) <= STACK_CACHE_LINE,
+                  "hot fields of stack_t do not fit in one cache line");
+#else
+    static_assert(offsetof(stack_t, kernel) + sizeof(const stack_kernel_t *) <= STACK_CACHE_LINE,
+                  "hot fields of stack_t do not fit in one cache line");
+#endif
+
+//==============================================================================
+//IDENTIFIER OF NEXT INITIALIZED STACK
+//==============================================================================
+static size_t next_stack_id = 0;
+
 //==============================================================================
 //FUNCTIONS PROTOTYPES
 //==============================================================================
+static stack_t *     stack_create(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                      const char *initialized_file,
+                                                      const char *initialized_varname,
+                                                      const char *initialized_function,
+                                                      size_t      initialized_line,
+                                                      int       (*print_func)(FILE *, void *),)
+                                  size_t capacity,
+                                  size_t                   element_size,
+                                  size_t                   alignment,
+                                  bool                     variable_size,
+                                  stack_combine_t          combine,
+                                  const stack_allocator_t *allocator);
 static stack_error_t stack_check_size(stack_t **        stack,
-                                      stack_operation_t operation);
-static stack_error_t stack_verify    (stack_t *stack);
+                                      stack_operation_t operation,
+                                      size_t            count);
+static void *        stack_reallocate          (stack_t *stack,
+                                                size_t   old_size,
+                                                size_t   new_size);
+static stack_error_t stack_limit_capacity      (stack_t *stack,
+                                                size_t   needed_capacity,
+                                                size_t * new_capacity);
+static bool          stack_error_is_recoverable(stack_error_t error);
+static void          stack_push_aggregate      (stack_t *stack);
+static size_t        stack_memory_alignment    (size_t alignment);
 
 //==============================================================================
 //STACK WRITE DUMP MODE
@@ -83,6 +139,21 @@ static stack_error_t stack_verify    (stack_t *stack);
     static const char *TEXT_STACK_UNEXPECTED_DATA_RIGHT_CANARY = "STACK_UNEXPECTED_DATA_RIGHT_CANARY";
     static const char *TEXT_STACK_UNEXPECTED_STRUCTURE_HASH    = "STACK_UNEXPECTED_STRUCTURE_HASH"   ;
     static const char *TEXT_STACK_UNEXPECTED_DATA_HASH         = "STACK_UNEXPECTED_DATA_HASH"        ;
+    static const char *TEXT_STACK_FULL                         = "STACK_FULL"                        ;
+    static const char *TEXT_STACK_IO_ERROR                     = "STACK_IO_ERROR"                    ;
+    static const char *TEXT_STACK_TIMEOUT                      = "STACK_TIMEOUT"                     ;
+    static const char *TEXT_STACK_NOT_FOUND                    = "STACK_NOT_FOUND"                   ;
+
+    //many broken stacks must not flood output with same error
+    static const size_t DUMP_ERROR_MESSAGES_PER_SECOND = 10;
+
+    //dumps write only changed slots, every DUMP_KEYFRAME_INTERVAL-th dump
+    //writes all of them, so stack can be restored from file at any record
+    static const size_t DUMP_KEYFRAME_INTERVAL = 64;
+
+    //how many times keyframe of stack owned by other thread is retried when
+    //stack is changed while it is written
+    static const size_t DUMP_KEYFRAME_ATTEMPTS = 4;
 
     #define STACK_DUMP(__stack_pointer, __error) {                  \
         stack_error_t __dump_error = stack_dump(__stack_pointer,    \
@@ -94,37 +165,56 @@ static stack_error_t stack_verify    (stack_t *stack);
             STACK_RETURN_ERROR(__stack_pointer, __dump_error);      \
     }
 
-    static stack_error_t stack_dump               (stack_t *     stack,
+    static stack_error_t stack_write_dump         (stack_t *     stack,
+                                                   FILE *        dump_file,
                                                    const char *  file_name,
                                                    const char *  function_name,
                                                    size_t        line,
-                                                   stack_error_t call_reason);
-    static const char *  get_error_text           (stack_error_t error);
-    static stack_error_t stack_write_members      (stack_t *stack);
-    static stack_error_t write_stack_members_flags(stack_t *stack);
+                                                   stack_error_t call_reason,
+                                                   size_t        corrupted_low,
+                                                   size_t        corrupted_high,
+                                                   bool          keyframe);
+    static stack_error_t stack_write_members      (stack_t *stack,
+                                                   FILE *   dump_file,
+                                                   bool     keyframe);
+    static stack_error_t write_stack_members_flags(stack_t *stack,
+                                                   FILE *   dump_file,
+                                                   size_t   first,
+                                                   size_t   last);
 #else
     #define STACK_DUMP(...)
 #endif
 
+//==============================================================================
+//SLOTS CHANGED BY OPERATION, DUMP WRITES THEM AND HASH REHASHES THEIR CHUNKS
+//==============================================================================
+#if defined(STACK_WRITE_DUMP) || defined(STACK_HASH_PROTECTION)
+    #define STACK_MARK_DIRTY(__stack_pointer, __first, __last) \
+        stack_mark_dirty((__stack_pointer), (__first), (__last))
+
+    static void stack_mark_dirty(stack_t *stack,
+                                 size_t   first,
+                                 size_t   last);
+#else
+    #define STACK_MARK_DIRTY(...)
+#endif
+
 //==============================================================================
 //PROTECTION OF STACK WITH HASH MODE
 //==============================================================================
 #ifdef STACK_HASH_PROTECTION
-    typedef uint64_t hash_t;
-
     #define STACK_UPDATE_HASH(__stack_pointer) {                        \
         stack_error_t __error_code = stack_update_hash(__stack_pointer);\
         if(__error_code != STACK_SUCCESS)                               \
             STACK_RETURN_ERROR(__stack_pointer, __error_code);          \
     }
 
-    static stack_error_t stack_update_hash   (stack_t *stack);
-    static stack_error_t stack_calculate_hashes(stack_t *stack,
-                                                hash_t * structure_hash,
-                                                hash_t * data_hash);
-    static hash_t        hash_function       (const void *start,
-                                              const void *end);
-    static stack_error_t stack_verify_hashes (stack_t *stack);
+    static hash_t        stack_data_hash       (const stack_t *stack);
+    static hash_t        stack_structure_hash  (const stack_t *stack);
+    static stack_error_t stack_verify_structure_hash(stack_t *stack);
+    static stack_error_t stack_verify_data_hash     (stack_t *stack,
+                                                     size_t * corrupted_low,
+                                                     size_t * corrupted_high);
 #else
     #define STACK_UPDATE_HASH(__stack_pointer)
 #endif
@@ -133,61 +223,21 @@ static stack_error_t stack_verify    (stack_t *stack);
 //PROTECTION OF STACK WITH CANARIES MODE
 //==============================================================================
 #ifdef STACK_CANARY_PROTECTION
-    typedef uint64_t canary_t;
-
-    const canary_t CANARY_HEX_SPEAK = 0xC0FFEEC0FFEE;
-
     #define STACK_UPDATE_CANARY(__stack_pointer) {                        \
         stack_error_t __error_code = stack_update_canary(__stack_pointer);\
         if(__error_code != STACK_SUCCESS)                                 \
             STACK_RETURN_ERROR(__stack_pointer, __error_code);            \
     }
 
-    static stack_error_t stack_update_canary       (stack_t *stack);
     static size_t        calculate_alignment_offset(size_t capacity,
                                                     size_t element_size);
     static stack_error_t stack_verify_canaries     (stack_t *stack);
+    static canary_t      stack_canary_value        (const stack_t *stack,
+                                                    const void *   canary);
 #else
     #define STACK_UPDATE_CANARY(__stack_pointer)
 #endif
 
-//==============================================================================
-//THE DEFINITION OF STACK STRUCTURE
-//==============================================================================
-struct stack_t {
-    #ifdef STACK_CANARY_PROTECTION
-        canary_t  structure_left_canary;
-        canary_t *data_left_canary;
-        canary_t *data_right_canary;
-        size_t    alignment_offset;
-    #endif
-
-    #ifdef STACK_HASH_PROTECTION
-        hash_t structure_hash;
-        hash_t data_hash;
-    #endif
-
-    #ifdef STACK_WRITE_DUMP
-        FILE *      dump_file;
-        const char *dump_filename;
-        const char *initialized_file;
-        const char *initialized_varname;
-        const char *initialized_function;
-        size_t      initialized_line;
-        int       (*print_func)(FILE *, void *);
-    #endif
-
-    size_t size;
-    size_t capacity;
-    size_t init_capacity;
-    size_t element_size;
-    char * data;
-
-    #ifdef STACK_CANARY_PROTECTION
-        canary_t structure_right_canary;
-    #endif
-};
-
 //==============================================================================
 //GLOBAL FUNCTION
 //==============================================================================
@@ -203,70 +253,139 @@ stack_t *stack_init(STACK_WRITE_DUMP_ON(const char *dump_filename,
                                         int       (*print_func)(FILE *, void *),)
                     size_t capacity,
                     size_t element_size) {
-    C_ASSERT(element_size != 0, return NULL);
-    #ifdef STACK_WRITE_DUMP
-        C_ASSERT(dump_filename        != NULL, return NULL);
-        C_ASSERT(initialized_file     != NULL, return NULL);
-        C_ASSERT(initialized_varname  != NULL, return NULL);
-        C_ASSERT(initialized_function != NULL, return NULL);
-        C_ASSERT(print_func           != NULL, return NULL);
-    #endif
-
-    size_t allocation_size = sizeof(stack_t) + capacity * element_size;
-
-    #ifdef STACK_CANARY_PROTECTION
-        size_t alignment_offset = calculate_alignment_offset(capacity, element_size);
-        allocation_size += alignment_offset + 2 * sizeof(canary_t);
-    #endif
-
-    stack_t *stack = (stack_t *)_calloc(allocation_size, 1);
-    if(stack == NULL)
-        return NULL;
-
-    stack->capacity = capacity;
-    stack->element_size = element_size;
-    stack->init_capacity = capacity;
-    stack->data = (char *)stack + sizeof(stack_t);
+    C_ASSERT_ALWAYS(element_size != 0, return NULL);
+
+    return stack_create(STACK_WRITE_DUMP_ON(dump_filename,
+                                            initialized_file,
+                                            initialized_varname,
+                                            initialized_function,
+                                            initialized_line,
+                                            print_func,)
+                        capacity,
+                        element_size,
+                        STACK_DEFAULT_ALIGNMENT,
+                        false,
+                        NULL,
+                        NULL);
+}
 
-    #ifdef STACK_CANARY_PROTECTION
-        stack->data              = stack->data + sizeof(canary_t);
-        stack->alignment_offset  = alignment_offset;
-    #endif
+//------------------------------------------------------------------------------
+//INITIALIZES STACK WHICH DATA IS ALIGNED, FOR EXAMPLE TO CACHE LINE OR SIMD WIDTH
+//------------------------------------------------------------------------------
+stack_t *stack_init_aligned(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                const char *initialized_file,
+                                                const char *initialized_varname,
+                                                const char *initialized_function,
+                                                size_t      initialized_line,
+                                                int       (*print_func)(FILE *, void *),)
+                            size_t capacity,
+                            size_t element_size,
+                            size_t alignment) {
+    C_ASSERT_ALWAYS(element_size != 0                  , return NULL);
+    C_ASSERT_ALWAYS(alignment    != 0                  , return NULL);
+    C_ASSERT_ALWAYS((alignment & (alignment - 1)) == 0 , return NULL);
+    C_ASSERT_ALWAYS(alignment    <= STACK_MAX_ALIGNMENT, return NULL);
+
+    return stack_create(STACK_WRITE_DUMP_ON(dump_filename,
+                                            initialized_file,
+                                            initialized_varname,
+                                            initialized_function,
+                                            initialized_line,
+                                            print_func,)
+                        capacity,
+                        element_size,
+                        alignment,
+                        false,
+                        NULL,
+                        NULL);
+}
 
-    #ifdef STACK_WRITE_DUMP
-        stack->dump_filename        = dump_filename;
-        stack->initialized_file     = initialized_file;
-        stack->initialized_varname  = initialized_varname;
-        stack->initialized_function = initialized_function;
-        stack->initialized_line     = initialized_line;
-        stack->print_func           = print_func;
-
-        stack->dump_file = fopen(stack->dump_filename, "wb");
-        if(stack->dump_file == NULL) {
-            stack_destroy(&stack);
-            return NULL;
-        }
-    #endif
+//------------------------------------------------------------------------------
+//INITIALIZES STACK WHICH MEMORY (ALSO AGGREGATES AND CHUNK HASHES) COMES FROM
+//allocator, SO IT MAY BE PLACED IN ARENA OR ON NUMA NODE OF ITS USER
+//------------------------------------------------------------------------------
+stack_t *stack_init_allocator(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                  const char *initialized_file,
+                                                  const char *initialized_varname,
+                                                  const char *initialized_function,
+                                                  size_t      initialized_line,
+                                                  int       (*print_func)(FILE *, void *),)
+                              size_t                   capacity,
+                              size_t                   element_size,
+                              const stack_allocator_t *allocator) {
+    C_ASSERT_ALWAYS(element_size != 0, return NULL);
+    if(allocator != NULL) {
+        C_ASSERT_ALWAYS(allocator->allocate != NULL, return NULL);
+        C_ASSERT_ALWAYS(allocator->release  != NULL, return NULL);
+    }
 
-    #ifdef STACK_HASH_PROTECTION
-        if(stack_update_hash(stack) != STACK_SUCCESS) {
-            stack_destroy(&stack);
-            return NULL;
-        }
-    #endif
+    return stack_create(STACK_WRITE_DUMP_ON(dump_filename,
+                                            initialized_file,
+                                            initialized_varname,
+                                            initialized_function,
+                                            initialized_line,
+                                            print_func,)
+                        capacity,
+                        element_size,
+                        STACK_DEFAULT_ALIGNMENT,
+                        false,
+                        NULL,
+                        allocator);
+}
 
-    #ifdef STACK_CANARY_PROTECTION
-        if(stack_update_canary(stack) != STACK_SUCCESS) {
-            stack_destroy(&stack);
-            return NULL;
-        }
-    #endif
+//------------------------------------------------------------------------------
+//INITIALIZES STACK OF ELEMENTS WITH DIFFERENT SIZES
+//ELEMENTS ARE PACKED, EVERY ELEMENT IS FOLLOWED BY ITS LENGTH (size_t)
+//------------------------------------------------------------------------------
+stack_t *stack_init_bytes(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                              const char *initialized_file,
+                                              const char *initialized_varname,
+                                              const char *initialized_function,
+                                              size_t      initialized_line,
+                                              int       (*print_func)(FILE *, void *),)
+                          size_t capacity) {
+    return stack_create(STACK_WRITE_DUMP_ON(dump_filename,
+                                            initialized_file,
+                                            initialized_varname,
+                                            initialized_function,
+                                            initialized_line,
+                                            print_func,)
+                        capacity,
+                        1,
+                        STACK_DEFAULT_ALIGNMENT,
+                        true,
+                        NULL,
+                        NULL);
+}
 
-    if(stack_verify(stack) != STACK_SUCCESS) {
-        stack_destroy(&stack);
-        return NULL;
-    }
-    return stack;
+//------------------------------------------------------------------------------
+//INITIALIZES STACK WHICH KEEPS COMBINE OF ELEMENTS UNDER EVERY LEVEL,
+//SO AGGREGATE OF WHOLE STACK IS READY AFTER EVERY PUSH AND POP
+//------------------------------------------------------------------------------
+stack_t *stack_init_aggregate(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                  const char *initialized_file,
+                                                  const char *initialized_varname,
+                                                  const char *initialized_function,
+                                                  size_t      initialized_line,
+                                                  int       (*print_func)(FILE *, void *),)
+                              size_t          capacity,
+                              size_t          element_size,
+                              stack_combine_t combine) {
+    C_ASSERT_ALWAYS(element_size != 0   , return NULL);
+    C_ASSERT_ALWAYS(combine      != NULL, return NULL);
+
+    return stack_create(STACK_WRITE_DUMP_ON(dump_filename,
+                                            initialized_file,
+                                            initialized_varname,
+                                            initialized_function,
+                                            initialized_line,
+                                            print_func,)
+                        capacity,
+                        element_size,
+                        STACK_DEFAULT_ALIGNMENT,
+                        false,
+                        combine,
+                        NULL);
 }
 
 //------------------------------------------------------------------------------
@@ -277,20 +396,27 @@ stack_error_t stack_push(stack_t **stack, void *element) {
     C_ASSERT(element != NULL, return STACK_INVALID_INPUT);
 
     STACK_VERIFY(*stack);
-    STACK_CHECK_SIZE(stack, STACK_OPERATION_PUSH);
+    if((*stack)->variable_size)
+        return STACK_INVALID_INPUT;
+
+    stack_trace_record(STACK_TRACE_PUSH, (*stack)->id, (*stack)->element_size, 0);
+    STACK_CHECK_SIZE(stack, STACK_OPERATION_PUSH, 1);
 
+    stack_write_begin(*stack);
     char *stack_storage = (*stack)->data +
                           (*stack)->element_size *
                           (*stack)->size;
-    if(memcpy(stack_storage,
-              element,
-              (*stack)->element_size) != stack_storage)
-        STACK_RETURN_ERROR(*stack, STACK_MEMORY_ERROR);
+    (*stack)->kernel->copy_in(stack_storage, element, (*stack)->element_size);
 
+    if((*stack)->combine != NULL)
+        stack_push_aggregate(*stack);
+
+    STACK_MARK_DIRTY(*stack, (*stack)->size, (*stack)->size + 1);
     (*stack)->size++;
 
     STACK_UPDATE_HASH  (*stack);
     STACK_UPDATE_CANARY(*stack);
+    stack_write_end    (*stack);
     STACK_VERIFY       (*stack);
     return STACK_SUCCESS;
 }
@@ -303,54 +429,593 @@ stack_error_t stack_pop(stack_t **stack, void *output) {
     C_ASSERT(output != NULL, return STACK_INVALID_OUTPUT);
 
     STACK_VERIFY(*stack);
-    STACK_CHECK_SIZE(stack, STACK_OPERATION_POP);
+    if((*stack)->variable_size)
+        return STACK_INVALID_INPUT;
+
+    stack_trace_record(STACK_TRACE_POP, (*stack)->id, (*stack)->element_size, 0);
+    STACK_CHECK_SIZE(stack, STACK_OPERATION_POP, 1);
 
     if((*stack)->size == 0)
         return STACK_EMPTY;
 
+    stack_write_begin(*stack);
     (*stack)->size--;
     char *stack_storage = (*stack)->data +
                           (*stack)->size *
                           (*stack)->element_size;
-    if(memcpy(output,
-              stack_storage,
-              (*stack)->element_size) != output)
-        STACK_RETURN_ERROR(*stack, STACK_MEMORY_ERROR);
+    (*stack)->kernel->copy_out(output, stack_storage, (*stack)->element_size);
+    (*stack)->kernel->clear   (stack_storage, (*stack)->element_size);
 
-    if(memset(stack_storage,
-              0,
-              (*stack)->element_size) != stack_storage)
-        STACK_RETURN_ERROR(*stack, STACK_MEMORY_ERROR);
+    STACK_MARK_DIRTY(*stack, (*stack)->size, (*stack)->size + 1);
+    STACK_UPDATE_HASH  (*stack);
+    STACK_UPDATE_CANARY(*stack);
+    stack_write_end    (*stack);
+    STACK_VERIFY       (*stack);
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//PUSHES length BYTES IN STACK OF ELEMENTS WITH DIFFERENT SIZES
+//------------------------------------------------------------------------------
+stack_error_t stack_push_bytes(stack_t **stack, void *element, size_t length) {
+    C_ASSERT(stack   != NULL               , return STACK_NULL         );
+    C_ASSERT(element != NULL || length == 0, return STACK_INVALID_INPUT);
+
+    STACK_VERIFY(*stack);
+    if(!(*stack)->variable_size)
+        return STACK_INVALID_INPUT;
+
+    stack_trace_record(STACK_TRACE_PUSH_BYTES, (*stack)->id, length, 0);
+    size_t record_size = length + sizeof(size_t);
+    STACK_CHECK_SIZE(stack, STACK_OPERATION_PUSH, record_size);
+
+    stack_write_begin(*stack);
+    char *record = (*stack)->data + (*stack)->size;
+    if(length != 0)
+        memcpy(record, element, length);
+    memcpy(record + length, &length, sizeof(size_t));
+
+    STACK_MARK_DIRTY(*stack, (*stack)->size, (*stack)->size + record_size);
+    (*stack)->size += record_size;
 
     STACK_UPDATE_HASH  (*stack);
     STACK_UPDATE_CANARY(*stack);
+    stack_write_end    (*stack);
     STACK_VERIFY       (*stack);
     return STACK_SUCCESS;
 }
 
+//------------------------------------------------------------------------------
+//POPS ELEMENT FROM STACK OF ELEMENTS WITH DIFFERENT SIZES
+//LENGTH FOOTER TELLS WHERE ELEMENT STARTS
+//------------------------------------------------------------------------------
+stack_error_t stack_pop_bytes(stack_t **stack, void *output, size_t *length) {
+    C_ASSERT(stack  != NULL, return STACK_NULL          );
+    C_ASSERT(length != NULL, return STACK_INVALID_OUTPUT);
+
+    STACK_VERIFY(*stack);
+    if(!(*stack)->variable_size)
+        return STACK_INVALID_INPUT;
+
+    size_t element_length = 0;
+    if((*stack)->size != 0) {
+        if((*stack)->size < sizeof(size_t))
+            STACK_RETURN_ERROR(*stack, STACK_INVALID_DATA);
+
+        memcpy(&element_length,
+               (*stack)->data + (*stack)->size - sizeof(size_t),
+               sizeof(size_t));
+        if(element_length > (*stack)->size - sizeof(size_t))
+            STACK_RETURN_ERROR(*stack, STACK_INVALID_DATA);
+    }
+
+    stack_trace_record(STACK_TRACE_POP_BYTES, (*stack)->id, element_length, 0);
+    STACK_CHECK_SIZE(stack, STACK_OPERATION_POP, 1);
+
+    if((*stack)->size == 0)
+        return STACK_EMPTY;
+
+    if(element_length > *length || (output == NULL && element_length != 0)) {
+        *length = element_length;
+        return STACK_INVALID_OUTPUT;
+    }
+
+    stack_write_begin(*stack);
+    size_t record_size = element_length + sizeof(size_t);
+    (*stack)->size -= record_size;
+
+    char *record = (*stack)->data + (*stack)->size;
+    if(element_length != 0)
+        memcpy(output, record, element_length);
+    memset(record, 0, record_size);
+    *length = element_length;
+
+    STACK_MARK_DIRTY(*stack, (*stack)->size, (*stack)->size + record_size);
+    STACK_UPDATE_HASH  (*stack);
+    STACK_UPDATE_CANARY(*stack);
+    stack_write_end    (*stack);
+    STACK_VERIFY       (*stack);
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//WRITES COMBINE OF ALL ELEMENTS, IT IS NOT COUNTED HERE BUT TAKEN FROM TOP LEVEL
+//------------------------------------------------------------------------------
+stack_error_t stack_aggregate(stack_t **stack, void *output) {
+    C_ASSERT(stack  != NULL, return STACK_NULL          );
+    C_ASSERT(output != NULL, return STACK_INVALID_OUTPUT);
+
+    STACK_VERIFY(*stack);
+    if((*stack)->combine == NULL)
+        return STACK_INVALID_INPUT;
+
+    if((*stack)->size == 0)
+        return STACK_EMPTY;
+
+    memcpy(output,
+           (*stack)->aggregates +
+           ((*stack)->size - 1) *
+           (*stack)->element_size,
+           (*stack)->element_size);
+    return STACK_SUCCESS;
+}
+
 //------------------------------------------------------------------------------
 //DESTROYS STACK
 //------------------------------------------------------------------------------
 stack_error_t stack_destroy(stack_t **stack) {
     C_ASSERT(stack != NULL, return STACK_NULL);
+    if(*stack == NULL)
+        return STACK_NULL;
+
+    stack_trace_record(STACK_TRACE_DESTROY, (*stack)->id, (*stack)->element_size, 0);
+
+    //stack leaves registry first, it waits for scrubber or signal dump which
+    //visits it, so they do not see it while its parts are freed
+    size_t stacks_left = stack_registry_remove(*stack);
+
+    #ifdef STACK_WRITE_DUMP
+        if((*stack)->cold != NULL) {
+            if((*stack)->cold->dump_sink != NULL)
+                stack_dump_sink_release((*stack)->cold->dump_sink);
+            _free((*stack)->cold);
+        }
+    #endif
+
+    if((*stack)->aggregates != NULL)
+        stack_memory_release(&(*stack)->allocator, (*stack)->aggregates);
 
-    STACK_WRITE_DUMP_ON(fclose((*stack)->dump_file));
-    _free(*stack);
-    _memory_destroy_log();
+    #ifdef STACK_HASH_PROTECTION
+        if((*stack)->chunk_hashes != NULL)
+            stack_memory_release(&(*stack)->allocator, (*stack)->chunk_hashes);
+    #endif
+
+    if((*stack)->storage == STACK_STORAGE_MAPPED)
+        stack_mapped_release(*stack);
+    else
+        stack_memory_release(&(*stack)->allocator, *stack);
+
+    if(stacks_left == 0)
+        _memory_destroy_log();
 
     *stack = NULL;
     return STACK_SUCCESS;
 }
 
+//------------------------------------------------------------------------------
+//REMEMBERS CURRENT DEPTH OF STACK
+//------------------------------------------------------------------------------
+stack_error_t stack_mark(stack_t **stack, stack_mark_t *mark) {
+    C_ASSERT(stack != NULL, return STACK_NULL          );
+    C_ASSERT(mark  != NULL, return STACK_INVALID_OUTPUT);
+
+    STACK_VERIFY(*stack);
+
+    *mark = (*stack)->size;
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//DISCARDS ELEMENTS PUSHED AFTER MARK AT ONCE
+//STACK DOES NOT SHRINK HERE, NEXT POP SHRINKS IT IF GROWTH POLICY SAYS SO
+//------------------------------------------------------------------------------
+stack_error_t stack_rollback(stack_t **stack, stack_mark_t mark) {
+    C_ASSERT(stack != NULL, return STACK_NULL);
+
+    STACK_VERIFY(*stack);
+    if(mark > (*stack)->size)
+        return STACK_INVALID_INPUT;
+
+    //mark in stack of elements with different sizes must be end of record,
+    //records above it are walked by length footers from top
+    if((*stack)->variable_size) {
+        size_t record_end = (*stack)->size;
+        while(record_end > mark) {
+            if(record_end < sizeof(size_t))
+                STACK_RETURN_ERROR(*stack, STACK_INVALID_DATA);
+
+            size_t element_length = 0;
+            memcpy(&element_length,
+                   (*stack)->data + record_end - sizeof(size_t),
+                   sizeof(size_t));
+            if(element_length > record_end - sizeof(size_t))
+                STACK_RETURN_ERROR(*stack, STACK_INVALID_DATA);
+
+            record_end -= element_length + sizeof(size_t);
+        }
+        if(record_end != mark)
+            return STACK_INVALID_INPUT;
+    }
+
+    stack_trace_record(STACK_TRACE_ROLLBACK, (*stack)->id, mark, 0);
+    if(mark == (*stack)->size)
+        return STACK_SUCCESS;
+
+    stack_write_begin(*stack);
+    size_t first = mark           * (*stack)->element_size,
+           last  = (*stack)->size * (*stack)->element_size;
+    memset((*stack)->data + first, 0, last - first);
+
+    STACK_MARK_DIRTY(*stack, mark, (*stack)->size);
+    (*stack)->size = mark;
+
+    STACK_UPDATE_HASH  (*stack);
+    STACK_UPDATE_CANARY(*stack);
+    stack_write_end    (*stack);
+    STACK_VERIFY       (*stack);
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//APPLIES PUSHES AND POPS IN ORDER WITH ONE VERIFY, ONE GROW AND ONE REHASH
+//STACK GROWS FOR ALL PUSHES AT ONCE, POPS OF EMPTY STACK GET STACK_EMPTY
+//------------------------------------------------------------------------------
+stack_error_t stack_apply_batch(stack_t **               stack,
+                                stack_batch_operation_t *operations,
+                                size_t                   count) {
+    C_ASSERT(stack      != NULL             , return STACK_NULL         );
+    C_ASSERT(operations != NULL || count == 0, return STACK_INVALID_INPUT);
+
+    STACK_VERIFY(*stack);
+    if((*stack)->variable_size)
+        return STACK_INVALID_INPUT;
+
+    size_t pushes = 0;
+    for(size_t i = 0; i < count; i++)
+        if(operations[i].is_push)
+            pushes++;
+
+    //like stack_pop, batch of pops checks if stack shrinks before popping
+    if(pushes != 0) {
+        STACK_CHECK_SIZE(stack, STACK_OPERATION_PUSH, pushes);
+    }
+    else {
+        STACK_CHECK_SIZE(stack, STACK_OPERATION_POP, 1);
+    }
+
+    stack_write_begin(*stack);
+    size_t element_size = (*stack)->element_size,
+           lowest       = (*stack)->size,
+           highest      = (*stack)->size;
+    for(size_t i = 0; i < count; i++) {
+        stack_batch_operation_t *operation = operations + i;
+        stack_trace_record(operation->is_push ? STACK_TRACE_PUSH : STACK_TRACE_POP,
+                           (*stack)->id,
+                           element_size,
+                           0);
+
+        char *top = (*stack)->data + (*stack)->size * element_size;
+        if(operation->is_push) {
+            (*stack)->kernel->copy_in(top, operation->element, element_size);
+            if((*stack)->combine != NULL)
+                stack_push_aggregate(*stack);
+            (*stack)->size++;
+            if((*stack)->size > highest)
+                highest = (*stack)->size;
+        }
+        else {
+            if((*stack)->size == 0) {
+                operation->result = STACK_EMPTY;
+                continue;
+            }
+            top -= element_size;
+            (*stack)->kernel->copy_out(operation->element, top, element_size);
+            (*stack)->kernel->clear   (top, element_size);
+            (*stack)->size--;
+            if((*stack)->size < lowest)
+                lowest = (*stack)->size;
+        }
+        operation->result = STACK_SUCCESS;
+    }
+
+    if(lowest != highest) {
+        STACK_MARK_DIRTY(*stack, lowest, highest);
+    }
+    STACK_UPDATE_HASH  (*stack);
+    STACK_UPDATE_CANARY(*stack);
+    stack_write_end    (*stack);
+    STACK_VERIFY       (*stack);
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//SETS LIMIT OF BYTES WHICH STACK CAN OCCUPY, 0 MEANS NO LIMIT
+//PUSH RETURNS STACK_FULL INSTEAD OF GROWING OVER THE LIMIT
+//------------------------------------------------------------------------------
+stack_error_t stack_set_max_bytes(stack_t **stack, size_t max_bytes) {
+    C_ASSERT(stack != NULL, return STACK_NULL);
+
+    STACK_VERIFY(*stack);
+
+    stack_write_begin(*stack);
+    (*stack)->max_bytes = max_bytes;
+
+    STACK_UPDATE_HASH(*stack);
+    stack_write_end  (*stack);
+    STACK_VERIFY     (*stack);
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//SHRINKS STACK WHICH HAS GROWN ONCE TO ITS SIZE OR INITIAL CAPACITY,
+//WITHOUT WAITING FOR POPS, STACK MAY BE MOVED
+//------------------------------------------------------------------------------
+stack_error_t stack_trim(stack_t **stack) {
+    C_ASSERT(stack != NULL, return STACK_NULL);
+
+    STACK_VERIFY(*stack);
+    STACK_CHECK_SIZE(stack, STACK_OPERATION_TRIM, 0);
+    STACK_VERIFY(*stack);
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//SETS HOW STACK CHANGES CAPACITY
+//FULL STACK GROWS grow_factor TIMES, STACK WHICH IS FILLED LESS THAN
+//1/shrink_threshold SHRINKS shrink_factor TIMES, shrink_threshold = 0 MEANS
+//THAT STACK NEVER SHRINKS
+//------------------------------------------------------------------------------
+stack_error_t stack_set_growth_policy(stack_t **stack,
+                                      size_t    grow_factor,
+                                      size_t    shrink_threshold,
+                                      size_t    shrink_factor) {
+    C_ASSERT(stack != NULL, return STACK_NULL);
+    //factors below 2 divide by zero or never grow, so they are checked in
+    //release build too
+    C_ASSERT_ALWAYS(grow_factor   >= 2, return STACK_INVALID_INPUT);
+    C_ASSERT_ALWAYS(shrink_factor >= 2, return STACK_INVALID_INPUT);
+
+    STACK_VERIFY(*stack);
+
+    stack_write_begin(*stack);
+    (*stack)->grow_factor      = grow_factor;
+    (*stack)->shrink_threshold = shrink_threshold;
+    (*stack)->shrink_factor    = shrink_factor;
+
+    STACK_UPDATE_HASH(*stack);
+    stack_write_end  (*stack);
+    STACK_VERIFY     (*stack);
+    return STACK_SUCCESS;
+}
+
+//==============================================================================
+//FUNCTIONS SHARED BETWEEN STACK MODULES
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//FILLS HEADER OF ZEROED STACK MEMORY AND PROTECTS IT
+//------------------------------------------------------------------------------
+stack_error_t stack_init_header(stack_t *stack,
+                                STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                    const char *initialized_file,
+                                                    const char *initialized_varname,
+                                                    const char *initialized_function,
+                                                    size_t      initialized_line,
+                                                    int       (*print_func)(FILE *, void *),)
+                                size_t   capacity,
+                                size_t   element_size,
+                                size_t   alignment,
+                                bool     variable_size) {
+    if(stack == NULL)
+        return STACK_NULL;
+
+    stack->capacity = capacity;
+    stack->element_size = element_size;
+    stack->alignment = alignment;
+    stack->variable_size = variable_size;
+    stack->init_capacity = capacity;
+    stack->grow_factor = 2;
+    stack->shrink_threshold = 4;
+    stack->shrink_factor = 4;
+    stack->id = stack_new_id();
+    stack->data = (char *)stack + stack_data_offset(alignment);
+    stack->kernel = stack_select_kernel(element_size, alignment);
+
+    #ifdef STACK_CANARY_PROTECTION
+        stack->alignment_offset  = calculate_alignment_offset(capacity,
+                                                              element_size);
+    #endif
+
+    #ifdef STACK_WRITE_DUMP
+        stack_error_t dump_state = stack_attach_dump(stack,
+                                                     dump_filename,
+                                                     initialized_file,
+                                                     initialized_varname,
+                                                     initialized_function,
+                                                     initialized_line,
+                                                     print_func);
+        if(dump_state != STACK_SUCCESS)
+            return dump_state;
+    #endif
+
+    #ifdef STACK_HASH_PROTECTION
+        stack_error_t chunks_state = stack_hash_resize(stack, capacity);
+        if(chunks_state != STACK_SUCCESS)
+            return chunks_state;
+
+        stack_hash_invalidate(stack);
+        stack_error_t hash_state = stack_update_hash(stack);
+        if(hash_state != STACK_SUCCESS)
+            return hash_state;
+    #endif
+
+    #ifdef STACK_CANARY_PROTECTION
+        stack_error_t canary_state = stack_update_canary(stack);
+        if(canary_state != STACK_SUCCESS)
+            return canary_state;
+    #endif
+
+    stack_error_t verify_state = stack_verify(stack);
+    if(verify_state != STACK_SUCCESS)
+        return verify_state;
+
+    stack_error_t registry_state = stack_registry_add(stack);
+    if(registry_state != STACK_SUCCESS)
+        return registry_state;
+
+    stack_trace_record(STACK_TRACE_INIT,
+                       stack->id,
+                       variable_size ? 0 : element_size,
+                       capacity);
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//ALLOCATES ZEROED MEMORY WITH ALLOCATOR OF STACK OR IN memory.cpp
+//------------------------------------------------------------------------------
+void *stack_memory_allocate(const stack_allocator_t *allocator,
+                            size_t                   size,
+                            size_t                   alignment) {
+    if(allocator == NULL || allocator->allocate == NULL)
+        return _aligned_calloc(size, 1, alignment);
+
+    void *memory = allocator->allocate(allocator->context, size, alignment);
+    if(memory != NULL)
+        memset(memory, 0, size);
+    return memory;
+}
+
+//------------------------------------------------------------------------------
+//REALLOCATES MEMORY, NEW BYTES ARE ZEROED, RETURNS NULL AND KEEPS OLD ON ERROR
+//------------------------------------------------------------------------------
+void *stack_memory_reallocate(const stack_allocator_t *allocator,
+                              void *                   memory,
+                              size_t                   old_size,
+                              size_t                   new_size,
+                              size_t                   alignment) {
+    if(allocator == NULL || allocator->allocate == NULL)
+        return _aligned_recalloc(memory, old_size, new_size, 1, alignment);
+
+    void *new_memory = NULL;
+    if(allocator->reallocate != NULL) {
+        new_memory = allocator->reallocate(allocator->context,
+                                           memory,
+                                           old_size,
+                                           new_size,
+                                           alignment);
+        if(new_memory == NULL)
+            return NULL;
+    }
+    else {
+        new_memory = allocator->allocate(allocator->context, new_size, alignment);
+        if(new_memory == NULL)
+            return NULL;
+        memcpy(new_memory, memory, old_size < new_size ? old_size : new_size);
+        allocator->release(allocator->context, memory);
+    }
+
+    if(new_size > old_size)
+        memset((char *)new_memory + old_size, 0, new_size - old_size);
+    return new_memory;
+}
+
+//------------------------------------------------------------------------------
+//GIVES MEMORY BACK TO ALLOCATOR IT CAME FROM
+//------------------------------------------------------------------------------
+void stack_memory_release(const stack_allocator_t *allocator,
+                          void *                   memory) {
+    if(allocator == NULL || allocator->allocate == NULL) {
+        _free(memory);
+        return ;
+    }
+    allocator->release(allocator->context, memory);
+}
+
+//------------------------------------------------------------------------------
+//RETURNS UNIQUE IDENTIFIER FOR STACK IN THIS PROCESS
+//------------------------------------------------------------------------------
+size_t stack_new_id(void) {
+    return __atomic_fetch_add(&next_stack_id, 1, __ATOMIC_RELAXED);
+}
+
 //==============================================================================
 //STATIC FUNCTIONS
 //==============================================================================
 
 //------------------------------------------------------------------------------
-//CHECKS IF SIZE OF STACK IS SUFFICIENT
+//ALLOCATES STACK ON HEAP AND INITIALIZES IT
+//------------------------------------------------------------------------------
+stack_t *stack_create(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                          const char *initialized_file,
+                                          const char *initialized_varname,
+                                          const char *initialized_function,
+                                          size_t      initialized_line,
+                                          int       (*print_func)(FILE *, void *),)
+                      size_t                   capacity,
+                      size_t                   element_size,
+                      size_t                   alignment,
+                      bool                     variable_size,
+                      stack_combine_t          combine,
+                      const stack_allocator_t *allocator) {
+    stack_t *stack = (stack_t *)stack_memory_allocate(allocator,
+                                                      calculate_allocation_size(capacity,
+                                                                                element_size,
+                                                                                alignment),
+                                                      stack_memory_alignment(alignment));
+    if(stack == NULL)
+        return NULL;
+
+    stack->storage    = STACK_STORAGE_HEAP;
+    stack->storage_fd = -1;
+    if(allocator != NULL)
+        stack->allocator = *allocator;
+
+    if(combine != NULL) {
+        //one slot is allocated even for zero capacity, so NULL means no combine
+        stack->combine    = combine;
+        stack->aggregates = (char *)stack_memory_allocate(allocator,
+                                                          (capacity != 0 ? capacity : 1) *
+                                                          element_size,
+                                                          alignment);
+        if(stack->aggregates == NULL) {
+            stack_memory_release(allocator, stack);
+            return NULL;
+        }
+    }
+
+    if(stack_init_header(stack,
+                         STACK_WRITE_DUMP_ON(dump_filename,
+                                             initialized_file,
+                                             initialized_varname,
+                                             initialized_function,
+                                             initialized_line,
+                                             print_func,)
+                         capacity,
+                         element_size,
+                         alignment,
+                         variable_size) != STACK_SUCCESS) {
+        stack_destroy(&stack);
+        return NULL;
+    }
+    return stack;
+}
+
+//------------------------------------------------------------------------------
+//CHECKS IF SIZE OF STACK IS SUFFICIENT, PUSH NEEDS PLACE FOR count ELEMENTS
 //------------------------------------------------------------------------------
 stack_error_t stack_check_size(stack_t **        stack,
-                               stack_operation_t operation) {
+                               stack_operation_t operation,
+                               size_t            count) {
     if(stack == NULL)
         return STACK_NULL;
 
@@ -360,16 +1025,40 @@ stack_error_t stack_check_size(stack_t **        stack,
 
     switch(operation) {
         case STACK_OPERATION_PUSH: {
-            if((*stack)->size < (*stack)->capacity)
+            size_t needed_capacity = (*stack)->size + count;
+            if(needed_capacity <= (*stack)->capacity)
                 return STACK_SUCCESS;
-            new_capacity = (*stack)->capacity * 2;
+            new_capacity = (*stack)->capacity * (*stack)->grow_factor;
+            if(new_capacity == 0)
+                new_capacity = 1;
+            while(new_capacity < needed_capacity)
+                new_capacity *= (*stack)->grow_factor;
+
+            stack_error_t limit_state = stack_limit_capacity(*stack,
+                                                             needed_capacity,
+                                                             &new_capacity);
+            if(limit_state != STACK_SUCCESS)
+                return limit_state;
             break;
         }
         case STACK_OPERATION_POP:  {
-            if((*stack)->size * 4 > (*stack)->capacity ||
+            if((*stack)->shrink_threshold == 0                                   ||
+               (*stack)->size * (*stack)->shrink_threshold > (*stack)->capacity ||
                (*stack)->init_capacity == (*stack)->capacity)
                 return STACK_SUCCESS;
-            new_capacity = (*stack)->capacity / 4 + (*stack)->capacity % 4;
+            new_capacity = (*stack)->capacity / (*stack)->shrink_factor +
+                           (*stack)->capacity % (*stack)->shrink_factor;
+            if(new_capacity < (*stack)->init_capacity)
+                new_capacity = (*stack)->init_capacity;
+            if(new_capacity < (*stack)->size)
+                new_capacity = (*stack)->size;
+            break;
+        }
+        case STACK_OPERATION_TRIM: {
+            new_capacity = (*stack)->size > (*stack)->init_capacity ?
+                           (*stack)->size : (*stack)->init_capacity;
+            if(new_capacity >= (*stack)->capacity)
+                return STACK_SUCCESS;
             break;
         }
         default:                   {
@@ -382,52 +1071,291 @@ stack_error_t stack_check_size(stack_t **        stack,
                                                    (*stack)->element_size);
     #endif
 
-    size_t old_size = sizeof(stack_t) +
-                      (*stack)->capacity *
-                      (*stack)->element_size;
-    size_t new_size = sizeof(stack_t) +
-                      new_capacity *
-                      (*stack)->element_size;
-
+    size_t old_size = calculate_allocation_size((*stack)->capacity,
+                                                (*stack)->element_size,
+                                                (*stack)->alignment);
+    size_t new_size = calculate_allocation_size(new_capacity,
+                                                (*stack)->element_size,
+                                                (*stack)->alignment);
+
+    //scrubber and other visitors read stack under lock of its registry slot,
+    //so stack is not moved under them, other stacks are moved at the same time
+    //realloc leaves old block untouched on failure, so stack is still valid
+    stack_registry_lock_stack(*stack);
+
+    //aggregates grow before stack and shrink after it, so they always have
+    //place for all elements, even if stack reallocation fails
+    size_t old_capacity = (*stack)->capacity;
+    if((*stack)->aggregates != NULL && operation == STACK_OPERATION_PUSH) {
+        char *aggregates = (char *)stack_memory_reallocate(&(*stack)->allocator,
+                                                           (*stack)->aggregates,
+                                                           old_capacity *
+                                                           (*stack)->element_size,
+                                                           new_capacity *
+                                                           (*stack)->element_size,
+                                                           (*stack)->alignment);
+        if(aggregates == NULL) {
+            stack_registry_unlock_stack(*stack);
+            return STACK_MEMORY_ERROR;
+        }
+        (*stack)->aggregates = aggregates;
+        #ifdef STACK_HASH_PROTECTION
+            stack_update_hash(*stack);
+        #endif
+    }
 
-    #ifdef STACK_CANARY_PROTECTION
-        old_size += 2 * sizeof(canary_t) + (*stack)->alignment_offset;
-        new_size += 2 * sizeof(canary_t) + offset;
+    //chunk hashes are separate array too, it also grows before stack
+    #ifdef STACK_HASH_PROTECTION
+        if(new_capacity > old_capacity &&
+           stack_hash_resize(*stack, new_capacity) != STACK_SUCCESS) {
+            stack_registry_unlock_stack(*stack);
+            return STACK_MEMORY_ERROR;
+        }
     #endif
 
-    stack_t *new_stack = (stack_t *)_recalloc(*stack, old_size, new_size, 1);
-    if(new_stack == NULL)
+    stack_t *new_stack = (stack_t *)stack_reallocate(*stack, old_size, new_size);
+    if(new_stack == NULL) {
+        stack_registry_unlock_stack(*stack);
+        #ifdef STACK_STRONG_GUARANTEE
+            if(operation != STACK_OPERATION_PUSH)
+                return STACK_SUCCESS;
+        #endif
         return STACK_MEMORY_ERROR;
+    }
 
     #ifdef STACK_CANARY_PROTECTION
         if(operation == STACK_OPERATION_PUSH) {
-            canary_t *old = (canary_t *)((char *)(new_stack + 1) +
-                                         sizeof(canary_t) +
+            canary_t *old = (canary_t *)((char *)new_stack +
+                                         stack_data_offset(new_stack->alignment) +
                                          new_stack->capacity *
-                                         new_stack->element_size);
+                                         new_stack->element_size +
+                                         new_stack->alignment_offset);
             *old = 0;
         }
     #endif
 
     *stack = new_stack;
+    stack_registry_update(new_stack);
     new_stack->capacity = new_capacity;
-    new_stack->data = (char *)(new_stack + 1);
+    if(new_stack->aggregates != NULL && operation != STACK_OPERATION_PUSH) {
+        char *aggregates = (char *)stack_memory_reallocate(&new_stack->allocator,
+                                                           new_stack->aggregates,
+                                                           old_capacity *
+                                                           new_stack->element_size,
+                                                           (new_capacity != 0 ? new_capacity : 1) *
+                                                           new_stack->element_size,
+                                                           new_stack->alignment);
+        if(aggregates != NULL)
+            new_stack->aggregates = aggregates;
+    }
+    #ifdef STACK_HASH_PROTECTION
+        //only chunks from last common slot to new end of data are changed
+        size_t common = new_capacity < old_capacity ? new_capacity : old_capacity;
+        if(new_capacity < old_capacity)
+            stack_hash_resize(new_stack, new_capacity);
+        stack_hash_touch(new_stack,
+                         common != 0 ? common - 1 : 0,
+                         new_capacity);
+    #endif
+    #ifdef STACK_WRITE_DUMP
+        new_stack->cold->dumps_to_keyframe = 0;
+    #endif
+    new_stack->data = (char *)new_stack + stack_data_offset(new_stack->alignment);
 
     #ifdef STACK_CANARY_PROTECTION
-        new_stack->data += sizeof(canary_t);
         new_stack->alignment_offset = offset;
     #endif
 
-    STACK_UPDATE_HASH  (*stack);
-    STACK_UPDATE_CANARY(*stack);
-    STACK_VERIFY       (*stack);
+    #ifdef STACK_HASH_PROTECTION
+        stack_update_hash(new_stack);
+    #endif
+    #ifdef STACK_CANARY_PROTECTION
+        stack_update_canary(new_stack);
+    #endif
+    stack_registry_unlock_stack(new_stack);
+
+    STACK_VERIFY(*stack);
     return STACK_SUCCESS;
 }
 
 //------------------------------------------------------------------------------
-//CHECKS IF STACK IS VALID
+//REALLOCATES STACK MEMORY IN ITS STORAGE, RETURNS NULL AND KEEPS OLD ON ERROR
+//------------------------------------------------------------------------------
+void *stack_reallocate(stack_t *stack,
+                       size_t   old_size,
+                       size_t   new_size) {
+    if(stack->storage == STACK_STORAGE_MAPPED)
+        return stack_mapped_reallocate(stack, old_size, new_size);
+
+    return stack_memory_reallocate(&stack->allocator,
+                                   stack,
+                                   old_size,
+                                   new_size,
+                                   stack_memory_alignment(stack->alignment));
+}
+
+//------------------------------------------------------------------------------
+//RETURNS NUMBER OF BYTES WHICH STACK WITH THIS CAPACITY OCCUPIES
+//IT IS MULTIPLE OF ALIGNMENT, SO NEXT ALIGNED BLOCK DOES NOT SHARE LAST LINE
+//------------------------------------------------------------------------------
+size_t calculate_allocation_size(size_t capacity,
+                                 size_t element_size,
+                                 size_t alignment) {
+    size_t allocation_size = stack_data_offset(alignment) + capacity * element_size;
+
+    #ifdef STACK_CANARY_PROTECTION
+        allocation_size += sizeof(canary_t) +
+                           calculate_alignment_offset(capacity, element_size);
+    #endif
+
+    return (allocation_size + alignment - 1) / alignment * alignment;
+}
+
+//------------------------------------------------------------------------------
+//RETURNS OFFSET OF DATA FROM STACK START, LEFT DATA CANARY IS RIGHT BEFORE DATA
+//------------------------------------------------------------------------------
+size_t stack_data_offset(size_t alignment) {
+    size_t offset = sizeof(stack_t);
+
+    #ifdef STACK_CANARY_PROTECTION
+        offset += sizeof(canary_t);
+    #endif
+
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+//------------------------------------------------------------------------------
+//STACK MEMORY IS ALIGNED BOTH FOR stack_t AND FOR DATA
+//------------------------------------------------------------------------------
+size_t stack_memory_alignment(size_t alignment) {
+    return alignment > alignof(stack_t) ? alignment : alignof(stack_t);
+}
+
+//------------------------------------------------------------------------------
+//DECREASES NEW CAPACITY TO FIT IN STACK BYTES LIMIT
+//RETURNS STACK_FULL IF STACK CAN NOT GROW TO NEEDED CAPACITY
+//------------------------------------------------------------------------------
+stack_error_t stack_limit_capacity(stack_t *stack,
+                                   size_t   needed_capacity,
+                                   size_t * new_capacity) {
+    if(stack->max_bytes == 0 ||
+       calculate_allocation_size(*new_capacity,
+                                 stack->element_size,
+                                 stack->alignment) <= stack->max_bytes)
+        return STACK_SUCCESS;
+
+    size_t overhead = calculate_allocation_size(0,
+                                                stack->element_size,
+                                                stack->alignment);
+    if(stack->max_bytes <= overhead)
+        return STACK_FULL;
+
+    size_t capacity = (stack->max_bytes - overhead) / stack->element_size;
+    while(capacity > 0 &&
+          calculate_allocation_size(capacity,
+                                    stack->element_size,
+                                    stack->alignment) > stack->max_bytes)
+        capacity--;
+
+    if(capacity < needed_capacity)
+        return STACK_FULL;
+
+    *new_capacity = capacity;
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//RETURNS TRUE IF ERROR LEAVES STACK VALID AND IT SHOULD NOT BE DESTROYED
+//------------------------------------------------------------------------------
+bool stack_error_is_recoverable(stack_error_t error) {
+    if(error == STACK_FULL)
+        return true;
+
+    #ifdef STACK_STRONG_GUARANTEE
+        if(error == STACK_MEMORY_ERROR)
+            return true;
+    #endif
+
+    return false;
+}
+
+//------------------------------------------------------------------------------
+//WRITES AGGREGATE OF LEVEL stack->size, ELEMENT IS ALREADY IN DATA
+//------------------------------------------------------------------------------
+void stack_push_aggregate(stack_t *stack) {
+    size_t level = stack->size * stack->element_size;
+    if(stack->size == 0)
+        memcpy(stack->aggregates, stack->data, stack->element_size);
+    else
+        stack->combine(stack->aggregates + level,
+                       stack->aggregates + level - stack->element_size,
+                       stack->data       + level);
+}
+
+//------------------------------------------------------------------------------
+//CHECKS IF STACK IS VALID, DATA HASH IS LEFT TO SCRUBBER WHEN IT IS RUNNING
 //------------------------------------------------------------------------------
 stack_error_t stack_verify(stack_t *stack) {
+    //chunk hashes of mapped stack are counted from data by first operation,
+    //they match data by construction, so only data hash is checked
+    #ifdef STACK_HASH_PROTECTION
+        if(stack != NULL && stack_hash_pending(stack)) {
+            stack_error_t structure_state = stack_verify_structure(stack);
+            if(structure_state != STACK_SUCCESS)
+                return structure_state;
+
+            return stack_verify_pending_hash(stack);
+        }
+    #endif
+
+    if(stack_scrubber_active())
+        return stack_verify_structure(stack);
+
+    size_t corrupted_low  = 0,
+           corrupted_high = 0;
+    stack_error_t verify_state = stack_verify_full(stack,
+                                                   &corrupted_low,
+                                                   &corrupted_high);
+
+    //only owner of stack keeps range for its dumps
+    #if defined(STACK_WRITE_DUMP) && defined(STACK_HASH_PROTECTION)
+        if(verify_state != STACK_NULL && stack->cold != NULL) {
+            stack->cold->corrupted_low  = corrupted_low;
+            stack->cold->corrupted_high = corrupted_high;
+        }
+    #endif
+    return verify_state;
+}
+
+//------------------------------------------------------------------------------
+//CHECKS STRUCTURE AND HASH OF ALL DATA, ELEMENTS OF CHUNKS WHICH FAILED DATA
+//HASH CHECK ARE [*corrupted_low, *corrupted_high), STACK IS NOT CHANGED
+//------------------------------------------------------------------------------
+stack_error_t stack_verify_full(stack_t *stack,
+                                size_t * corrupted_low,
+                                size_t * corrupted_high) {
+    *corrupted_low  = 0;
+    *corrupted_high = 0;
+
+    stack_error_t structure_state = stack_verify_structure(stack);
+    if(structure_state != STACK_SUCCESS)
+        return structure_state;
+
+    #ifdef STACK_HASH_PROTECTION
+        stack_error_t hash_state = stack_verify_data_hash(stack,
+                                                          corrupted_low,
+                                                          corrupted_high);
+        if(hash_state != STACK_SUCCESS)
+            return hash_state;
+    #endif
+
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//CHECKS EVERYTHING EXCEPT DATA HASH, DOES NOT READ STACK ELEMENTS
+//------------------------------------------------------------------------------
+stack_error_t stack_verify_structure(stack_t *stack) {
     if(stack == NULL)
         return STACK_NULL;
 
@@ -440,63 +1368,275 @@ stack_error_t stack_verify(stack_t *stack) {
     if(stack->capacity < stack->init_capacity)
         return STACK_INVALID_CAPACITY;
 
-    #ifdef STACK_CANARY_PROTECTION
-        if(stack->data != (char *)(stack + 1) + sizeof(canary_t))
+    //mapped file may bring any growth policy
+    if(stack->grow_factor < 2 || stack->shrink_factor < 2)
+        return STACK_INVALID_CAPACITY;
+
+    if((stack->combine == NULL) != (stack->aggregates == NULL))
+        return STACK_INVALID_DATA;
+
+    #ifdef STACK_HASH_PROTECTION
+        if(stack->chunk_hashes == NULL ||
+           stack->chunk_count < stack_hash_chunk_count(stack, stack->capacity))
             return STACK_INVALID_DATA;
+    #endif
+
+    if(stack->alignment == 0                               ||
+       (stack->alignment & (stack->alignment - 1)) != 0   ||
+       stack->alignment > STACK_MAX_ALIGNMENT)
+        return STACK_INVALID_DATA;
+
+    if(stack->data != (char *)stack + stack_data_offset(stack->alignment))
+        return STACK_INVALID_DATA;
+
+    //kernel pointer is not hashed, it is different in every process
+    if(stack->kernel != stack_select_kernel(stack->element_size, stack->alignment))
+        return STACK_INVALID_DATA;
 
+    #ifdef STACK_CANARY_PROTECTION
         stack_error_t canary_state = stack_verify_canaries(stack);
         if(canary_state != STACK_SUCCESS)
             return canary_state;
-    #else
-        if(stack->data != stack + 1)
-            return STACK_INVALID_DATA;
     #endif
 
     #ifdef STACK_HASH_PROTECTION
-        stack_error_t hash_state = stack_verify_hashes(stack);
+        stack_error_t hash_state = stack_verify_structure_hash(stack);
         if(hash_state != STACK_SUCCESS)
             return hash_state;
     #endif
 
     #ifdef STACK_WRITE_DUMP
-        if(stack->dump_file == NULL)
+        if(stack->cold == NULL || stack->cold->dump_sink == NULL)
             return STACK_DUMP_ERROR;
     #endif
 
     return STACK_SUCCESS;
 }
 
+//------------------------------------------------------------------------------
+//MARKS STACK AS BEING CHANGED, READERS WITHOUT LOCK IGNORE WHAT THEY SEE
+//UNTIL stack_write_end (SEQLOCK)
+//------------------------------------------------------------------------------
+void stack_write_begin(stack_t *stack) {
+    C_ASSERT_PARANOID(stack->version % 2 == 0, );
+    __atomic_store_n(&stack->version, stack->version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    //trimmer issues membarrier between setting trimming and reading version,
+    //so only compiler barrier is needed here (stack_trim.cpp)
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&stack->trimming, __ATOMIC_ACQUIRE))
+        stack_wait_trim(stack);
+}
+
+//------------------------------------------------------------------------------
+//MARKS STACK AS CONSISTENT AGAIN
+//------------------------------------------------------------------------------
+void stack_write_end(stack_t *stack) {
+    C_ASSERT_PARANOID(stack->version % 2 != 0, );
+    __atomic_store_n(&stack->version, stack->version + 1, __ATOMIC_RELEASE);
+}
+
 //==============================================================================
 //STACK WRITE DUMP MODE FUNCTIONS DEFINITION
 //==============================================================================
 #ifdef STACK_WRITE_DUMP
     //------------------------------------------------------------------------------
-    //WRITES STACK INFORMATION IN DUMP FILE
+    //REMEMBERS WHERE STACK WAS INITIALIZED AND CONNECTS IT TO SHARED DUMP FILE,
+    //FILE ITSELF IS OPENED WHEN FIRST DUMP IS WRITTEN
+    //------------------------------------------------------------------------------
+    stack_error_t stack_attach_dump(stack_t *   stack,
+                                    const char *dump_filename,
+                                    const char *initialized_file,
+                                    const char *initialized_varname,
+                                    const char *initialized_function,
+                                    size_t      initialized_line,
+                                    int       (*print_func)(FILE *, void *)) {
+        C_ASSERT(dump_filename        != NULL, return STACK_DUMP_ERROR);
+        C_ASSERT(initialized_file     != NULL, return STACK_DUMP_ERROR);
+        C_ASSERT(initialized_varname  != NULL, return STACK_DUMP_ERROR);
+        C_ASSERT(initialized_function != NULL, return STACK_DUMP_ERROR);
+        C_ASSERT(print_func           != NULL, return STACK_DUMP_ERROR);
+
+        if(stack->cold == NULL) {
+            stack->cold = (stack_cold_t *)_calloc(1, sizeof(stack_cold_t));
+            if(stack->cold == NULL)
+                return STACK_MEMORY_ERROR;
+        }
+
+        stack->cold->dump_filename        = dump_filename;
+        stack->cold->initialized_file     = initialized_file;
+        stack->cold->initialized_varname  = initialized_varname;
+        stack->cold->initialized_function = initialized_function;
+        stack->cold->initialized_line     = initialized_line;
+        stack->cold->print_func           = print_func;
+        stack->cold->dirty_low            = 0;
+        stack->cold->dirty_high           = 0;
+        stack->cold->dumps_to_keyframe    = 0;
+
+        stack->cold->dump_sink = stack_dump_sink_acquire(dump_filename);
+        if(stack->cold->dump_sink == NULL)
+            return STACK_DUMP_ERROR;
+
+        return STACK_SUCCESS;
+    }
+
+    //------------------------------------------------------------------------------
+    //WRITES STACK INFORMATION IN SHARED DUMP FILE
     //------------------------------------------------------------------------------
     stack_error_t stack_dump(stack_t *stack,
                              const char *file_name,
                              const char *function_name,
                              size_t line,
                              stack_error_t call_reason) {
-        if(stack->dump_file == NULL) {
-            color_printf(RED_TEXT, BOLD_TEXT, DEFAULT_BACKGROUND,
-                         "MEMORY DUMP FILE ERROR\r\n"
-                         "called from: %s:%llu\r\n",
-                         file_name,
-                         line);
+        if(stack == NULL || stack->cold == NULL)
+            return stack_dump_corrupted(stack, file_name, function_name, line,
+                                        call_reason, 0, 0, false);
+
+        return stack_dump_corrupted(stack,
+                                    file_name,
+                                    function_name,
+                                    line,
+                                    call_reason,
+                                    stack->cold->corrupted_low,
+                                    stack->cold->corrupted_high,
+                                    false);
+    }
+
+    //------------------------------------------------------------------------------
+    //WRITES DUMP WITH CORRUPTED RANGE OF CALLER, keyframe DUMP IS FULL AND DOES
+    //NOT CHANGE WHAT NEXT DUMP OF OWNER WRITES, FOR THREADS WHICH DO NOT OWN STACK
+    //------------------------------------------------------------------------------
+    stack_error_t stack_dump_corrupted(stack_t *     stack,
+                                       const char *  file_name,
+                                       const char *  function_name,
+                                       size_t        line,
+                                       stack_error_t call_reason,
+                                       size_t        corrupted_low,
+                                       size_t        corrupted_high,
+                                       bool          keyframe) {
+        FILE *dump_file = NULL;
+        if(stack == NULL || stack->cold == NULL     ||
+           stack->cold->dump_sink == NULL            ||
+           (dump_file = stack_dump_sink_lock(stack->cold->dump_sink)) == NULL) {
+            COLOR_PRINTF_LIMITED(DUMP_ERROR_MESSAGES_PER_SECOND,
+                                 RED_TEXT, BOLD_TEXT, DEFAULT_BACKGROUND,
+                                 "MEMORY DUMP FILE ERROR\r\n"
+                                 "called from: %s:%llu\r\n",
+                                 file_name,
+                                 line);
             return STACK_DUMP_ERROR;
         }
 
-        if(fprintf(stack->dump_file,
-                   "stack_t[0x%p] initialized in %s:%llu as "
+        stack_error_t dump_state = stack_write_dump(stack,
+                                                    dump_file,
+                                                    file_name,
+                                                    function_name,
+                                                    line,
+                                                    call_reason,
+                                                    corrupted_low,
+                                                    corrupted_high,
+                                                    keyframe);
+
+        //dumps of errors are flushed at once, process may not survive them
+        stack_dump_sink_unlock(stack->cold->dump_sink,
+                               call_reason != STACK_SUCCESS);
+        return dump_state;
+    }
+
+    //------------------------------------------------------------------------------
+    //WRITES KEYFRAME OF STACK WHICH IS OWNED BY OTHER THREAD, DUMP IS WRITTEN TO
+    //MEMORY FIRST AND GOES TO FILE ONLY IF VERSION WAS EVEN AND DID NOT CHANGE,
+    //STACK WHICH IS CHANGED ALL THE TIME GETS ONE LINE INSTEAD OF DUMP
+    //------------------------------------------------------------------------------
+    stack_error_t stack_dump_keyframe(stack_t *   stack,
+                                      const char *file_name,
+                                      const char *function_name,
+                                      size_t      line) {
+        if(stack == NULL || stack->cold == NULL || stack->cold->dump_sink == NULL)
+            return STACK_DUMP_ERROR;
+
+        for(size_t attempt = 0; attempt < DUMP_KEYFRAME_ATTEMPTS; attempt++) {
+            size_t version = __atomic_load_n(&stack->version, __ATOMIC_ACQUIRE);
+            if(version % 2 != 0) {
+                sched_yield();
+                continue;
+            }
+
+            char * record        = NULL;
+            size_t record_length = 0;
+            FILE * memory        = open_memstream(&record, &record_length);
+            if(memory == NULL)
+                return STACK_DUMP_ERROR;
+
+            stack_error_t dump_state = stack_write_dump(stack,
+                                                        memory,
+                                                        file_name,
+                                                        function_name,
+                                                        line,
+                                                        STACK_SUCCESS,
+                                                        0,
+                                                        0,
+                                                        true);
+            if(fclose(memory) != 0)
+                dump_state = STACK_DUMP_ERROR;
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if(__atomic_load_n(&stack->version, __ATOMIC_RELAXED) != version) {
+                free(record);
+                continue;
+            }
+
+            FILE *dump_file = stack_dump_sink_lock(stack->cold->dump_sink);
+            if(dump_file == NULL) {
+                free(record);
+                return STACK_DUMP_ERROR;
+            }
+            if(dump_state == STACK_SUCCESS &&
+               fwrite(record, 1, record_length, dump_file) != record_length)
+                dump_state = STACK_DUMP_ERROR;
+            stack_dump_sink_unlock(stack->cold->dump_sink, false);
+            free(record);
+            return dump_state;
+        }
+
+        FILE *dump_file = stack_dump_sink_lock(stack->cold->dump_sink);
+        if(dump_file == NULL)
+            return STACK_DUMP_ERROR;
+        stack_error_t note_state = fprintf(dump_file,
+                                           "stack_t #%zu [0x%p] was being changed, "
+                                           "dump called from %s:%zu is skipped\r\n\r\n",
+                                           stack->id,
+                                           stack,
+                                           file_name,
+                                           line) < 0 ? STACK_DUMP_ERROR : STACK_SUCCESS;
+        stack_dump_sink_unlock(stack->cold->dump_sink, false);
+        return note_state;
+    }
+
+    //------------------------------------------------------------------------------
+    //WRITES ONE DUMP RECORD, SINK OF STACK IS LOCKED BY CALLER
+    //------------------------------------------------------------------------------
+    stack_error_t stack_write_dump(stack_t *     stack,
+                                   FILE *        dump_file,
+                                   const char *  file_name,
+                                   const char *  function_name,
+                                   size_t        line,
+                                   stack_error_t call_reason,
+                                   size_t        corrupted_low,
+                                   size_t        corrupted_high,
+                                   bool          keyframe) {
+        if(fprintf(dump_file,
+                   "stack_t #%zu [0x%p] initialized in %s:%llu as "
                    "'stack_t %s' in function '%s'\r\n"
                    "dump called from %s:%llu '%s'\r\n"
                    "ERROR = ",
+                   stack->id,
                    stack,
-                   stack->initialized_file,
-                   stack->initialized_line,
-                   stack->initialized_varname,
-                   stack->initialized_function,
+                   stack->cold->initialized_file,
+                   stack->cold->initialized_line,
+                   stack->cold->initialized_varname,
+                   stack->cold->initialized_function,
                    file_name,
                    line,
                    function_name) < 0)
@@ -506,7 +1646,7 @@ stack_error_t stack_verify(stack_t *stack) {
         if(error_definition == NULL)
             error_definition = "'unknown error'";
 
-        if(fprintf(stack->dump_file,
+        if(fprintf(dump_file,
                    "'%s'\r\n",
                    error_definition) < 0)
             return STACK_DUMP_ERROR;
@@ -515,7 +1655,7 @@ stack_error_t stack_verify(stack_t *stack) {
             return STACK_NULL;
 
         #ifdef STACK_CANARY_PROTECTION
-            if(fprintf(stack->dump_file,
+            if(fprintf(dump_file,
                        "{\r\n"
                        "\t\t---CANARIES---\r\n"
                        "\tcanary_left       = 0x%llx;\r\n"
@@ -532,16 +1672,28 @@ stack_error_t stack_verify(stack_t *stack) {
         #endif
 
         #ifdef STACK_HASH_PROTECTION
-            if(fprintf(stack->dump_file,
+            if(fprintf(dump_file,
                        "\t\t---HASHES---\r\n"
                        "\tstructure_hash    = 0x%llx;\r\n"
-                       "\tdata_hash         = 0x%llx;\r\n",
+                       "\tdata_hash         = 0x%llx;\r\n"
+                       "\tchunk_hashes[0x%p], %zu chunks;\r\n",
                        stack->structure_hash,
-                       stack->data_hash) < 0)
+                       stack->data_hash,
+                       stack->chunk_hashes,
+                       stack_hash_chunk_count(stack, stack->capacity)) < 0)
+                return STACK_DUMP_ERROR;
+            if(corrupted_low != corrupted_high &&
+               fprintf(dump_file,
+                       "\tcorrupted elements = [%zu, %zu);\r\n",
+                       corrupted_low,
+                       corrupted_high) < 0)
                 return STACK_DUMP_ERROR;
+        #else
+            (void)corrupted_low;
+            (void)corrupted_high;
         #endif
 
-        if(fprintf(stack->dump_file,
+        if(fprintf(dump_file,
                    "\t\t---DEFAULT_INFO---\r\n"
                    "\tsize              =   %llu;\r\n"
                    "\tcapacity          =   %llu;\r\n"
@@ -554,38 +1706,75 @@ stack_error_t stack_verify(stack_t *stack) {
                    stack->data) < 0)
             return STACK_DUMP_ERROR;
 
-        stack_error_t members_writing_state = stack_write_members(stack);
+        //error dumps and keyframes asked by caller are full and do not change
+        //what next dump writes, they can be written by scrubber and signal
+        //dumps while owner changes stack
+        bool read_only = keyframe || call_reason != STACK_SUCCESS;
+        bool full      = read_only || stack->cold->dumps_to_keyframe == 0;
+
+        stack_error_t members_writing_state = stack_write_members(stack,
+                                                                  dump_file,
+                                                                  full);
         if(members_writing_state != STACK_SUCCESS)
             return members_writing_state;
 
-        if(fprintf(stack->dump_file,
+        if(!read_only) {
+            stack->cold->dirty_low  = 0;
+            stack->cold->dirty_high = 0;
+            if(stack->cold->dumps_to_keyframe == 0)
+                stack->cold->dumps_to_keyframe = DUMP_KEYFRAME_INTERVAL;
+            stack->cold->dumps_to_keyframe--;
+        }
+
+        if(fprintf(dump_file,
                    "}\r\n\r\n") < 0)
             return STACK_DUMP_ERROR;
 
-        fflush(stack->dump_file);
         return STACK_SUCCESS;
     }
 
     //------------------------------------------------------------------------------
-    //WRITES STACK MEMBERS
+    //WRITES ALL STACK MEMBERS FOR KEYFRAME, ONLY CHANGED MEMBERS OTHERWISE
     //------------------------------------------------------------------------------
-    stack_error_t stack_write_members(stack_t *stack) {
+    stack_error_t stack_write_members(stack_t *stack,
+                                      FILE *   dump_file,
+                                      bool     keyframe) {
         if(stack->data == NULL          ) {
-            if(fprintf(stack->dump_file,
+            if(fprintf(dump_file,
                        "\t\t--- (POISON)\r\n") < 0)
                 return STACK_DUMP_ERROR;
 
             return STACK_SUCCESS;
         }
         if(stack->size > stack->capacity) {
-            if(fprintf(stack->dump_file,
+            if(fprintf(dump_file,
                        "\t\tincorrect size\r\n") < 0)
                 return STACK_DUMP_ERROR;
 
             return STACK_SUCCESS;
         }
 
-        stack_error_t printing_error = write_stack_members_flags(stack);
+        size_t first = 0,
+               last  = stack->capacity;
+        if(!keyframe) {
+            first = stack->cold->dirty_low;
+            last  = stack->cold->dirty_high < stack->capacity ?
+                    stack->cold->dirty_high : stack->capacity;
+        }
+
+        int header_state = keyframe ? fprintf(dump_file,
+                                              "\t\t(KEYFRAME)\r\n")         :
+                                      fprintf(dump_file,
+                                              "\t\t(CHANGED [%zu, %zu))\r\n",
+                                              first,
+                                              last);
+        if(header_state < 0)
+            return STACK_DUMP_ERROR;
+
+        stack_error_t printing_error = write_stack_members_flags(stack,
+                                                                 dump_file,
+                                                                 first,
+                                                                 last);
         if(printing_error != STACK_SUCCESS)
             return printing_error;
 
@@ -595,13 +1784,16 @@ stack_error_t stack_verify(stack_t *stack) {
     //------------------------------------------------------------------------------
     //WRITES STACK MEMBERS WITH * BEFORE INDEX AND (POISON) AFTER ELEMENT IF IT IS
     //------------------------------------------------------------------------------
-    stack_error_t write_stack_members_flags(stack_t *stack) {
+    stack_error_t write_stack_members_flags(stack_t *stack,
+                                            FILE *   dump_file,
+                                            size_t   first,
+                                            size_t   last) {
         const char * const POISON_ELEMENT_FLAG = " (POISON)";
         const char * const NORMAL_ELEMENT_FLAG = "";
         const char * const POISON_INDEX_FLAG   = "*";
         const char * const NORMAL_INDEX_FLAG   = " ";
 
-        for(size_t element = 0; element < stack->capacity; element++) {
+        for(size_t element = first; element < last; element++) {
             const char *index_flag = NULL;
             const char *element_flag = NULL;
 
@@ -614,19 +1806,19 @@ stack_error_t stack_verify(stack_t *stack) {
                 element_flag = POISON_ELEMENT_FLAG;
             }
 
-            if(fprintf(stack->dump_file,
+            if(fprintf(dump_file,
                        "\t   %s[%llu] = ",
                        index_flag,
                        element) < 0)
                 return STACK_DUMP_ERROR;
 
-            if(stack->print_func(stack->dump_file,
+            if(stack->cold->print_func(dump_file,
                                  (char *)stack->data +
                                  element *
                                  stack->element_size) < 0)
                 return STACK_DUMP_ERROR;
 
-            if(fprintf(stack->dump_file,
+            if(fprintf(dump_file,
                        "%s;\r\n",
                        element_flag) < 0)
                 return STACK_DUMP_ERROR;
@@ -675,6 +1867,14 @@ stack_error_t stack_verify(stack_t *stack) {
                 return TEXT_STACK_UNEXPECTED_STRUCTURE_HASH;
             case STACK_UNEXPECTED_DATA_HASH:
                 return TEXT_STACK_UNEXPECTED_DATA_HASH;
+            case STACK_FULL:
+                return TEXT_STACK_FULL;
+            case STACK_IO_ERROR:
+                return TEXT_STACK_IO_ERROR;
+            case STACK_TIMEOUT:
+                return TEXT_STACK_TIMEOUT;
+            case STACK_NOT_FOUND:
+                return TEXT_STACK_NOT_FOUND;
             default:
                 return NULL;
         }
@@ -697,21 +1897,42 @@ stack_error_t stack_verify(stack_t *stack) {
     //AS A HELL'S HUG
     //------------------------------------------------------------------------------
     stack_error_t stack_update_canary(stack_t *stack) {
+        stack_locate_canaries(stack);
+
+        *(stack->data_left_canary ) = stack_canary_value(stack,
+                                                         stack->data_left_canary);
+        *(stack->data_right_canary) = stack_canary_value(stack,
+                                                         stack->data_right_canary);
+
+        stack->structure_left_canary  = stack_canary_value(stack,
+                                                           &stack->structure_left_canary);
+        stack->structure_right_canary = stack_canary_value(stack,
+                                                           &stack->structure_right_canary);
+        return STACK_SUCCESS;
+    }
+
+    //------------------------------------------------------------------------------
+    //POINTS DATA CANARIES POINTERS TO THEIR PLACES AROUND DATA
+    //------------------------------------------------------------------------------
+    void stack_locate_canaries(stack_t *stack) {
         stack->data_left_canary  = (canary_t *)((char *)stack +
-                                                sizeof(stack_t));
+                                                stack_data_offset(stack->alignment) -
+                                                sizeof(canary_t));
         stack->data_right_canary = (canary_t *)((char *)stack +
-                                                sizeof(stack_t) +
-                                                sizeof(canary_t) +
+                                                stack_data_offset(stack->alignment) +
                                                 stack->capacity *
                                                 stack->element_size +
                                                 stack->alignment_offset);
+    }
 
-        *(stack->data_left_canary ) = (canary_t)stack->data ^ CANARY_HEX_SPEAK;
-        *(stack->data_right_canary) = (canary_t)stack->data ^ CANARY_HEX_SPEAK;
-
-        stack->structure_left_canary  = (canary_t)stack ^ CANARY_HEX_SPEAK;
-        stack->structure_right_canary = (canary_t)stack ^ CANARY_HEX_SPEAK;
-        return STACK_SUCCESS;
+    //------------------------------------------------------------------------------
+    //CANARY VALUE DEPENDS ON ITS OFFSET FROM STACK START, NOT ON ADDRESS,
+    //SO STACK STAYS VALID WHEN IT IS MAPPED TO ANOTHER PLACE
+    //------------------------------------------------------------------------------
+    canary_t stack_canary_value(const stack_t *stack,
+                                const void *   canary) {
+        return (canary_t)((const char *)canary -
+                          (const char *)stack) ^ CANARY_HEX_SPEAK;
     }
 
     //------------------------------------------------------------------------------
@@ -729,93 +1950,192 @@ stack_error_t stack_verify(stack_t *stack) {
     //CHECKS IF CURRENT CANARIES ARE SAME AS WRITTEN IN STACK STRUCTURE
     //------------------------------------------------------------------------------
     stack_error_t stack_verify_canaries(stack_t *stack) {
-        if(stack->structure_left_canary  != ((canary_t)stack ^
-                                             CANARY_HEX_SPEAK))
+        if(stack->structure_left_canary  != stack_canary_value(stack,
+                                                               &stack->structure_left_canary))
             return STACK_UNEXPECTED_LEFT_CANARY;
 
-        if(stack->structure_right_canary != ((canary_t)stack ^
-                                             CANARY_HEX_SPEAK))
+        if(stack->structure_right_canary != stack_canary_value(stack,
+                                                               &stack->structure_right_canary))
             return STACK_UNEXPECTED_RIGHT_CANARY;
 
-        if(*(stack->data_left_canary ) != ((canary_t)stack->data ^
-                                           CANARY_HEX_SPEAK))
+        if(*(stack->data_left_canary ) != stack_canary_value(stack,
+                                                             stack->data_left_canary))
             return STACK_UNEXPECTED_DATA_LEFT_CANARY;
 
-        if(*(stack->data_right_canary) != ((canary_t)stack->data ^
-                                           CANARY_HEX_SPEAK))
+        if(*(stack->data_right_canary) != stack_canary_value(stack,
+                                                             stack->data_right_canary))
             return STACK_UNEXPECTED_DATA_RIGHT_CANARY;
 
         return STACK_SUCCESS;
     }
 #endif
 
+//==============================================================================
+//CHANGED SLOTS TRACKING FUNCTIONS DEFINITION
+//==============================================================================
+#if defined(STACK_WRITE_DUMP) || defined(STACK_HASH_PROTECTION)
+    //------------------------------------------------------------------------------
+    //ADDS SLOTS [first, last) TO RANGES WHICH NEXT DUMP WRITES AND NEXT HASH UPDATE
+    //REHASHES
+    //------------------------------------------------------------------------------
+    void stack_mark_dirty(stack_t *stack,
+                          size_t   first,
+                          size_t   last) {
+        #ifdef STACK_HASH_PROTECTION
+            stack_hash_touch(stack, first, last);
+        #endif
+
+        #ifdef STACK_WRITE_DUMP
+            stack_cold_t *cold = stack->cold;
+            if(cold->dirty_low == cold->dirty_high) {
+                cold->dirty_low  = first;
+                cold->dirty_high = last;
+                return ;
+            }
+            if(first < cold->dirty_low)
+                cold->dirty_low = first;
+            if(last > cold->dirty_high)
+                cold->dirty_high = last;
+        #endif
+    }
+#endif
+
 //==============================================================================
 //STACK HASH PROTECTION MODE FUNCTIONS DEFINITION
 //==============================================================================
 #ifdef STACK_HASH_PROTECTION
     //------------------------------------------------------------------------------
-    //FUNCTION UPDATES STACK HASHES
+    //FUNCTION UPDATES STACK HASHES, ONLY CHUNKS WITH CHANGED SLOTS ARE REHASHED
     //------------------------------------------------------------------------------
     stack_error_t stack_update_hash(stack_t *stack) {
-        stack_error_t error_code = stack_calculate_hashes(stack,
-                                                          &stack->structure_hash,
-                                                          &stack->data_hash);
-        if(error_code != STACK_SUCCESS)
-            return error_code;
+        if(stack == NULL)
+            return STACK_NULL;
 
+        stack_hash_chunks(stack);
+        stack->structure_hash = stack_structure_hash(stack);
+        stack->data_hash      = stack_data_hash     (stack);
         return STACK_SUCCESS;
     }
 
     //------------------------------------------------------------------------------
-    //FUNCTION WRITES HASHES OF STRUCTURE AND DATA
+    //COUNTS CHUNK HASHES OF STACK WHICH DATA WAS NOT WRITTEN BY OPERATIONS (MAPPED
+    //STACK) AND CHECKS THEM WITH DATA HASH KEPT WITH STACK, SO DATA IS HASHED
+    //ONCE, BY FIRST OPERATION, CALLED ONLY BY OWNER OF STACK
     //------------------------------------------------------------------------------
-    stack_error_t stack_calculate_hashes(stack_t *stack,
-                                         hash_t * structure_hash,
-                                         hash_t * data_hash) {
+    stack_error_t stack_verify_pending_hash(stack_t *stack) {
         if(stack == NULL)
             return STACK_NULL;
 
-        *structure_hash = hash_function(&stack->size,
-                                        &stack->data + 1);
+        if(!stack_hash_pending(stack))
+            return STACK_SUCCESS;
+
+        //scrubber skips stack while chunk hashes are written
+        stack_write_begin(stack);
+        stack_hash_chunks(stack);
+        stack_write_end  (stack);
+
+        if(stack->data_hash != stack_data_hash(stack))
+            return STACK_UNEXPECTED_DATA_HASH;
 
-        *data_hash      = hash_function(stack->data,
-                                        stack->data +
-                                        stack->capacity *
-                                        stack->element_size - 1);
         return STACK_SUCCESS;
     }
 
     //------------------------------------------------------------------------------
-    //HASH FUNCTION djb2, COUNTS HASH FROM START TO END
+    //HASHES CHUNK HASHES (THEY ARE NOT RECOUNTED FROM DATA HERE) AND AGGREGATES
     //------------------------------------------------------------------------------
-    hash_t hash_function(const void *start,
-                         const void *end) {
-        hash_t hash = 5381;
-        const char *bytes_start = (const char *)start;
-        for(const char *elem = bytes_start; elem < end; elem++)
-            hash = (hash << 5) + hash + *elem;
-        return hash;
+    hash_t stack_data_hash(const stack_t *stack) {
+        hash_t data_hash = stack_hash_root(stack);
+
+        //aggregates above size are left from popped elements, they are not hashed
+        if(stack->aggregates != NULL)
+            data_hash = data_hash * 33 +
+                        hash_function(stack->aggregates,
+                                      stack->aggregates +
+                                      stack->size *
+                                      stack->element_size);
+        return data_hash;
     }
 
     //------------------------------------------------------------------------------
-    //CHECKS IF CURRENT HASH IS SAME AS WRITTEN IN STACK STRUCTURE
+    //HASHES FIELDS ONE BY ONE, SO IT DOES NOT DEPEND ON ORDER OF FIELDS IN stack_t
+    //data POINTER IS CHECKED IN stack_verify_structure, IT IS NOT HASHED
+    //TO KEEP HASH SAME WHEN STACK IS MAPPED TO ANOTHER ADDRESS
     //------------------------------------------------------------------------------
-    stack_error_t stack_verify_hashes(stack_t *stack) {
-        hash_t structure_hash = 0,
-               data_hash      = 0;
+    hash_t stack_structure_hash(const stack_t *stack) {
+        const uint64_t fields[] = {
+            stack->size,
+            stack->capacity,
+            stack->element_size,
+            stack->alignment,
+            stack->variable_size,
+            (uintptr_t)stack->combine,
+            (uintptr_t)stack->aggregates,
+            (uintptr_t)stack->allocator.allocate,
+            (uintptr_t)stack->allocator.reallocate,
+            (uintptr_t)stack->allocator.release,
+            (uintptr_t)stack->allocator.context,
+            stack->init_capacity,
+            stack->max_bytes,
+            stack->grow_factor,
+            stack->shrink_threshold,
+            stack->shrink_factor,
+        };
+        return hash_function(fields,
+                             fields + sizeof(fields) / sizeof(fields[0]));
+    }
 
-        stack_error_t error_code = stack_calculate_hashes(stack,
-                                                          &structure_hash,
-                                                          &data_hash);
-        if(error_code != STACK_SUCCESS)
-            return error_code;
+    //------------------------------------------------------------------------------
+    //CHECKS IF CURRENT STRUCTURE HASH IS SAME AS WRITTEN IN STACK STRUCTURE
+    //------------------------------------------------------------------------------
+    stack_error_t stack_verify_structure_hash(stack_t *stack) {
+        if(stack == NULL)
+            return STACK_NULL;
 
-        if(stack->structure_hash != structure_hash)
+        if(stack->structure_hash != stack_structure_hash(stack))
             return STACK_UNEXPECTED_STRUCTURE_HASH;
 
-        if(stack->data_hash      != data_hash)
+        return STACK_SUCCESS;
+    }
+
+    //------------------------------------------------------------------------------
+    //CHECKS EVERY CHUNK OF DATA AGAINST ITS HASH AND CHUNK HASHES AGAINST DATA HASH
+    //ELEMENTS OF CHANGED CHUNKS ARE RETURNED TO CALLER
+    //------------------------------------------------------------------------------
+    stack_error_t stack_verify_data_hash(stack_t *stack,
+                                         size_t * corrupted_low,
+                                         size_t * corrupted_high) {
+        if(stack == NULL)
+            return STACK_NULL;
+
+        //there is nothing to compare data with until owner counts chunk hashes
+        if(stack_hash_pending(stack))
+            return STACK_SUCCESS;
+
+        bool chunks_valid = stack_hash_check_chunks(stack,
+                                                    corrupted_low,
+                                                    corrupted_high);
+        if(!chunks_valid)
+            return STACK_UNEXPECTED_DATA_HASH;
+
+        if(stack->data_hash != stack_data_hash(stack))
             return STACK_UNEXPECTED_DATA_HASH;
 
         return STACK_SUCCESS;
     }
 #endif
+
+//==============================================================================
+//HASH FUNCTION, ALSO USED FOR CHECKSUMS WHEN HASH PROTECTION IS OFF
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//HASH FUNCTION djb2, COUNTS HASH FROM START TO END
+//------------------------------------------------------------------------------
+hash_t hash_function(const void *start,
+                     const void *end) {
+    hash_t hash = 5381;
+    const char *bytes_start = (const char *)start;
+    for(const char *elem = bytes_start; elem < end; elem++)
+        hash = (hash << 5) + hash + *elem;
+    return hash;
+}
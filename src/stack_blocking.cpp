@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "stack.h"
+#include "stack_internal.h"
+#include "stack_blocking.h"
+#include "memory.h"
+#include "custom_assert.h"
+
+//==============================================================================
+//QUEUE OF WAITERS, FIRST QUEUED IS FIRST SERVED
+//==============================================================================
+struct stack_waiter_queue_t {
+    stack_waiter_t *head;
+    stack_waiter_t *tail;
+};
+
+//==============================================================================
+//THE DEFINITION OF BLOCKING STACK STRUCTURE
+//SEQUENCES ARE FUTEX WORDS, THEY CHANGE AFTER EVERY PUSH/POP
+//==============================================================================
+struct stack_blocking_t {
+    pthread_mutex_t      lock;
+    stack_t *            stack;
+    size_t               bound;
+
+    uint32_t             pushed_sequence;
+    uint32_t             popped_sequence;
+    size_t               pop_sleepers;
+    size_t               push_sleepers;
+
+    stack_waiter_queue_t pop_waiters;
+    stack_waiter_queue_t push_waiters;
+};
+
+//==============================================================================
+//FUNCTIONS PROTOTYPES
+//==============================================================================
+static stack_error_t   push_locked     (stack_blocking_t *stack,
+                                        void *            element,
+                                        stack_waiter_t ** woken,
+                                        bool *            wake_sleeper);
+static stack_error_t   pop_locked      (stack_blocking_t *stack,
+                                        void *            output,
+                                        stack_waiter_t ** woken,
+                                        bool *            wake_sleeper);
+static void            wake_after_lock (stack_waiter_t *woken,
+                                        uint32_t *      sequence);
+static stack_error_t   futex_wait_until(uint32_t *             sequence,
+                                        uint32_t               expected,
+                                        long                   timeout_ms,
+                                        const struct timespec *deadline);
+static struct timespec deadline_after  (long timeout_ms);
+static void            queue_append    (stack_waiter_queue_t *queue,
+                                        stack_waiter_t *      waiter);
+static stack_waiter_t *queue_take      (stack_waiter_queue_t *queue);
+
+//==============================================================================
+//GLOBAL FUNCTION
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//INITIALIZES BLOCKING STACK WHICH HOLDS NOT MORE THAN bound ELEMENTS
+//------------------------------------------------------------------------------
+stack_blocking_t *stack_blocking_init(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                          const char *initialized_file,
+                                                          const char *initialized_varname,
+                                                          const char *initialized_function,
+                                                          size_t      initialized_line,
+                                                          int       (*print_func)(FILE *, void *),)
+                                      size_t capacity,
+                                      size_t bound,
+                                      size_t element_size) {
+    C_ASSERT(bound != 0, return NULL);
+
+    stack_blocking_t *stack = (stack_blocking_t *)_calloc(1, sizeof(stack_blocking_t));
+    if(stack == NULL)
+        return NULL;
+
+    stack->stack = stack_init(STACK_WRITE_DUMP_ON(dump_filename,
+                                                  initialized_file,
+                                                  initialized_varname,
+                                                  initialized_function,
+                                                  initialized_line,
+                                                  print_func,)
+                              capacity,
+                              element_size);
+    if(stack->stack == NULL) {
+        _free(stack);
+        return NULL;
+    }
+
+    pthread_mutex_init(&stack->lock, NULL);
+    stack->bound = bound;
+    return stack;
+}
+
+//------------------------------------------------------------------------------
+//PUSHES ELEMENT, SLEEPS WHILE STACK IS FULL
+//------------------------------------------------------------------------------
+stack_error_t stack_push_wait(stack_blocking_t *stack,
+                              void *            element,
+                              long              timeout_ms) {
+    C_ASSERT(stack   != NULL, return STACK_NULL         );
+    C_ASSERT(element != NULL, return STACK_INVALID_INPUT);
+
+    struct timespec deadline = deadline_after(timeout_ms);
+
+    pthread_mutex_lock(&stack->lock);
+    while(true) {
+        stack_waiter_t *woken        = NULL;
+        bool            wake_sleeper = false;
+
+        stack_error_t push_state = push_locked(stack, element, &woken, &wake_sleeper);
+        if(push_state != STACK_FULL || timeout_ms == 0) {
+            pthread_mutex_unlock(&stack->lock);
+            wake_after_lock(woken, wake_sleeper ? &stack->pushed_sequence : NULL);
+            return push_state;
+        }
+
+        uint32_t sequence = __atomic_load_n(&stack->popped_sequence, __ATOMIC_RELAXED);
+        stack->push_sleepers++;
+        pthread_mutex_unlock(&stack->lock);
+
+        stack_error_t wait_state = futex_wait_until(&stack->popped_sequence,
+                                                    sequence,
+                                                    timeout_ms,
+                                                    &deadline);
+
+        pthread_mutex_lock(&stack->lock);
+        stack->push_sleepers--;
+        if(wait_state != STACK_SUCCESS) {
+            pthread_mutex_unlock(&stack->lock);
+            return wait_state;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+//POPS ELEMENT, SLEEPS WHILE STACK IS EMPTY
+//------------------------------------------------------------------------------
+stack_error_t stack_pop_wait(stack_blocking_t *stack,
+                             void *            output,
+                             long              timeout_ms) {
+    C_ASSERT(stack  != NULL, return STACK_NULL          );
+    C_ASSERT(output != NULL, return STACK_INVALID_OUTPUT);
+
+    struct timespec deadline = deadline_after(timeout_ms);
+
+    pthread_mutex_lock(&stack->lock);
+    while(true) {
+        stack_waiter_t *woken        = NULL;
+        bool            wake_sleeper = false;
+
+        stack_error_t pop_state = pop_locked(stack, output, &woken, &wake_sleeper);
+        if(pop_state != STACK_EMPTY || timeout_ms == 0) {
+            pthread_mutex_unlock(&stack->lock);
+            wake_after_lock(woken, wake_sleeper ? &stack->popped_sequence : NULL);
+            return pop_state;
+        }
+
+        uint32_t sequence = __atomic_load_n(&stack->pushed_sequence, __ATOMIC_RELAXED);
+        stack->pop_sleepers++;
+        pthread_mutex_unlock(&stack->lock);
+
+        stack_error_t wait_state = futex_wait_until(&stack->pushed_sequence,
+                                                    sequence,
+                                                    timeout_ms,
+                                                    &deadline);
+
+        pthread_mutex_lock(&stack->lock);
+        stack->pop_sleepers--;
+        if(wait_state != STACK_SUCCESS) {
+            pthread_mutex_unlock(&stack->lock);
+            return wait_state;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+//DESTROYS BLOCKING STACK, NOBODY MUST WAIT ON IT
+//------------------------------------------------------------------------------
+stack_error_t stack_blocking_destroy(stack_blocking_t **stack) {
+    C_ASSERT(stack != NULL, return STACK_NULL);
+    if(*stack == NULL)
+        return STACK_NULL;
+
+    stack_error_t destroy_state = STACK_SUCCESS;
+    if((*stack)->stack != NULL)
+        destroy_state = stack_destroy(&(*stack)->stack);
+
+    pthread_mutex_destroy(&(*stack)->lock);
+    _free(*stack);
+    *stack = NULL;
+    return destroy_state;
+}
+
+//------------------------------------------------------------------------------
+//PUSHES ELEMENT OR QUEUES WAITER IF STACK IS FULL
+//------------------------------------------------------------------------------
+bool stack_push_enqueue(stack_blocking_t *stack,
+                        stack_waiter_t *  waiter) {
+    stack_waiter_t *woken        = NULL;
+    bool            wake_sleeper = false;
+
+    pthread_mutex_lock(&stack->lock);
+    stack_error_t push_state = push_locked(stack, waiter->element, &woken, &wake_sleeper);
+    if(push_state == STACK_FULL) {
+        queue_append(&stack->push_waiters, waiter);
+        pthread_mutex_unlock(&stack->lock);
+        return true;
+    }
+    pthread_mutex_unlock(&stack->lock);
+
+    waiter->result = push_state;
+    wake_after_lock(woken, wake_sleeper ? &stack->pushed_sequence : NULL);
+    return false;
+}
+
+//------------------------------------------------------------------------------
+//POPS ELEMENT OR QUEUES WAITER IF STACK IS EMPTY
+//------------------------------------------------------------------------------
+bool stack_pop_enqueue(stack_blocking_t *stack,
+                       stack_waiter_t *  waiter) {
+    stack_waiter_t *woken        = NULL;
+    bool            wake_sleeper = false;
+
+    pthread_mutex_lock(&stack->lock);
+    stack_error_t pop_state = pop_locked(stack, waiter->element, &woken, &wake_sleeper);
+    if(pop_state == STACK_EMPTY) {
+        queue_append(&stack->pop_waiters, waiter);
+        pthread_mutex_unlock(&stack->lock);
+        return true;
+    }
+    pthread_mutex_unlock(&stack->lock);
+
+    waiter->result = pop_state;
+    wake_after_lock(woken, wake_sleeper ? &stack->popped_sequence : NULL);
+    return false;
+}
+
+//==============================================================================
+//STATIC FUNCTIONS
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//GIVES ELEMENT TO WAITING POPPER OR PUSHES IT, RETURNS STACK_FULL IF NO SPACE
+//------------------------------------------------------------------------------
+stack_error_t push_locked(stack_blocking_t *stack,
+                          void *            element,
+                          stack_waiter_t ** woken,
+                          bool *            wake_sleeper) {
+    if(stack->stack == NULL)
+        return STACK_NULL;
+
+    stack_waiter_t *waiter = queue_take(&stack->pop_waiters);
+    if(waiter != NULL) {
+        memcpy(waiter->element, element, stack->stack->element_size);
+        waiter->result = STACK_SUCCESS;
+        *woken = waiter;
+        return STACK_SUCCESS;
+    }
+
+    if(stack->stack->size >= stack->bound)
+        return STACK_FULL;
+
+    stack_error_t push_state = stack_push(&stack->stack, element);
+    if(push_state != STACK_SUCCESS)
+        return push_state;
+
+    __atomic_fetch_add(&stack->pushed_sequence, 1, __ATOMIC_RELEASE);
+    *wake_sleeper = stack->pop_sleepers > 0;
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//POPS ELEMENT AND TAKES ELEMENT OF WAITING PUSHER IN ITS PLACE
+//RETURNS STACK_EMPTY IF THERE IS NOTHING TO POP
+//------------------------------------------------------------------------------
+stack_error_t pop_locked(stack_blocking_t *stack,
+                         void *            output,
+                         stack_waiter_t ** woken,
+                         bool *            wake_sleeper) {
+    if(stack->stack == NULL)
+        return STACK_NULL;
+
+    if(stack->stack->size == 0)
+        return STACK_EMPTY;
+
+    stack_error_t pop_state = stack_pop(&stack->stack, output);
+    if(pop_state != STACK_SUCCESS)
+        return pop_state;
+
+    __atomic_fetch_add(&stack->popped_sequence, 1, __ATOMIC_RELEASE);
+
+    stack_waiter_t *waiter = queue_take(&stack->push_waiters);
+    if(waiter != NULL) {
+        waiter->result = stack_push(&stack->stack, waiter->element);
+        *woken = waiter;
+        return STACK_SUCCESS;
+    }
+
+    *wake_sleeper = stack->push_sleepers > 0;
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//WAKES ONE SLEEPING THREAD AND QUEUED WAITER AFTER LOCK IS RELEASED
+//------------------------------------------------------------------------------
+void wake_after_lock(stack_waiter_t *woken,
+                     uint32_t *      sequence) {
+    if(sequence != NULL)
+        syscall(SYS_futex, sequence, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+
+    if(woken != NULL)
+        woken->wake(woken);
+}
+
+//------------------------------------------------------------------------------
+//SLEEPS WHILE SEQUENCE IS EQUAL TO EXPECTED OR UNTIL DEADLINE
+//------------------------------------------------------------------------------
+stack_error_t futex_wait_until(uint32_t *             sequence,
+                               uint32_t               expected,
+                               long                   timeout_ms,
+                               const struct timespec *deadline) {
+    struct timespec  remaining = {};
+    struct timespec *timeout   = NULL;
+
+    if(timeout_ms > 0) {
+        struct timespec now = {};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        remaining.tv_sec  = deadline->tv_sec  - now.tv_sec;
+        remaining.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+        if(remaining.tv_nsec < 0) {
+            remaining.tv_sec--;
+            remaining.tv_nsec += 1000000000;
+        }
+        if(remaining.tv_sec < 0)
+            return STACK_TIMEOUT;
+
+        timeout = &remaining;
+    }
+
+    if(syscall(SYS_futex, sequence, FUTEX_WAIT_PRIVATE, expected, timeout, NULL, 0) != 0 &&
+       errno == ETIMEDOUT)
+        return STACK_TIMEOUT;
+
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//RETURNS MONOTONIC TIME AFTER timeout_ms FROM NOW
+//------------------------------------------------------------------------------
+struct timespec deadline_after(long timeout_ms) {
+    struct timespec deadline = {};
+    if(timeout_ms <= 0)
+        return deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec  += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+}
+
+//------------------------------------------------------------------------------
+//ADDS WAITER TO THE END OF QUEUE
+//------------------------------------------------------------------------------
+void queue_append(stack_waiter_queue_t *queue,
+                  stack_waiter_t *      waiter) {
+    waiter->next = NULL;
+    if(queue->tail == NULL)
+        queue->head = waiter;
+    else
+        queue->tail->next = waiter;
+    queue->tail = waiter;
+}
+
+//------------------------------------------------------------------------------
+//TAKES FIRST WAITER FROM QUEUE, RETURNS NULL IF QUEUE IS EMPTY
+//------------------------------------------------------------------------------
+stack_waiter_t *queue_take(stack_waiter_queue_t *queue) {
+    stack_waiter_t *waiter = queue->head;
+    if(waiter == NULL)
+        return NULL;
+
+    queue->head = waiter->next;
+    if(queue->head == NULL)
+        queue->tail = NULL;
+    return waiter;
+}
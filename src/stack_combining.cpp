@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <sched.h>
+
+#include "stack.h"
+#include "stack_internal.h"
+#include "stack_combining.h"
+#include "memory.h"
+#include "custom_assert.h"
+
+//==============================================================================
+//NUMBER OF PUBLICATION SLOTS, THREADS WHICH SHARE SLOT WAIT FOR EACH OTHER
+//==============================================================================
+static const size_t COMBINING_SLOTS  = 64;
+//combiner scans slots again while it finds new requests, but not forever
+static const size_t COMBINING_PASSES = 4;
+//waiting thread spins this many times before giving processor away
+static const size_t COMBINING_SPINS  = 128;
+
+//==============================================================================
+//STATE OF SLOT, ONLY OWNER MOVES IT FROM FREE TO PENDING AND FROM DONE TO FREE
+//==============================================================================
+enum combining_slot_state_t : uint32_t {
+    COMBINING_SLOT_FREE    = 0,
+    COMBINING_SLOT_CLAIMED = 1, //owner writes request
+    COMBINING_SLOT_PENDING = 2, //request waits for combiner
+    COMBINING_SLOT_DONE    = 3, //combiner wrote result
+};
+
+//==============================================================================
+//EVERY SLOT IS IN ITS OWN CACHE LINE, SO WAITING THREADS DO NOT SHARE LINES
+//==============================================================================
+struct alignas(STACK_CACHE_LINE) combining_slot_t {
+    combining_slot_state_t  state;
+    stack_batch_operation_t operation;
+};
+
+//==============================================================================
+//THE DEFINITION OF COMBINING STACK STRUCTURE
+//==============================================================================
+struct stack_combining_t {
+    alignas(STACK_CACHE_LINE) bool combining; //true while some thread combines
+    stack_t *                      stack;
+    combining_slot_t               slots[COMBINING_SLOTS];
+};
+
+//==============================================================================
+//SLOT WHICH THREAD TRIES FIRST, THREADS GET HOME SLOTS ROUND ROBIN
+//==============================================================================
+static thread_local size_t home_slot      = SIZE_MAX;
+static size_t              next_home_slot = 0;
+
+//==============================================================================
+//FUNCTIONS PROTOTYPES
+//==============================================================================
+static stack_error_t     combining_request(stack_combining_t *stack,
+                                           bool               is_push,
+                                           void *             element);
+static combining_slot_t *claim_slot       (stack_combining_t *stack);
+static bool              try_combine      (stack_combining_t *stack);
+static void              combine_batch    (stack_combining_t *      stack,
+                                           stack_batch_operation_t *operations,
+                                           size_t                   count);
+
+//==============================================================================
+//GLOBAL FUNCTION
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//INITIALIZES COMBINING STACK
+//------------------------------------------------------------------------------
+stack_combining_t *stack_combining_init(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                            const char *initialized_file,
+                                                            const char *initialized_varname,
+                                                            const char *initialized_function,
+                                                            size_t      initialized_line,
+                                                            int       (*print_func)(FILE *, void *),)
+                                        size_t capacity,
+                                        size_t element_size) {
+    stack_combining_t *stack = (stack_combining_t *)_aligned_calloc(1,
+                                                                   sizeof(stack_combining_t),
+                                                                   alignof(stack_combining_t));
+    if(stack == NULL)
+        return NULL;
+
+    stack->stack = stack_init(STACK_WRITE_DUMP_ON(dump_filename,
+                                                  initialized_file,
+                                                  initialized_varname,
+                                                  initialized_function,
+                                                  initialized_line,
+                                                  print_func,)
+                              capacity,
+                              element_size);
+    if(stack->stack == NULL) {
+        _free(stack);
+        return NULL;
+    }
+    return stack;
+}
+
+//------------------------------------------------------------------------------
+//PUSHES ELEMENT, RETURNS WHEN SOME COMBINER HAS APPLIED IT
+//------------------------------------------------------------------------------
+stack_error_t stack_combining_push(stack_combining_t *stack, void *element) {
+    C_ASSERT(stack   != NULL, return STACK_NULL         );
+    C_ASSERT(element != NULL, return STACK_INVALID_INPUT);
+
+    return combining_request(stack, true, element);
+}
+
+//------------------------------------------------------------------------------
+//POPS ELEMENT TO OUTPUT, RETURNS WHEN SOME COMBINER HAS APPLIED IT
+//------------------------------------------------------------------------------
+stack_error_t stack_combining_pop(stack_combining_t *stack, void *output) {
+    C_ASSERT(stack  != NULL, return STACK_NULL          );
+    C_ASSERT(output != NULL, return STACK_INVALID_OUTPUT);
+
+    return combining_request(stack, false, output);
+}
+
+//------------------------------------------------------------------------------
+//DESTROYS COMBINING STACK AND STACK IN IT
+//------------------------------------------------------------------------------
+stack_error_t stack_combining_destroy(stack_combining_t **stack) {
+    C_ASSERT(stack != NULL, return STACK_NULL);
+    if(*stack == NULL)
+        return STACK_NULL;
+
+    stack_error_t destroy_state = STACK_SUCCESS;
+    if((*stack)->stack != NULL)
+        destroy_state = stack_destroy(&(*stack)->stack);
+
+    _free(*stack);
+    *stack = NULL;
+    return destroy_state;
+}
+
+//==============================================================================
+//STATIC FUNCTIONS
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//PUBLISHES REQUEST AND WAITS FOR RESULT, COMBINES ITSELF IF NOBODY ELSE DOES
+//------------------------------------------------------------------------------
+stack_error_t combining_request(stack_combining_t *stack,
+                                bool               is_push,
+                                void *             element) {
+    combining_slot_t *slot = claim_slot(stack);
+    slot->operation.is_push = is_push;
+    slot->operation.element = element;
+    slot->operation.result  = STACK_UNEXPECTED_ERROR;
+    __atomic_store_n(&slot->state, COMBINING_SLOT_PENDING, __ATOMIC_RELEASE);
+
+    size_t spins = 0;
+    while(__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != COMBINING_SLOT_DONE) {
+        if(try_combine(stack))
+            continue;
+        if(++spins % COMBINING_SPINS == 0)
+            sched_yield();
+    }
+
+    stack_error_t result = slot->operation.result;
+    __atomic_store_n(&slot->state, COMBINING_SLOT_FREE, __ATOMIC_RELEASE);
+    return result;
+}
+
+//------------------------------------------------------------------------------
+//TAKES FREE SLOT, STARTING FROM HOME SLOT OF THREAD
+//------------------------------------------------------------------------------
+combining_slot_t *claim_slot(stack_combining_t *stack) {
+    if(home_slot == SIZE_MAX)
+        home_slot = __atomic_fetch_add(&next_home_slot, 1, __ATOMIC_RELAXED) %
+                    COMBINING_SLOTS;
+
+    for(size_t i = 0; ; i++) {
+        combining_slot_t *slot = stack->slots + (home_slot + i) % COMBINING_SLOTS;
+        combining_slot_state_t expected = COMBINING_SLOT_FREE;
+        if(__atomic_load_n(&slot->state, __ATOMIC_RELAXED) == COMBINING_SLOT_FREE &&
+           __atomic_compare_exchange_n(&slot->state,
+                                       &expected,
+                                       COMBINING_SLOT_CLAIMED,
+                                       false,
+                                       __ATOMIC_ACQUIRE,
+                                       __ATOMIC_RELAXED))
+            return slot;
+        if((i + 1) % COMBINING_SLOTS == 0)
+            sched_yield();
+    }
+}
+
+//------------------------------------------------------------------------------
+//BECOMES COMBINER IF NOBODY IS, RETURNS FALSE IF OTHER THREAD COMBINES
+//------------------------------------------------------------------------------
+bool try_combine(stack_combining_t *stack) {
+    if(__atomic_load_n(&stack->combining, __ATOMIC_RELAXED) ||
+       __atomic_exchange_n(&stack->combining, true, __ATOMIC_ACQUIRE))
+        return false;
+
+    stack_batch_operation_t operations[COMBINING_SLOTS] = {};
+    size_t                  positions [COMBINING_SLOTS] = {};
+    for(size_t pass = 0; pass < COMBINING_PASSES; pass++) {
+        size_t count = 0;
+        for(size_t i = 0; i < COMBINING_SLOTS; i++) {
+            combining_slot_t *slot = stack->slots + i;
+            if(__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != COMBINING_SLOT_PENDING)
+                continue;
+            operations[count] = slot->operation;
+            positions [count] = i;
+            count++;
+        }
+        if(count == 0)
+            break;
+
+        combine_batch(stack, operations, count);
+        for(size_t i = 0; i < count; i++) {
+            combining_slot_t *slot = stack->slots + positions[i];
+            slot->operation.result = operations[i].result;
+            __atomic_store_n(&slot->state, COMBINING_SLOT_DONE, __ATOMIC_RELEASE);
+        }
+    }
+
+    __atomic_store_n(&stack->combining, false, __ATOMIC_RELEASE);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+//APPLIES REQUESTS AS ONE BATCH
+//IF STACK CAN NOT GROW FOR WHOLE BATCH, REQUESTS ARE APPLIED ONE BY ONE,
+//SO ONLY PUSHES WHICH DO NOT FIT GET STACK_FULL OR STACK_MEMORY_ERROR
+//------------------------------------------------------------------------------
+void combine_batch(stack_combining_t *      stack,
+                   stack_batch_operation_t *operations,
+                   size_t                   count) {
+    stack_error_t batch_state = STACK_NULL;
+    if(stack->stack != NULL)
+        batch_state = stack_apply_batch(&stack->stack, operations, count);
+    if(batch_state == STACK_SUCCESS)
+        return;
+
+    //stack was broken or destroyed, nothing can be applied
+    if(stack->stack == NULL) {
+        for(size_t i = 0; i < count; i++)
+            operations[i].result = batch_state;
+        return;
+    }
+
+    for(size_t i = 0; i < count; i++) {
+        stack_batch_operation_t *operation = operations + i;
+        if(stack->stack == NULL)
+            operation->result = STACK_NULL;
+        else if(operation->is_push)
+            operation->result = stack_push(&stack->stack, operation->element);
+        else
+            operation->result = stack_pop (&stack->stack, operation->element);
+    }
+}
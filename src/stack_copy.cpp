@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "stack.h"
+#include "stack_internal.h"
+
+//hash mode reads every pushed element back to hash its chunk, so element
+//which was streamed past cache would be loaded from memory again at once
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(STACK_HASH_PROTECTION)
+    #include <immintrin.h>
+    #define STACK_COPY_STREAM
+#endif
+
+//==============================================================================
+//ELEMENTS OF 1, 2, 4, 8 AND 16 BYTES ARE MOVED WITH FIXED SIZE COPIES WHICH
+//COMPILER TURNS INTO REGISTER MOVES, LARGE ELEMENTS ARE WRITTEN TO STACK WITH
+//NON-TEMPORAL STORES WITHOUT HASH MODE, SO PUSH OF THEM DOES NOT EVICT HOT DATA,
+//OTHER SIZES USE memcpy AND memset
+//==============================================================================
+static const size_t STREAM_ELEMENT_SIZE = 4096;
+static const size_t STREAM_VECTOR_SIZE  = 16;
+
+//==============================================================================
+//FUNCTIONS PROTOTYPES
+//==============================================================================
+template<size_t size>
+static void copy_fixed  (void *destination, const void *source, size_t);
+template<size_t size>
+static void clear_fixed (void *destination, size_t);
+static void copy_any    (void *destination, const void *source, size_t size);
+static void clear_any   (void *destination, size_t size);
+
+#ifdef STACK_COPY_STREAM
+    static void copy_stream (void *destination, const void *source, size_t size);
+    static void clear_stream(void *destination, size_t size);
+#endif
+
+//==============================================================================
+//KERNELS OF EVERY ELEMENT SIZE, copy_out NEVER STREAMS, BECAUSE CALLER READS
+//POPPED ELEMENT AT ONCE
+//==============================================================================
+static const stack_kernel_t KERNEL_1   = {copy_fixed<1> , copy_fixed<1> , clear_fixed<1> };
+static const stack_kernel_t KERNEL_2   = {copy_fixed<2> , copy_fixed<2> , clear_fixed<2> };
+static const stack_kernel_t KERNEL_4   = {copy_fixed<4> , copy_fixed<4> , clear_fixed<4> };
+static const stack_kernel_t KERNEL_8   = {copy_fixed<8> , copy_fixed<8> , clear_fixed<8> };
+static const stack_kernel_t KERNEL_16  = {copy_fixed<16>, copy_fixed<16>, clear_fixed<16>};
+static const stack_kernel_t KERNEL_ANY = {copy_any      , copy_any      , clear_any      };
+
+#ifdef STACK_COPY_STREAM
+    static const stack_kernel_t KERNEL_STREAM = {copy_stream, copy_any, clear_stream};
+#endif
+
+//==============================================================================
+//FUNCTIONS SHARED BETWEEN STACK MODULES
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//CHOOSES KERNEL ONCE, WHEN STACK IS INITIALIZED OR MAPPED
+//------------------------------------------------------------------------------
+const stack_kernel_t *stack_select_kernel(size_t element_size,
+                                          size_t alignment) {
+    switch(element_size) {
+        case 1:  return &KERNEL_1;
+        case 2:  return &KERNEL_2;
+        case 4:  return &KERNEL_4;
+        case 8:  return &KERNEL_8;
+        case 16: return &KERNEL_16;
+        default: break;
+    }
+
+    #ifdef STACK_COPY_STREAM
+        //every element starts on vector boundary, so slots are written by
+        //aligned stores only
+        if(element_size >= STREAM_ELEMENT_SIZE             &&
+           element_size % STREAM_VECTOR_SIZE == 0          &&
+           alignment    >= STREAM_VECTOR_SIZE              &&
+           __builtin_cpu_supports("sse2"))
+            return &KERNEL_STREAM;
+    #else
+        (void)alignment;
+    #endif
+
+    return &KERNEL_ANY;
+}
+
+//==============================================================================
+//STATIC FUNCTIONS
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//COPY AND CLEAR OF ELEMENT WHICH SIZE IS KNOWN TO COMPILER
+//------------------------------------------------------------------------------
+template<size_t size>
+void copy_fixed(void *destination, const void *source, size_t) {
+    memcpy(destination, source, size);
+}
+
+template<size_t size>
+void clear_fixed(void *destination, size_t) {
+    memset(destination, 0, size);
+}
+
+//------------------------------------------------------------------------------
+//COPY AND CLEAR OF ELEMENT OF ANY SIZE
+//------------------------------------------------------------------------------
+void copy_any(void *destination, const void *source, size_t size) {
+    memcpy(destination, source, size);
+}
+
+void clear_any(void *destination, size_t size) {
+    memset(destination, 0, size);
+}
+
+#ifdef STACK_COPY_STREAM
+    //------------------------------------------------------------------------------
+    //WRITES ELEMENT TO ALIGNED SLOT BY 16 BYTES PAST CACHE, sfence ORDERS THESE
+    //STORES BEFORE VERSION OF STACK IS CHANGED
+    //------------------------------------------------------------------------------
+    __attribute__((target("sse2")))
+    void copy_stream(void *destination, const void *source, size_t size) {
+        __m128i *      vector_destination = (__m128i *)destination;
+        const __m128i *vector_source      = (const __m128i *)source;
+        for(size_t vector = 0; vector < size / STREAM_VECTOR_SIZE; vector++)
+            _mm_stream_si128(vector_destination + vector,
+                             _mm_loadu_si128(vector_source + vector));
+        _mm_sfence();
+    }
+
+    __attribute__((target("sse2")))
+    void clear_stream(void *destination, size_t size) {
+        __m128i *vector_destination = (__m128i *)destination;
+        __m128i  zero               = _mm_setzero_si128();
+        for(size_t vector = 0; vector < size / STREAM_VECTOR_SIZE; vector++)
+            _mm_stream_si128(vector_destination + vector, zero);
+        _mm_sfence();
+    }
+#endif
@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "stack.h"
+#include "stack_internal.h"
+#include "custom_assert.h"
+
+#ifdef STACK_HASH_PROTECTION
+
+//==============================================================================
+//DATA IS HASHED BY CHUNKS OF STACK_HASH_CHUNK_SIZE BYTES (AT LEAST ONE ELEMENT),
+//DATA HASH OF STACK IS HASH OF CHUNK HASHES (MERKLE ROOT)
+//==============================================================================
+static const size_t STACK_HASH_CHUNK_SIZE = 4096;
+
+//==============================================================================
+//STACKS WITH FEWER CHUNKS ARE CHECKED BY CALLING THREAD ALONE
+//==============================================================================
+static const size_t HASH_PARALLEL_CHUNKS = 256;
+static const size_t HASH_MAX_WORKERS     = 7;
+
+//==============================================================================
+//ONE PASS OVER CHUNKS [next_chunk, chunks), CHUNKS ARE CLAIMED ONE BY ONE WITH
+//next_chunk, THEY ARE COMPARED WITH chunk_hashes OR WRITTEN TO store
+//==============================================================================
+struct hash_job_t {
+    const stack_t *stack;
+    hash_t *       store;        //NULL if chunks are checked
+    size_t         chunk_elements;
+    size_t         chunks;
+    size_t         next_chunk;
+    size_t         changed_low;  //first changed chunk, chunks if there is none
+    size_t         changed_high; //last changed chunk + 1, 0 if there is none
+};
+
+//==============================================================================
+//WORKERS WAIT FOR CHANGE OF generation, LAST OF THEM SIGNALS done
+//==============================================================================
+struct hash_pool_t {
+    pthread_mutex_t job_lock; //one parallel check at a time, others check alone
+    pthread_mutex_t lock;
+    pthread_cond_t  start;
+    pthread_cond_t  done;
+    size_t          workers;
+    size_t          generation;
+    size_t          busy;
+    hash_job_t      job;
+};
+
+static hash_pool_t    pool      = {};
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+//==============================================================================
+//FUNCTIONS PROTOTYPES
+//==============================================================================
+static size_t hash_chunk_elements(const stack_t *stack);
+static hash_t hash_chunk         (const stack_t *stack,
+                                  size_t         chunk,
+                                  size_t         chunk_elements);
+static void   hash_check_job     (hash_job_t *   job);
+static void   hash_run_job       (hash_job_t *   job);
+static void   hash_pool_start    (void);
+static void * hash_worker        (void *         argument);
+static void   atomic_store_min   (size_t *       value,
+                                  size_t         candidate);
+static void   atomic_store_max   (size_t *       value,
+                                  size_t         candidate);
+
+//==============================================================================
+//GLOBAL FUNCTION
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//RETURNS NUMBER OF CHUNKS IN STACK WITH capacity ELEMENTS
+//------------------------------------------------------------------------------
+size_t stack_hash_chunk_count(const stack_t *stack,
+                              size_t         capacity) {
+    size_t chunk_elements = hash_chunk_elements(stack);
+    return capacity / chunk_elements + (capacity % chunk_elements != 0);
+}
+
+//------------------------------------------------------------------------------
+//MAKES chunk_hashes FIT capacity ELEMENTS, KEEPS OLD ARRAY ON ERROR
+//------------------------------------------------------------------------------
+stack_error_t stack_hash_resize(stack_t *stack,
+                                size_t   capacity) {
+    C_ASSERT(stack != NULL, return STACK_NULL);
+
+    //one entry is allocated even for zero capacity, so NULL means no array
+    size_t chunks = stack_hash_chunk_count(stack, capacity);
+    if(chunks == 0)
+        chunks = 1;
+    if(stack->chunk_hashes != NULL && chunks == stack->chunk_count)
+        return STACK_SUCCESS;
+
+    hash_t *chunk_hashes = NULL;
+    if(stack->chunk_hashes == NULL)
+        chunk_hashes = (hash_t *)stack_memory_allocate(&stack->allocator,
+                                                       chunks * sizeof(hash_t),
+                                                       alignof(hash_t));
+    else
+        chunk_hashes = (hash_t *)stack_memory_reallocate(&stack->allocator,
+                                                         stack->chunk_hashes,
+                                                         stack->chunk_count * sizeof(hash_t),
+                                                         chunks             * sizeof(hash_t),
+                                                         alignof(hash_t));
+    if(chunk_hashes == NULL)
+        return STACK_MEMORY_ERROR;
+
+    stack->chunk_hashes = chunk_hashes;
+    stack->chunk_count  = chunks;
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//ADDS SLOTS [first, last) TO RANGE WHICH NEXT stack_hash_chunks REHASHES
+//------------------------------------------------------------------------------
+void stack_hash_touch(stack_t *stack,
+                      size_t   first,
+                      size_t   last) {
+    if(stack->hash_dirty_low == stack->hash_dirty_high) {
+        stack->hash_dirty_low  = first;
+        stack->hash_dirty_high = last;
+        return ;
+    }
+    if(first < stack->hash_dirty_low)
+        stack->hash_dirty_low = first;
+    if(last > stack->hash_dirty_high)
+        stack->hash_dirty_high = last;
+}
+
+//------------------------------------------------------------------------------
+//NEXT stack_hash_chunks REHASHES ALL DATA, FOR DATA WRITTEN NOT BY OPERATIONS,
+//CHUNK HASHES ARE UNKNOWN UNTIL THEN
+//------------------------------------------------------------------------------
+void stack_hash_invalidate(stack_t *stack) {
+    stack->hash_dirty_low  = 0;
+    stack->hash_dirty_high = SIZE_MAX;
+}
+
+//------------------------------------------------------------------------------
+//RETURNS TRUE IF CHUNK HASHES WERE INVALIDATED AND ARE NOT COUNTED YET
+//------------------------------------------------------------------------------
+bool stack_hash_pending(const stack_t *stack) {
+    return stack->hash_dirty_high == SIZE_MAX;
+}
+
+//------------------------------------------------------------------------------
+//REHASHES ONLY CHUNKS WHICH WERE TOUCHED SINCE LAST CALL, MANY OF THEM ARE
+//SPLIT BETWEEN WORKER THREADS
+//------------------------------------------------------------------------------
+void stack_hash_chunks(stack_t *stack) {
+    size_t low  = stack->hash_dirty_low,
+           high = stack->hash_dirty_high;
+    if(high > stack->capacity)
+        high = stack->capacity;
+    stack->hash_dirty_low  = 0;
+    stack->hash_dirty_high = 0;
+    if(low >= high)
+        return ;
+
+    hash_job_t job = {};
+    job.stack          = stack;
+    job.store          = stack->chunk_hashes;
+    job.chunk_elements = hash_chunk_elements(stack);
+    job.chunks         = (high - 1) / job.chunk_elements + 1;
+    job.next_chunk     = low / job.chunk_elements;
+    hash_run_job(&job);
+}
+
+//------------------------------------------------------------------------------
+//RETURNS HASH OF CHUNK HASHES WHICH ARE IN USE
+//------------------------------------------------------------------------------
+hash_t stack_hash_root(const stack_t *stack) {
+    return hash_function(stack->chunk_hashes,
+                         stack->chunk_hashes +
+                         stack_hash_chunk_count(stack, stack->capacity));
+}
+
+//------------------------------------------------------------------------------
+//REHASHES ALL CHUNKS AND COMPARES THEM WITH chunk_hashes, LARGE STACKS ARE
+//SPLIT BETWEEN WORKER THREADS, [*first, *last) ARE ELEMENTS OF CHANGED CHUNKS
+//------------------------------------------------------------------------------
+bool stack_hash_check_chunks(const stack_t *stack,
+                             size_t *       first,
+                             size_t *       last) {
+    C_ASSERT(stack != NULL, return false);
+    C_ASSERT(first != NULL, return false);
+    C_ASSERT(last  != NULL, return false);
+
+    hash_job_t job = {};
+    job.stack          = stack;
+    job.chunk_elements = hash_chunk_elements(stack);
+    job.chunks         = stack_hash_chunk_count(stack, stack->capacity);
+    job.changed_low    = job.chunks;
+    hash_run_job(&job);
+
+    if(job.changed_low >= job.changed_high) {
+        *first = 0;
+        *last  = 0;
+        return true;
+    }
+
+    *first = job.changed_low * job.chunk_elements;
+    *last  = job.changed_high * job.chunk_elements;
+    if(*last > stack->capacity)
+        *last = stack->capacity;
+    return false;
+}
+
+//==============================================================================
+//STATIC FUNCTIONS
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//RETURNS NUMBER OF ELEMENTS IN ONE CHUNK
+//------------------------------------------------------------------------------
+size_t hash_chunk_elements(const stack_t *stack) {
+    if(stack->element_size >= STACK_HASH_CHUNK_SIZE)
+        return 1;
+    return STACK_HASH_CHUNK_SIZE / stack->element_size;
+}
+
+//------------------------------------------------------------------------------
+//HASHES ELEMENTS OF ONE CHUNK, LAST CHUNK MAY BE SHORTER
+//------------------------------------------------------------------------------
+hash_t hash_chunk(const stack_t *stack,
+                  size_t         chunk,
+                  size_t         chunk_elements) {
+    size_t first = chunk * chunk_elements,
+           last  = first + chunk_elements;
+    if(last > stack->capacity)
+        last = stack->capacity;
+
+    return hash_function(stack->data + first * stack->element_size,
+                         stack->data + last  * stack->element_size);
+}
+
+//------------------------------------------------------------------------------
+//CHECKS OR HASHES CHUNKS UNTIL ALL OF THEM ARE CLAIMED, CALLED BY EVERY THREAD
+//OF JOB
+//------------------------------------------------------------------------------
+void hash_check_job(hash_job_t *job) {
+    while(true) {
+        size_t chunk = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+        if(chunk >= job->chunks)
+            return ;
+
+        hash_t hash = hash_chunk(job->stack, chunk, job->chunk_elements);
+        if(job->store != NULL) {
+            job->store[chunk] = hash;
+            continue;
+        }
+
+        if(hash == job->stack->chunk_hashes[chunk])
+            continue;
+
+        atomic_store_min(&job->changed_low , chunk    );
+        atomic_store_max(&job->changed_high, chunk + 1);
+    }
+}
+
+//------------------------------------------------------------------------------
+//RUNS JOB ON CALLING THREAD AND WORKERS IF IT HAS ENOUGH CHUNKS AND POOL IS
+//FREE, ALONE OTHERWISE, RESULT IS IN job WHEN IT RETURNS
+//------------------------------------------------------------------------------
+void hash_run_job(hash_job_t *job) {
+    size_t chunks = job->chunks - job->next_chunk;
+    if(chunks >= HASH_PARALLEL_CHUNKS)
+        pthread_once(&pool_once, hash_pool_start);
+
+    if(chunks < HASH_PARALLEL_CHUNKS ||
+       pool.workers == 0            ||
+       pthread_mutex_trylock(&pool.job_lock) != 0) {
+        hash_check_job(job);
+        return ;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.job  = *job;
+    pool.busy = pool.workers;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    hash_check_job(&pool.job);
+
+    pthread_mutex_lock(&pool.lock);
+    while(pool.busy != 0)
+        pthread_cond_wait(&pool.done, &pool.lock);
+    *job = pool.job;
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool.job_lock);
+}
+
+//------------------------------------------------------------------------------
+//STARTS WORKERS ON FIRST CHECK OF LARGE STACK, ONE WORKER LESS THAN CPUS,
+//CALLING THREAD CHECKS CHUNKS TOO
+//------------------------------------------------------------------------------
+void hash_pool_start(void) {
+    pthread_mutex_init(&pool.job_lock, NULL);
+    pthread_mutex_init(&pool.lock,     NULL);
+    pthread_cond_init (&pool.start,    NULL);
+    pthread_cond_init (&pool.done,     NULL);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t workers = cpus > 1 ? (size_t)cpus - 1 : 0;
+    if(workers > HASH_MAX_WORKERS)
+        workers = HASH_MAX_WORKERS;
+
+    pthread_attr_t attributes = {};
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    for(size_t worker = 0; worker < workers; worker++) {
+        //worker may start running after first job is posted, so it gets
+        //generation it has to wait past from here, not from pool
+        pthread_t thread = {};
+        if(pthread_create(&thread, &attributes, hash_worker,
+                          (void *)(uintptr_t)pool.generation) != 0)
+            break;
+        pool.workers++;
+    }
+    pthread_attr_destroy(&attributes);
+}
+
+//------------------------------------------------------------------------------
+//WORKER TAKES PART IN EVERY JOB, IT LIVES UNTIL PROCESS EXITS
+//------------------------------------------------------------------------------
+void *hash_worker(void *argument) {
+    size_t seen = (size_t)(uintptr_t)argument;
+    pthread_mutex_lock(&pool.lock);
+    while(true) {
+        while(pool.generation == seen)
+            pthread_cond_wait(&pool.start, &pool.lock);
+        seen = pool.generation;
+        pthread_mutex_unlock(&pool.lock);
+
+        hash_check_job(&pool.job);
+
+        pthread_mutex_lock(&pool.lock);
+        if(--pool.busy == 0)
+            pthread_cond_signal(&pool.done);
+    }
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+//LOWERS value TO candidate IF IT IS SMALLER
+//------------------------------------------------------------------------------
+void atomic_store_min(size_t *value,
+                      size_t  candidate) {
+    size_t current = __atomic_load_n(value, __ATOMIC_RELAXED);
+    while(candidate < current &&
+          !__atomic_compare_exchange_n(value, &current, candidate, true,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+//------------------------------------------------------------------------------
+//RAISES value TO candidate IF IT IS BIGGER
+//------------------------------------------------------------------------------
+void atomic_store_max(size_t *value,
+                      size_t  candidate) {
+    size_t current = __atomic_load_n(value, __ATOMIC_RELAXED);
+    while(candidate > current &&
+          !__atomic_compare_exchange_n(value, &current, candidate, true,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+#endif
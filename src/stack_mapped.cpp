@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stack.h"
+#include "stack_internal.h"
+#include "custom_assert.h"
+
+//==============================================================================
+//FUNCTIONS PROTOTYPES
+//==============================================================================
+static stack_t *map_stack_file     (int    fd,
+                                    size_t size);
+static void     shrink_file        (int    fd,
+                                    size_t size);
+static stack_t *create_mapped_stack(int    fd,
+                                    STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                        const char *initialized_file,
+                                                        const char *initialized_varname,
+                                                        const char *initialized_function,
+                                                        size_t      initialized_line,
+                                                        int       (*print_func)(FILE *, void *),)
+                                    size_t capacity,
+                                    size_t element_size);
+static stack_t *attach_mapped_stack(int    fd,
+                                    size_t file_size,
+                                    STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                        const char *initialized_file,
+                                                        const char *initialized_varname,
+                                                        const char *initialized_function,
+                                                        size_t      initialized_line,
+                                                        int       (*print_func)(FILE *, void *),)
+                                    size_t element_size);
+
+//==============================================================================
+//GLOBAL FUNCTION
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//OPENS STACK STORED IN FILE, CREATES IT WITH CAPACITY IF FILE IS EMPTY
+//EXISTING STACK KEEPS ITS OWN CAPACITY, ONLY HEADER IS CHECKED ON OPEN,
+//DATA HASH IS CHECKED BY FIRST OPERATION WITH STACK
+//------------------------------------------------------------------------------
+stack_t *stack_open_mapped(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                               const char *initialized_file,
+                                               const char *initialized_varname,
+                                               const char *initialized_function,
+                                               size_t      initialized_line,
+                                               int       (*print_func)(FILE *, void *),)
+                           const char *path,
+                           size_t      capacity,
+                           size_t      element_size) {
+    C_ASSERT(path         != NULL, return NULL);
+    C_ASSERT_ALWAYS(element_size != 0   , return NULL);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if(fd < 0)
+        return NULL;
+
+    struct stat file_info = {};
+    if(fstat(fd, &file_info) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    if(file_info.st_size == 0)
+        return create_mapped_stack(fd,
+                                   STACK_WRITE_DUMP_ON(dump_filename,
+                                                       initialized_file,
+                                                       initialized_varname,
+                                                       initialized_function,
+                                                       initialized_line,
+                                                       print_func,)
+                                   capacity,
+                                   element_size);
+
+    return attach_mapped_stack(fd,
+                               (size_t)file_info.st_size,
+                               STACK_WRITE_DUMP_ON(dump_filename,
+                                                   initialized_file,
+                                                   initialized_varname,
+                                                   initialized_function,
+                                                   initialized_line,
+                                                   print_func,)
+                               element_size);
+}
+
+//==============================================================================
+//FUNCTIONS SHARED BETWEEN STACK MODULES
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//RESIZES FILE AND MAPS IT AGAIN, RETURNS NULL AND KEEPS OLD MAPPING ON ERROR
+//------------------------------------------------------------------------------
+void *stack_mapped_reallocate(stack_t *stack,
+                              size_t   old_size,
+                              size_t   new_size) {
+    int fd = stack->storage_fd;
+
+    if(new_size > old_size && ftruncate(fd, (off_t)new_size) != 0)
+        return NULL;
+
+    void *new_memory = mmap(NULL,
+                            new_size,
+                            PROT_READ | PROT_WRITE,
+                            MAP_SHARED,
+                            fd,
+                            0);
+    if(new_memory == MAP_FAILED) {
+        if(new_size > old_size)
+            shrink_file(fd, old_size);
+        return NULL;
+    }
+
+    munmap(stack, old_size);
+
+    if(new_size < old_size)
+        shrink_file(fd, new_size);
+
+    return new_memory;
+}
+
+//------------------------------------------------------------------------------
+//UNMAPS STACK, CONTENT STAYS IN FILE
+//------------------------------------------------------------------------------
+void stack_mapped_release(stack_t *stack) {
+    int fd = stack->storage_fd;
+    munmap(stack, calculate_allocation_size(stack->capacity,
+                                            stack->element_size,
+                                            stack->alignment));
+    close(fd);
+}
+
+//==============================================================================
+//STATIC FUNCTIONS
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//MAPS FIRST SIZE BYTES OF FILE
+//------------------------------------------------------------------------------
+stack_t *map_stack_file(int    fd,
+                        size_t size) {
+    void *memory = mmap(NULL,
+                        size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED,
+                        fd,
+                        0);
+    if(memory == MAP_FAILED)
+        return NULL;
+
+    return (stack_t *)memory;
+}
+
+//------------------------------------------------------------------------------
+//TRUNCATES FILE, FILE WHICH IS LARGER THAN STACK IS ACCEPTED ON OPEN,
+//SO FAILED TRUNCATION DOES NOT BREAK STACK
+//------------------------------------------------------------------------------
+void shrink_file(int    fd,
+                 size_t size) {
+    if(ftruncate(fd, (off_t)size) != 0)
+        return ;
+}
+
+//------------------------------------------------------------------------------
+//INITIALIZES NEW STACK IN EMPTY FILE
+//------------------------------------------------------------------------------
+stack_t *create_mapped_stack(int    fd,
+                             STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                 const char *initialized_file,
+                                                 const char *initialized_varname,
+                                                 const char *initialized_function,
+                                                 size_t      initialized_line,
+                                                 int       (*print_func)(FILE *, void *),)
+                             size_t capacity,
+                             size_t element_size) {
+    size_t file_size = calculate_allocation_size(capacity,
+                                                 element_size,
+                                                 STACK_DEFAULT_ALIGNMENT);
+    if(ftruncate(fd, (off_t)file_size) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    stack_t *stack = map_stack_file(fd, file_size);
+    if(stack == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    stack->storage    = STACK_STORAGE_MAPPED;
+    stack->storage_fd = fd;
+
+    if(stack_init_header(stack,
+                         STACK_WRITE_DUMP_ON(dump_filename,
+                                             initialized_file,
+                                             initialized_varname,
+                                             initialized_function,
+                                             initialized_line,
+                                             print_func,)
+                         capacity,
+                         element_size,
+                         STACK_DEFAULT_ALIGNMENT,
+                         false) != STACK_SUCCESS) {
+        //empty file is initialized again on next open
+        shrink_file(fd, 0);
+        stack_destroy(&stack);
+        return NULL;
+    }
+    return stack;
+}
+
+//------------------------------------------------------------------------------
+//MAPS STACK WHICH IS ALREADY STORED IN FILE
+//------------------------------------------------------------------------------
+stack_t *attach_mapped_stack(int    fd,
+                             size_t file_size,
+                             STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                 const char *initialized_file,
+                                                 const char *initialized_varname,
+                                                 const char *initialized_function,
+                                                 size_t      initialized_line,
+                                                 int       (*print_func)(FILE *, void *),)
+                             size_t element_size) {
+    stack_t header = {};
+    if(file_size < sizeof(stack_t) ||
+       pread(fd, &header, sizeof(stack_t), 0) != (ssize_t)sizeof(stack_t) ||
+       header.element_size != element_size                                ||
+       header.capacity > (file_size - sizeof(stack_t)) / element_size) {
+        close(fd);
+        return NULL;
+    }
+
+    //alignment is checked before it is used to count size of file
+    if(header.alignment == 0                              ||
+       (header.alignment & (header.alignment - 1)) != 0   ||
+       header.alignment > STACK_MAX_ALIGNMENT) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t mapped_size = calculate_allocation_size(header.capacity,
+                                                   element_size,
+                                                   header.alignment);
+    if(mapped_size > file_size) {
+        close(fd);
+        return NULL;
+    }
+
+    stack_t *stack = map_stack_file(fd, mapped_size);
+    if(stack == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    //pointers in file belong to process which wrote it
+    stack->storage           = STACK_STORAGE_MAPPED;
+    stack->storage_fd        = fd;
+    stack->id                = stack_new_id();
+    stack->registry_slot     = NULL;
+    stack->version           = 0;
+    stack->trimming          = false;
+    stack->trim_version      = 0;
+    stack->idle_since_ns     = 0;
+    stack->trimmed           = false;
+    stack->combine           = NULL;
+    stack->aggregates        = NULL;
+    stack->allocator         = {};
+    stack->data              = (char *)stack + stack_data_offset(stack->alignment);
+    stack->kernel            = stack_select_kernel(stack->element_size, stack->alignment);
+
+    #ifdef STACK_CANARY_PROTECTION
+        stack_locate_canaries(stack);
+    #endif
+
+    //chunk hashes are counted from data in file by first operation, which
+    //checks them with data hash kept in file, so data is not hashed on open
+    #ifdef STACK_HASH_PROTECTION
+        stack->chunk_hashes = NULL;
+        stack->chunk_count  = 0;
+        if(stack_hash_resize(stack, stack->capacity) != STACK_SUCCESS) {
+            stack_mapped_release(stack);
+            return NULL;
+        }
+        stack_hash_invalidate(stack);
+    #endif
+
+    #ifdef STACK_WRITE_DUMP
+        stack->cold = NULL;
+        if(stack_attach_dump(stack,
+                             dump_filename,
+                             initialized_file,
+                             initialized_varname,
+                             initialized_function,
+                             initialized_line,
+                             print_func) != STACK_SUCCESS) {
+            stack_destroy(&stack);
+            return NULL;
+        }
+    #endif
+
+    if(stack_verify_structure(stack) != STACK_SUCCESS ||
+       stack_registry_add(stack)     != STACK_SUCCESS) {
+        stack_destroy(&stack);
+        return NULL;
+    }
+    return stack;
+}
@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "stack.h"
+#include "stack_internal.h"
+#include "stack_registry.h"
+#include "memory.h"
+
+//==============================================================================
+//DUMP FILE SHARED BY ALL STACKS WITH SAME DUMP FILENAME
+//==============================================================================
+static const size_t DUMP_SINK_BUFFER_SIZE = 1 << 16;
+
+struct stack_dump_sink_t {
+    char *             filename;
+    FILE *             file;
+    bool               truncated; //file was opened once, later opens append
+    size_t             references;
+    pthread_mutex_t    lock;
+    stack_dump_sink_t *next;
+};
+
+//==============================================================================
+//PLACE OF ONE STACK IN REGISTRY, IT IS ALLOCATED SEPARATELY, SO IT IS NOT MOVED
+//WITH STACK, lock IS HELD WHILE STACK IS VISITED OR MOVED BY ITS OWNER
+//SLOTS ARE NEVER FREED, SLOT OF DESTROYED STACK IS USED BY NEXT ADDED STACK
+//==============================================================================
+struct stack_registry_slot_t {
+    stack_t *              stack;     //NULL if slot is free
+    size_t                 position;  //index in registry_slots
+    pthread_mutex_t        lock;
+    stack_registry_slot_t *next_free;
+};
+
+//==============================================================================
+//REGISTRY STATE, EVERYTHING IS GUARDED BY registry_lock
+//registry_slots, registry_size, SLOTS AND THEIR STACKS ARE ALSO STORED
+//ATOMICALLY FOR CRASH HANDLER, WHICH READS THEM WITHOUT LOCK (stack_registry_peek)
+//STACK IN SLOT IS CHANGED ONLY UNDER LOCK OF SLOT, SO STACKS ARE MOVED WITHOUT
+//registry_lock AND WITHOUT WAITING FOR VISITORS OF OTHER STACKS
+//==============================================================================
+static pthread_mutex_t         registry_lock       = PTHREAD_MUTEX_INITIALIZER;
+static stack_registry_slot_t **registry_slots      = NULL;
+static size_t                  registry_size       = 0;
+static size_t                  registry_capacity   = 0;
+static stack_registry_slot_t * registry_free_slots = NULL;
+static stack_dump_sink_t *     dump_sinks          = NULL;
+
+//==============================================================================
+//FUNCTIONS PROTOTYPES
+//==============================================================================
+static stack_error_t visit_slot(stack_registry_slot_t *slot,
+                                stack_visitor_t        visitor,
+                                void *                 context);
+
+//==============================================================================
+//GLOBAL FUNCTION
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//RETURNS NUMBER OF LIVE STACKS
+//------------------------------------------------------------------------------
+size_t stack_registry_count(void) {
+    pthread_mutex_lock(&registry_lock);
+    size_t count = registry_size;
+    pthread_mutex_unlock(&registry_lock);
+    return count;
+}
+
+//------------------------------------------------------------------------------
+//CALLS VISITOR FOR EVERY LIVE STACK, STOPS ON FIRST ERROR
+//------------------------------------------------------------------------------
+stack_error_t stack_registry_for_each(stack_visitor_t visitor, void *context) {
+    if(visitor == NULL)
+        return STACK_INVALID_INPUT;
+
+    stack_error_t visit_state = STACK_SUCCESS;
+
+    pthread_mutex_lock(&registry_lock);
+    for(size_t index = 0; index < registry_size; index++) {
+        visit_state = visit_slot(registry_slots[index], visitor, context);
+        if(visit_state != STACK_SUCCESS)
+            break;
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    return visit_state;
+}
+
+//------------------------------------------------------------------------------
+//WRITES BUFFERED DUMPS OF ALL STACKS TO FILES
+//------------------------------------------------------------------------------
+stack_error_t stack_registry_flush(void) {
+    stack_error_t flush_state = STACK_SUCCESS;
+
+    pthread_mutex_lock(&registry_lock);
+    for(stack_dump_sink_t *sink = dump_sinks; sink != NULL; sink = sink->next) {
+        pthread_mutex_lock(&sink->lock);
+        if(sink->file != NULL && fflush(sink->file) != 0)
+            flush_state = STACK_DUMP_ERROR;
+        pthread_mutex_unlock(&sink->lock);
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    return flush_state;
+}
+
+//==============================================================================
+//FUNCTIONS SHARED BETWEEN STACK MODULES
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//ADDS STACK TO REGISTRY
+//------------------------------------------------------------------------------
+stack_error_t stack_registry_add(stack_t *stack) {
+    pthread_mutex_lock(&registry_lock);
+
+    if(registry_size == registry_capacity) {
+        size_t new_capacity = registry_capacity == 0 ? 16 : registry_capacity * 2;
+        stack_registry_slot_t **new_slots = (stack_registry_slot_t **)
+                                            _calloc(new_capacity,
+                                                    sizeof(stack_registry_slot_t *));
+        if(new_slots == NULL) {
+            pthread_mutex_unlock(&registry_lock);
+            return STACK_MEMORY_ERROR;
+        }
+        if(registry_size != 0)
+            memcpy(new_slots, registry_slots,
+                   registry_size * sizeof(stack_registry_slot_t *));
+
+        //old array is never freed, crash handler may still read it, arrays
+        //double, so all of them take less memory than the last one
+        __atomic_store_n(&registry_slots, new_slots, __ATOMIC_RELEASE);
+        registry_capacity = new_capacity;
+    }
+
+    stack_registry_slot_t *slot = registry_free_slots;
+    if(slot != NULL)
+        registry_free_slots = slot->next_free;
+    else {
+        slot = (stack_registry_slot_t *)_calloc(1, sizeof(stack_registry_slot_t));
+        if(slot == NULL) {
+            pthread_mutex_unlock(&registry_lock);
+            return STACK_MEMORY_ERROR;
+        }
+        pthread_mutex_init(&slot->lock, NULL);
+    }
+
+    __atomic_store_n(&slot->stack, stack, __ATOMIC_RELAXED);
+    slot->position         = registry_size;
+    stack->registry_slot   = slot;
+    __atomic_store_n(&registry_slots[registry_size], slot, __ATOMIC_RELEASE);
+    //array with this slot is published before size which covers it
+    __atomic_store_n(&registry_size, registry_size + 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&registry_lock);
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//REMOVES STACK FROM REGISTRY, RETURNS NUMBER OF STACKS LEFT
+//WAITS FOR VISITOR OF STACK, SO STACK IS NOT VISITED AFTER RETURN
+//------------------------------------------------------------------------------
+size_t stack_registry_remove(stack_t *stack) {
+    pthread_mutex_lock(&registry_lock);
+
+    stack_registry_slot_t *slot = stack->registry_slot;
+    if(slot != NULL) {
+        pthread_mutex_lock(&slot->lock);
+        __atomic_store_n(&slot->stack, NULL, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&slot->lock);
+
+        //last slot takes place of removed one
+        stack_registry_slot_t *last = registry_slots[registry_size - 1];
+        __atomic_store_n(&registry_slots[slot->position], last, __ATOMIC_RELAXED);
+        last->position = slot->position;
+
+        __atomic_store_n(&registry_size, registry_size - 1, __ATOMIC_RELEASE);
+        slot->next_free      = registry_free_slots;
+        registry_free_slots  = slot;
+        stack->registry_slot = NULL;
+    }
+    size_t stacks_left = registry_size;
+
+    pthread_mutex_unlock(&registry_lock);
+    return stacks_left;
+}
+
+//------------------------------------------------------------------------------
+//LOCKS REGISTRY, NO STACK IS ADDED OR REMOVED UNTIL UNLOCK
+//------------------------------------------------------------------------------
+void stack_registry_lock(void) {
+    pthread_mutex_lock(&registry_lock);
+}
+
+//------------------------------------------------------------------------------
+//UNLOCKS REGISTRY
+//------------------------------------------------------------------------------
+void stack_registry_unlock(void) {
+    pthread_mutex_unlock(&registry_lock);
+}
+
+//------------------------------------------------------------------------------
+//LOCKS SLOT OF STACK, STACK IS NOT VISITED UNTIL UNLOCK, SO IT MAY BE MOVED
+//STACK WHICH IS NOT REGISTERED IS NOT LOCKED
+//------------------------------------------------------------------------------
+void stack_registry_lock_stack(const stack_t *stack) {
+    if(stack->registry_slot != NULL)
+        pthread_mutex_lock(&stack->registry_slot->lock);
+}
+
+//------------------------------------------------------------------------------
+//UNLOCKS SLOT OF STACK
+//------------------------------------------------------------------------------
+void stack_registry_unlock_stack(const stack_t *stack) {
+    if(stack->registry_slot != NULL)
+        pthread_mutex_unlock(&stack->registry_slot->lock);
+}
+
+//------------------------------------------------------------------------------
+//UPDATES ADDRESS OF STACK AFTER IT WAS REALLOCATED, SLOT IS LOCKED BY CALLER
+//------------------------------------------------------------------------------
+void stack_registry_update(stack_t *stack) {
+    if(stack->registry_slot == NULL)
+        return ;
+
+    __atomic_store_n(&stack->registry_slot->stack, stack, __ATOMIC_RELAXED);
+}
+
+//------------------------------------------------------------------------------
+//CALLS VISITOR FOR EVERY LIVE STACK, REGISTRY IS LOCKED BY CALLER
+//------------------------------------------------------------------------------
+void stack_registry_for_each_locked(stack_visitor_t visitor,
+                                    void *          context) {
+    for(size_t index = 0; index < registry_size; index++)
+        visit_slot(registry_slots[index], visitor, context);
+}
+
+//------------------------------------------------------------------------------
+//GIVES REGISTRY SLOTS WITHOUT LOCK, FOR CRASH HANDLER WHICH CAN NOT WAIT
+//FOR IT, OTHER THREADS MAY CHANGE REGISTRY AT ONCE, SO STACKS ARE READ WITH
+//stack_registry_slot_stack AND MAY BE NULL OR BEING DESTROYED OR MOVED
+//------------------------------------------------------------------------------
+size_t stack_registry_peek(stack_registry_slot_t *const **slots) {
+    //size is loaded first, array published before it has at least size slots,
+    //arrays and slots are never freed, so any array loaded after it is valid
+    size_t size = __atomic_load_n(&registry_size, __ATOMIC_ACQUIRE);
+    *slots = __atomic_load_n(&registry_slots, __ATOMIC_ACQUIRE);
+    return size;
+}
+
+//------------------------------------------------------------------------------
+//RETURNS STACK OF SLOT GIVEN BY stack_registry_peek, NULL IF SLOT IS FREE
+//------------------------------------------------------------------------------
+stack_t *stack_registry_slot_stack(stack_registry_slot_t *const *slots,
+                                   size_t                        index) {
+    stack_registry_slot_t *slot = __atomic_load_n(slots + index, __ATOMIC_ACQUIRE);
+    if(slot == NULL)
+        return NULL;
+    return __atomic_load_n(&slot->stack, __ATOMIC_RELAXED);
+}
+
+//------------------------------------------------------------------------------
+//CALLS VISITOR FOR ONE STACK, POSITION WRAPS AROUND NUMBER OF STACKS
+//RETURNS STACK_EMPTY IF THERE ARE NO STACKS
+//REGISTRY IS UNLOCKED WHILE VISITOR RUNS, ONLY VISITED STACK IS LOCKED
+//------------------------------------------------------------------------------
+stack_error_t stack_registry_visit(size_t          position,
+                                   stack_visitor_t visitor,
+                                   void *          context) {
+    pthread_mutex_lock(&registry_lock);
+    if(registry_size == 0) {
+        pthread_mutex_unlock(&registry_lock);
+        return STACK_EMPTY;
+    }
+
+    //slot is locked before registry is unlocked, so stack_registry_remove
+    //waits for visitor before stack is freed
+    stack_registry_slot_t *slot = registry_slots[position % registry_size];
+    pthread_mutex_lock(&slot->lock);
+    pthread_mutex_unlock(&registry_lock);
+
+    stack_error_t visit_state = visitor(slot->stack, context);
+    pthread_mutex_unlock(&slot->lock);
+    return visit_state;
+}
+
+#ifdef STACK_WRITE_DUMP
+    //------------------------------------------------------------------------------
+    //RETURNS SINK FOR FILENAME, CREATES IT ON FIRST USE OF THIS FILE
+    //------------------------------------------------------------------------------
+    stack_dump_sink_t *stack_dump_sink_acquire(const char *filename) {
+        if(filename == NULL)
+            return NULL;
+
+        pthread_mutex_lock(&registry_lock);
+
+        stack_dump_sink_t *sink = dump_sinks;
+        while(sink != NULL && strcmp(sink->filename, filename) != 0)
+            sink = sink->next;
+
+        if(sink == NULL) {
+            sink = (stack_dump_sink_t *)_calloc(1, sizeof(stack_dump_sink_t));
+            char *filename_copy = (char *)_calloc(strlen(filename) + 1, 1);
+            if(sink == NULL || filename_copy == NULL) {
+                _free(sink);
+                _free(filename_copy);
+                pthread_mutex_unlock(&registry_lock);
+                return NULL;
+            }
+            strcpy(filename_copy, filename);
+
+            sink->filename = filename_copy;
+            pthread_mutex_init(&sink->lock, NULL);
+            sink->next = dump_sinks;
+            dump_sinks = sink;
+        }
+        sink->references++;
+
+        pthread_mutex_unlock(&registry_lock);
+        return sink;
+    }
+
+    //------------------------------------------------------------------------------
+    //CLOSES SINK FILE WHEN LAST STACK WHICH WRITES TO IT IS DESTROYED
+    //SINK ITSELF IS KEPT, SO NEXT STACK WITH SAME FILENAME APPENDS TO DUMPS OF
+    //EARLIER STACKS INSTEAD OF TRUNCATING FILE
+    //------------------------------------------------------------------------------
+    void stack_dump_sink_release(stack_dump_sink_t *sink) {
+        pthread_mutex_lock(&registry_lock);
+
+        if(--sink->references == 0) {
+            pthread_mutex_lock(&sink->lock);
+            if(sink->file != NULL)
+                fclose(sink->file);
+            sink->file = NULL;
+            pthread_mutex_unlock(&sink->lock);
+        }
+
+        pthread_mutex_unlock(&registry_lock);
+    }
+
+    //------------------------------------------------------------------------------
+    //LOCKS SINK AND RETURNS ITS FILE, OPENS FILE ON FIRST DUMP
+    //FILE IS TRUNCATED ONLY BY FIRST OPEN IN PROCESS
+    //RETURNS NULL AND LEAVES SINK UNLOCKED IF FILE CAN NOT BE OPENED
+    //------------------------------------------------------------------------------
+    FILE *stack_dump_sink_lock(stack_dump_sink_t *sink) {
+        pthread_mutex_lock(&sink->lock);
+
+        if(sink->file == NULL) {
+            sink->file = fopen(sink->filename, sink->truncated ? "ab" : "wb");
+            if(sink->file == NULL) {
+                pthread_mutex_unlock(&sink->lock);
+                return NULL;
+            }
+            sink->truncated = true;
+            setvbuf(sink->file, NULL, _IOFBF, DUMP_SINK_BUFFER_SIZE);
+        }
+        return sink->file;
+    }
+
+    //------------------------------------------------------------------------------
+    //UNLOCKS SINK, WRITES BUFFER TO FILE IF flush IS SET
+    //------------------------------------------------------------------------------
+    void stack_dump_sink_unlock(stack_dump_sink_t *sink,
+                                bool               flush) {
+        if(flush)
+            fflush(sink->file);
+        pthread_mutex_unlock(&sink->lock);
+    }
+#endif
+
+//==============================================================================
+//STATIC FUNCTIONS
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//CALLS VISITOR FOR STACK OF SLOT UNDER LOCK OF SLOT, SO STACK IS NOT MOVED
+//------------------------------------------------------------------------------
+stack_error_t visit_slot(stack_registry_slot_t *slot,
+                         stack_visitor_t        visitor,
+                         void *                 context) {
+    pthread_mutex_lock(&slot->lock);
+    stack_error_t visit_state = visitor(slot->stack, context);
+    pthread_mutex_unlock(&slot->lock);
+    return visit_state;
+}
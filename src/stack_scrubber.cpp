@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "stack.h"
+#include "stack_internal.h"
+#include "stack_scrubber.h"
+#include "custom_assert.h"
+
+//==============================================================================
+//HOW MANY TIMES SCRUBBER RETRIES STACK WHICH IS CHANGED WHILE IT IS VERIFIED
+//==============================================================================
+static const size_t SCRUB_ATTEMPTS = 4;
+
+//==============================================================================
+//SCRUBBER STATE, STOP IS SIGNALED WITH scrubber_wakeup
+//==============================================================================
+struct stack_scrubber_t {
+    pthread_t                  thread;
+    pthread_mutex_t            lock;
+    pthread_cond_t             wakeup;
+    bool                       running;
+    long                       interval_ns;
+    stack_corruption_handler_t handler;
+    void *                     context;
+};
+
+static stack_scrubber_t scrubber = {};
+
+//==============================================================================
+//FUNCTIONS PROTOTYPES
+//==============================================================================
+static void *        scrubber_thread(void *   argument);
+static stack_error_t scrub_stack    (stack_t *stack,
+                                     void *   context);
+static void          scrubber_sleep (void);
+
+//==============================================================================
+//GLOBAL FUNCTION
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//STARTS SCRUBBER THREAD WHICH VERIFIES stacks_per_second STACKS EVERY SECOND
+//------------------------------------------------------------------------------
+stack_error_t stack_scrubber_start(size_t                     stacks_per_second,
+                                   stack_corruption_handler_t handler,
+                                   void *                     context) {
+    C_ASSERT_ALWAYS(stacks_per_second != 0, return STACK_INVALID_INPUT);
+
+    if(__atomic_load_n(&scrubber.running, __ATOMIC_ACQUIRE))
+        return STACK_UNEXPECTED_ERROR;
+
+    pthread_condattr_t attributes = {};
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&scrubber.wakeup, &attributes);
+    pthread_condattr_destroy(&attributes);
+    pthread_mutex_init(&scrubber.lock, NULL);
+
+    scrubber.interval_ns = (long)(1000000000 / stacks_per_second);
+    scrubber.handler     = handler;
+    scrubber.context     = context;
+    __atomic_store_n(&scrubber.running, true, __ATOMIC_RELEASE);
+
+    if(pthread_create(&scrubber.thread, NULL, scrubber_thread, NULL) != 0) {
+        __atomic_store_n(&scrubber.running, false, __ATOMIC_RELEASE);
+        pthread_cond_destroy(&scrubber.wakeup);
+        pthread_mutex_destroy(&scrubber.lock);
+        return STACK_UNEXPECTED_ERROR;
+    }
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//STOPS SCRUBBER THREAD, OPERATIONS CHECK DATA HASHES THEMSELVES AGAIN
+//------------------------------------------------------------------------------
+stack_error_t stack_scrubber_stop(void) {
+    if(!__atomic_load_n(&scrubber.running, __ATOMIC_ACQUIRE))
+        return STACK_UNEXPECTED_ERROR;
+
+    pthread_mutex_lock(&scrubber.lock);
+    __atomic_store_n(&scrubber.running, false, __ATOMIC_RELEASE);
+    pthread_cond_signal(&scrubber.wakeup);
+    pthread_mutex_unlock(&scrubber.lock);
+
+    pthread_join(scrubber.thread, NULL);
+    pthread_cond_destroy(&scrubber.wakeup);
+    pthread_mutex_destroy(&scrubber.lock);
+    return STACK_SUCCESS;
+}
+
+//==============================================================================
+//FUNCTIONS SHARED BETWEEN STACK MODULES
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//RETURNS TRUE IF DATA HASHES ARE CHECKED BY SCRUBBER
+//------------------------------------------------------------------------------
+bool stack_scrubber_active(void) {
+    return __atomic_load_n(&scrubber.running, __ATOMIC_RELAXED);
+}
+
+//==============================================================================
+//STATIC FUNCTIONS
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//VISITS REGISTERED STACKS ONE BY ONE UNTIL SCRUBBER IS STOPPED
+//------------------------------------------------------------------------------
+void *scrubber_thread(void *) {
+    size_t position = 0;
+    while(__atomic_load_n(&scrubber.running, __ATOMIC_ACQUIRE)) {
+        stack_registry_visit(position++, scrub_stack, NULL);
+        scrubber_sleep();
+    }
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+//VERIFIES STACK WITHOUT BLOCKING ITS OWNER, RESULT IS TRUSTED ONLY IF VERSION
+//WAS EVEN AND DID NOT CHANGE WHILE STACK WAS VERIFIED
+//------------------------------------------------------------------------------
+stack_error_t scrub_stack(stack_t *stack,
+                          void *) {
+    for(size_t attempt = 0; attempt < SCRUB_ATTEMPTS; attempt++) {
+        size_t version = __atomic_load_n(&stack->version, __ATOMIC_ACQUIRE);
+        if(version % 2 != 0) {
+            sched_yield();
+            continue;
+        }
+
+        //range of corrupted elements is reported by scrubber and is not
+        //stored in stack, which is changed only by its owner
+        size_t corrupted_low  = 0,
+               corrupted_high = 0;
+        stack_error_t verify_state = stack_verify_full(stack,
+                                                       &corrupted_low,
+                                                       &corrupted_high);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&stack->version, __ATOMIC_RELAXED) != version)
+            continue;
+
+        if(verify_state != STACK_SUCCESS) {
+            if(scrubber.handler != NULL)
+                scrubber.handler(stack,
+                                 verify_state,
+                                 corrupted_low,
+                                 corrupted_high,
+                                 scrubber.context);
+
+            #ifdef STACK_WRITE_DUMP
+                stack_dump_corrupted(stack,
+                                     __FILE_NAME__,
+                                     __PRETTY_FUNCTION__,
+                                     __LINE__,
+                                     verify_state,
+                                     corrupted_low,
+                                     corrupted_high,
+                                     true);
+            #endif
+        }
+        return STACK_SUCCESS;
+    }
+
+    //stack is too busy now, it is verified on next pass
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//WAITS ONE INTERVAL OR UNTIL SCRUBBER IS STOPPED
+//------------------------------------------------------------------------------
+void scrubber_sleep(void) {
+    struct timespec deadline = {};
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec  += scrubber.interval_ns / 1000000000;
+    deadline.tv_nsec += scrubber.interval_ns % 1000000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&scrubber.lock);
+    while(__atomic_load_n(&scrubber.running, __ATOMIC_ACQUIRE) &&
+          pthread_cond_timedwait(&scrubber.wakeup, &scrubber.lock, &deadline) == 0);
+    pthread_mutex_unlock(&scrubber.lock);
+}
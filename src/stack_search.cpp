@@ -0,0 +1,331 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define STACK_SEARCH_SIMD
+#endif
+
+#include "stack.h"
+#include "stack_internal.h"
+#include "custom_assert.h"
+
+//==============================================================================
+//SEARCH OF ELEMENTS, ELEMENTS OF 1, 2, 4, 8 AND 16 BYTES ARE COMPARED BY
+//WHOLE VECTORS: BYTES OF CHUNK ARE COMPARED WITH REPEATED ELEMENT AND ELEMENT
+//MATCHES IF ALL ITS BYTES ARE EQUAL, OTHER SIZES ARE COMPARED ONE BY ONE
+//==============================================================================
+enum search_mode_t {
+    SEARCH_FIRST,
+    SEARCH_LAST ,
+    SEARCH_COUNT,
+};
+
+static const size_t SEARCH_NOT_FOUND   = SIZE_MAX;
+static const size_t SEARCH_MAX_CHUNK   = 32;
+
+//returns mask with bit for every equal byte of chunk and pattern
+typedef uint32_t (*chunk_mask_t)(const char *chunk, const char *pattern);
+
+typedef size_t (*search_kernel_t)(const char *  data,
+                                  size_t        count,
+                                  size_t        element_size,
+                                  const char *  pattern,
+                                  search_mode_t mode);
+
+//==============================================================================
+//FUNCTIONS PROTOTYPES
+//==============================================================================
+static stack_error_t   search_stack   (stack_t **    stack,
+                                       const void *  element,
+                                       search_mode_t mode,
+                                       size_t *      result);
+static search_kernel_t select_kernel  (void);
+static size_t          search_scalar  (const char *  data,
+                                       size_t        count,
+                                       size_t        element_size,
+                                       const char *  pattern,
+                                       search_mode_t mode);
+static bool            is_vector_size (size_t element_size);
+static uint32_t        element_starts (uint32_t mask,
+                                       size_t   element_size);
+
+#ifdef STACK_SEARCH_SIMD
+    static size_t search_sse2(const char *  data,
+                              size_t        count,
+                              size_t        element_size,
+                              const char *  pattern,
+                              search_mode_t mode);
+    static size_t search_avx2(const char *  data,
+                              size_t        count,
+                              size_t        element_size,
+                              const char *  pattern,
+                              search_mode_t mode);
+#endif
+
+//==============================================================================
+//GLOBAL FUNCTION
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//GIVES READ-ONLY ACCESS TO ELEMENTS WITHOUT COPYING THEM
+//------------------------------------------------------------------------------
+stack_error_t stack_view(stack_t **stack, stack_span_t *span) {
+    C_ASSERT(stack != NULL, return STACK_NULL          );
+    C_ASSERT(span  != NULL, return STACK_INVALID_OUTPUT);
+
+    stack_error_t verify_state = stack_verify(*stack);
+    if(verify_state != STACK_SUCCESS)
+        return verify_state;
+
+    span->data         = (*stack)->data;
+    span->size         = (*stack)->size;
+    span->element_size = (*stack)->element_size;
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//RETURNS ELEMENT OF SPAN, NULL IF INDEX IS OUT OF SPAN
+//------------------------------------------------------------------------------
+const void *stack_span_at(const stack_span_t *span, size_t index) {
+    C_ASSERT(span != NULL, return NULL);
+
+    if(index >= span->size)
+        return NULL;
+
+    return span->data + index * span->element_size;
+}
+
+//------------------------------------------------------------------------------
+//FINDS INDEX OF FIRST OR LAST ELEMENT WITH SAME BYTES
+//RETURNS STACK_NOT_FOUND IF THERE IS NO SUCH ELEMENT
+//------------------------------------------------------------------------------
+stack_error_t stack_find(stack_t **   stack,
+                         const void * element,
+                         stack_find_t direction,
+                         size_t *     index) {
+    C_ASSERT(index != NULL, return STACK_INVALID_OUTPUT);
+
+    stack_error_t search_state = search_stack(stack,
+                                              element,
+                                              direction == STACK_FIND_FIRST ? SEARCH_FIRST :
+                                                                              SEARCH_LAST,
+                                              index);
+    if(search_state != STACK_SUCCESS)
+        return search_state;
+
+    if(*index == SEARCH_NOT_FOUND)
+        return STACK_NOT_FOUND;
+
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//COUNTS ELEMENTS WITH SAME BYTES
+//------------------------------------------------------------------------------
+stack_error_t stack_count(stack_t **   stack,
+                          const void * element,
+                          size_t *     count) {
+    C_ASSERT(count != NULL, return STACK_INVALID_OUTPUT);
+
+    return search_stack(stack, element, SEARCH_COUNT, count);
+}
+
+//==============================================================================
+//STATIC FUNCTIONS
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//VERIFIES STACK AND RUNS BEST SEARCH KERNEL FOR THIS CPU
+//------------------------------------------------------------------------------
+stack_error_t search_stack(stack_t **    stack,
+                           const void *  element,
+                           search_mode_t mode,
+                           size_t *      result) {
+    C_ASSERT(stack   != NULL, return STACK_NULL         );
+    C_ASSERT(element != NULL, return STACK_INVALID_INPUT);
+
+    stack_error_t verify_state = stack_verify(*stack);
+    if(verify_state != STACK_SUCCESS)
+        return verify_state;
+
+    if((*stack)->variable_size)
+        return STACK_INVALID_INPUT;
+
+    search_kernel_t kernel = search_scalar;
+    if(is_vector_size((*stack)->element_size))
+        kernel = select_kernel();
+
+    *result = kernel((*stack)->data,
+                     (*stack)->size,
+                     (*stack)->element_size,
+                     (const char *)element,
+                     mode);
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//CHOOSES KERNEL ONCE, BY INSTRUCTIONS WHICH CPU SUPPORTS
+//------------------------------------------------------------------------------
+search_kernel_t select_kernel(void) {
+    #ifdef STACK_SEARCH_SIMD
+        static search_kernel_t kernel = NULL;
+
+        search_kernel_t selected = __atomic_load_n(&kernel, __ATOMIC_RELAXED);
+        if(selected == NULL) {
+            selected = __builtin_cpu_supports("avx2") ? search_avx2 : search_sse2;
+            __atomic_store_n(&kernel, selected, __ATOMIC_RELAXED);
+        }
+        return selected;
+    #else
+        return search_scalar;
+    #endif
+}
+
+//------------------------------------------------------------------------------
+//TRUE IF ELEMENTS DO NOT CROSS BOUNDS OF VECTOR CHUNKS
+//------------------------------------------------------------------------------
+bool is_vector_size(size_t element_size) {
+    return element_size == 1 || element_size == 2 || element_size == 4 ||
+           element_size == 8 || element_size == 16;
+}
+
+//------------------------------------------------------------------------------
+//LEAVES BIT ON FIRST BYTE OF EVERY ELEMENT WHOSE BYTES ALL MATCH
+//------------------------------------------------------------------------------
+uint32_t element_starts(uint32_t mask,
+                        size_t   element_size) {
+    for(size_t shift = 1; shift < element_size; shift <<= 1)
+        mask &= mask >> shift;
+
+    switch(element_size) {
+        case 2:
+            return mask & 0x55555555;
+        case 4:
+            return mask & 0x11111111;
+        case 8:
+            return mask & 0x01010101;
+        case 16:
+            return mask & 0x00010001;
+        default:
+            return mask;
+    }
+}
+
+//------------------------------------------------------------------------------
+//SEARCH LOOP, CHUNKS OF chunk_size BYTES ARE COMPARED BY chunk_mask,
+//ELEMENTS AFTER LAST WHOLE CHUNK ARE COMPARED ONE BY ONE
+//------------------------------------------------------------------------------
+__attribute__((always_inline))
+static inline size_t search_chunks(const char *  data,
+                                   size_t        count,
+                                   size_t        element_size,
+                                   const char *  pattern,
+                                   search_mode_t mode,
+                                   size_t        chunk_size,
+                                   chunk_mask_t  chunk_mask) {
+    char repeated[SEARCH_MAX_CHUNK] = {};
+    for(size_t offset = 0; offset < chunk_size; offset += element_size)
+        memcpy(repeated + offset, pattern, element_size);
+
+    size_t chunk_elements = chunk_size / element_size;
+    size_t chunks         = count / chunk_elements;
+    size_t tail           = chunks * chunk_elements;
+
+    if(mode == SEARCH_LAST) {
+        for(size_t element = count; element-- > tail;)
+            if(memcmp(data + element * element_size, pattern, element_size) == 0)
+                return element;
+
+        for(size_t chunk = chunks; chunk-- > 0;) {
+            uint32_t mask = element_starts(chunk_mask(data + chunk * chunk_size, repeated),
+                                           element_size);
+            if(mask != 0)
+                return chunk * chunk_elements +
+                       (size_t)(31 - __builtin_clz(mask)) / element_size;
+        }
+        return SEARCH_NOT_FOUND;
+    }
+
+    size_t matches = 0;
+    for(size_t chunk = 0; chunk < chunks; chunk++) {
+        uint32_t mask = element_starts(chunk_mask(data + chunk * chunk_size, repeated),
+                                       element_size);
+        if(mode == SEARCH_FIRST && mask != 0)
+            return chunk * chunk_elements + (size_t)__builtin_ctz(mask) / element_size;
+        matches += (size_t)__builtin_popcount(mask);
+    }
+
+    for(size_t element = tail; element < count; element++) {
+        if(memcmp(data + element * element_size, pattern, element_size) != 0)
+            continue;
+        if(mode == SEARCH_FIRST)
+            return element;
+        matches++;
+    }
+
+    return mode == SEARCH_FIRST ? SEARCH_NOT_FOUND : matches;
+}
+
+//------------------------------------------------------------------------------
+//COMPARES ELEMENTS ONE BY ONE
+//------------------------------------------------------------------------------
+size_t search_scalar(const char *  data,
+                     size_t        count,
+                     size_t        element_size,
+                     const char *  pattern,
+                     search_mode_t mode) {
+    size_t matches = 0;
+    for(size_t step = 0; step < count; step++) {
+        size_t element = mode == SEARCH_LAST ? count - 1 - step : step;
+        if(memcmp(data + element * element_size, pattern, element_size) != 0)
+            continue;
+        if(mode != SEARCH_COUNT)
+            return element;
+        matches++;
+    }
+    return mode == SEARCH_COUNT ? matches : SEARCH_NOT_FOUND;
+}
+
+#ifdef STACK_SEARCH_SIMD
+    //------------------------------------------------------------------------------
+    //16 BYTES ARE COMPARED AT ONCE, SSE2 IS ALWAYS PRESENT ON x86-64
+    //------------------------------------------------------------------------------
+    __attribute__((always_inline, target("sse2")))
+    static inline uint32_t chunk_mask_sse2(const char *chunk, const char *pattern) {
+        __m128i bytes    = _mm_loadu_si128((const __m128i *)chunk);
+        __m128i repeated = _mm_loadu_si128((const __m128i *)pattern);
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, repeated));
+    }
+
+    __attribute__((target("sse2")))
+    size_t search_sse2(const char *  data,
+                       size_t        count,
+                       size_t        element_size,
+                       const char *  pattern,
+                       search_mode_t mode) {
+        return search_chunks(data, count, element_size, pattern, mode,
+                             16, chunk_mask_sse2);
+    }
+
+    //------------------------------------------------------------------------------
+    //32 BYTES ARE COMPARED AT ONCE
+    //------------------------------------------------------------------------------
+    __attribute__((always_inline, target("avx2")))
+    static inline uint32_t chunk_mask_avx2(const char *chunk, const char *pattern) {
+        __m256i bytes    = _mm256_loadu_si256((const __m256i *)chunk);
+        __m256i repeated = _mm256_loadu_si256((const __m256i *)pattern);
+        return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, repeated));
+    }
+
+    __attribute__((target("avx2")))
+    size_t search_avx2(const char *  data,
+                       size_t        count,
+                       size_t        element_size,
+                       const char *  pattern,
+                       search_mode_t mode) {
+        return search_chunks(data, count, element_size, pattern, mode,
+                             32, chunk_mask_avx2);
+    }
+#endif
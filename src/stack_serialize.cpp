@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+#include "stack.h"
+#include "stack_internal.h"
+#include "custom_assert.h"
+
+//==============================================================================
+//FORMAT OF SAVED STACK
+//HEADER, THEN BLOCKS OF PAYLOAD, EACH BLOCK STARTS WITH ITS LENGTH AND CHECKSUM
+//==============================================================================
+static const uint64_t STACK_SAVE_MAGIC      = 0x31564153'4B415453; //"STAKSAV1"
+static const size_t   STACK_SAVE_BLOCK_SIZE = 1 << 20;
+
+struct stack_save_header_t {
+    uint64_t magic;
+    uint64_t element_size;
+    uint64_t size;
+    uint64_t init_capacity;
+    uint64_t block_size;
+    uint64_t checksum;
+};
+
+struct stack_save_block_t {
+    uint64_t length;
+    uint64_t checksum;
+};
+
+//==============================================================================
+//FUNCTIONS PROTOTYPES
+//==============================================================================
+static stack_error_t write_vectors    (int           fd,
+                                       struct iovec *vectors,
+                                       int           count);
+static stack_error_t read_bytes       (int    fd,
+                                       void * output,
+                                       size_t length);
+static hash_t        header_checksum  (const stack_save_header_t *header);
+static bool          header_fits_file (int                        fd,
+                                       const stack_save_header_t *header,
+                                       size_t                     element_size);
+static stack_error_t read_stack_blocks(stack_t *                  stack,
+                                       int                        fd,
+                                       const stack_save_header_t *header);
+
+//==============================================================================
+//GLOBAL FUNCTION
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//WRITES STACK ELEMENTS TO FILE DESCRIPTOR IN BLOCKS WITH CHECKSUMS
+//------------------------------------------------------------------------------
+stack_error_t stack_save(stack_t **stack, int fd) {
+    C_ASSERT(stack != NULL, return STACK_NULL);
+
+    #ifdef STACK_HASH_PROTECTION
+        stack_error_t pending_state = stack_verify_pending_hash(*stack);
+        if(pending_state != STACK_SUCCESS)
+            return pending_state;
+    #endif
+
+    size_t corrupted_low  = 0,
+           corrupted_high = 0;
+    stack_error_t verify_state = stack_verify_full(*stack,
+                                                   &corrupted_low,
+                                                   &corrupted_high);
+    if(verify_state != STACK_SUCCESS)
+        return verify_state;
+
+    stack_save_header_t header = {};
+    header.magic         = STACK_SAVE_MAGIC;
+    header.element_size  = (*stack)->variable_size ? 0 : (*stack)->element_size;
+    header.size          = (*stack)->size;
+    header.init_capacity = (*stack)->init_capacity;
+    header.block_size    = STACK_SAVE_BLOCK_SIZE;
+    header.checksum      = header_checksum(&header);
+
+    struct iovec header_vector = {&header, sizeof(header)};
+    stack_error_t write_state = write_vectors(fd, &header_vector, 1);
+    if(write_state != STACK_SUCCESS)
+        return write_state;
+
+    size_t payload_size = (*stack)->size * (*stack)->element_size;
+    for(size_t offset = 0; offset < payload_size; offset += STACK_SAVE_BLOCK_SIZE) {
+        size_t length = payload_size - offset;
+        if(length > STACK_SAVE_BLOCK_SIZE)
+            length = STACK_SAVE_BLOCK_SIZE;
+
+        char *payload = (*stack)->data + offset;
+        stack_save_block_t block = {};
+        block.length   = length;
+        block.checksum = hash_function(payload, payload + length);
+
+        struct iovec vectors[] = {{&block , sizeof(block)},
+                                  {payload, length       }};
+        write_state = write_vectors(fd, vectors, 2);
+        if(write_state != STACK_SUCCESS)
+            return write_state;
+    }
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//READS STACK WHICH WAS WRITTEN WITH stack_save, CAPACITY IS ALLOCATED ONCE
+//element_size = 0 MEANS STACK OF ELEMENTS WITH DIFFERENT SIZES
+//------------------------------------------------------------------------------
+stack_t *stack_load(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                        const char *initialized_file,
+                                        const char *initialized_varname,
+                                        const char *initialized_function,
+                                        size_t      initialized_line,
+                                        int       (*print_func)(FILE *, void *),)
+                    int    fd,
+                    size_t element_size) {
+    stack_save_header_t header = {};
+    if(read_bytes(fd, &header, sizeof(header)) != STACK_SUCCESS ||
+       header.magic        != STACK_SAVE_MAGIC                  ||
+       header.checksum     != header_checksum(&header)          ||
+       header.element_size != element_size                      ||
+       header.block_size   == 0                                 ||
+       !header_fits_file(fd, &header, element_size))
+        return NULL;
+
+    size_t capacity = header.size;
+    if(capacity < header.init_capacity)
+        capacity = header.init_capacity;
+
+    stack_t *stack = NULL;
+    if(element_size == 0)
+        stack = stack_init_bytes(STACK_WRITE_DUMP_ON(dump_filename,
+                                                     initialized_file,
+                                                     initialized_varname,
+                                                     initialized_function,
+                                                     initialized_line,
+                                                     print_func,)
+                                 capacity);
+    else
+        stack = stack_init(STACK_WRITE_DUMP_ON(dump_filename,
+                                               initialized_file,
+                                               initialized_varname,
+                                               initialized_function,
+                                               initialized_line,
+                                               print_func,)
+                           capacity,
+                           element_size);
+    if(stack == NULL)
+        return NULL;
+
+    stack_write_begin(stack);
+    if(read_stack_blocks(stack, fd, &header) != STACK_SUCCESS) {
+        stack_destroy(&stack);
+        return NULL;
+    }
+
+    stack->size          = header.size;
+    stack->init_capacity = header.init_capacity;
+
+    #ifdef STACK_HASH_PROTECTION
+        stack_hash_invalidate(stack);
+        if(stack_update_hash(stack) != STACK_SUCCESS) {
+            stack_destroy(&stack);
+            return NULL;
+        }
+    #endif
+    stack_write_end(stack);
+
+    if(stack_verify(stack) != STACK_SUCCESS) {
+        stack_destroy(&stack);
+        return NULL;
+    }
+    return stack;
+}
+
+//==============================================================================
+//STATIC FUNCTIONS
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//WRITES ALL VECTORS, CONTINUES AFTER PARTIAL WRITES
+//------------------------------------------------------------------------------
+stack_error_t write_vectors(int           fd,
+                            struct iovec *vectors,
+                            int           count) {
+    while(count > 0) {
+        ssize_t written = writev(fd, vectors, count);
+        if(written < 0) {
+            if(errno == EINTR)
+                continue;
+            return STACK_IO_ERROR;
+        }
+
+        size_t left = (size_t)written;
+        while(count > 0 && left >= vectors->iov_len) {
+            left -= vectors->iov_len;
+            vectors++;
+            count--;
+        }
+        if(count > 0) {
+            vectors->iov_base = (char *)vectors->iov_base + left;
+            vectors->iov_len -= left;
+        }
+    }
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//READS EXACTLY LENGTH BYTES, END OF FILE IS AN ERROR
+//------------------------------------------------------------------------------
+stack_error_t read_bytes(int    fd,
+                         void * output,
+                         size_t length) {
+    char *position = (char *)output;
+    while(length > 0) {
+        ssize_t was_read = read(fd, position, length);
+        if(was_read < 0 && errno == EINTR)
+            continue;
+        if(was_read <= 0)
+            return STACK_IO_ERROR;
+
+        position += was_read;
+        length   -= (size_t)was_read;
+    }
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//COUNTS CHECKSUM OF HEADER FIELDS BEFORE CHECKSUM
+//------------------------------------------------------------------------------
+hash_t header_checksum(const stack_save_header_t *header) {
+    return hash_function(header, &header->checksum);
+}
+
+//------------------------------------------------------------------------------
+//CHECKS THAT SIZES FROM HEADER CAN BE ALLOCATED IN BYTES,
+//PAYLOAD OF REGULAR FILE MUST BE NOT LONGER THAN BYTES LEFT IN IT
+//------------------------------------------------------------------------------
+bool header_fits_file(int                        fd,
+                      const stack_save_header_t *header,
+                      size_t                     element_size) {
+    size_t bytes_per_element = element_size == 0 ? 1 : element_size;
+    if(header->size          > SIZE_MAX / bytes_per_element ||
+       header->init_capacity > SIZE_MAX / bytes_per_element)
+        return false;
+
+    //pipes and sockets have no length, their payload is checked block by block
+    struct stat file_info = {};
+    if(fstat(fd, &file_info) != 0)
+        return false;
+    if(!S_ISREG(file_info.st_mode))
+        return true;
+
+    off_t position = lseek(fd, 0, SEEK_CUR);
+    if(position < 0 || position > file_info.st_size)
+        return false;
+
+    uint64_t left_bytes = (uint64_t)(file_info.st_size - position);
+    return header->size * bytes_per_element <= left_bytes;
+}
+
+//------------------------------------------------------------------------------
+//READS PAYLOAD BLOCKS STRAIGHT INTO STACK DATA AND CHECKS THEIR CHECKSUMS
+//------------------------------------------------------------------------------
+stack_error_t read_stack_blocks(stack_t *                  stack,
+                                int                        fd,
+                                const stack_save_header_t *header) {
+    size_t payload_size = header->size * stack->element_size;
+    size_t offset = 0;
+
+    while(offset < payload_size) {
+        stack_save_block_t block = {};
+        if(read_bytes(fd, &block, sizeof(block)) != STACK_SUCCESS)
+            return STACK_IO_ERROR;
+
+        if(block.length == 0                   ||
+           block.length > header->block_size   ||
+           block.length > payload_size - offset)
+            return STACK_INVALID_DATA;
+
+        char *payload = stack->data + offset;
+        if(read_bytes(fd, payload, block.length) != STACK_SUCCESS)
+            return STACK_IO_ERROR;
+
+        if(hash_function(payload, payload + block.length) != block.checksum)
+            return STACK_INVALID_DATA;
+
+        offset += block.length;
+    }
+    return STACK_SUCCESS;
+}
@@ -0,0 +1,834 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stack.h"
+#include "stack_internal.h"
+#include "stack_shared.h"
+#include "memory.h"
+#include "colors.h"
+#include "custom_assert.h"
+
+//==============================================================================
+//SEGMENT IS ONE BLOCK:
+//[stack_shared_header_t][left canary][elements][right canary]
+//HEADER KEEPS ONLY OFFSETS FROM SEGMENT START AND CANARIES DEPEND ON OFFSETS,
+//SO SEGMENT IS VALID AT ANY ADDRESS IN ANY PROCESS
+//==============================================================================
+struct stack_shared_header_t {
+    #ifdef STACK_CANARY_PROTECTION
+        canary_t structure_left_canary;
+    #endif
+
+    uint64_t        magic;       //written last, segment is ready when it is set
+    uint64_t        header_size; //processes built with other modes do not attach
+    pthread_mutex_t lock;
+
+    //owner writes new size here before changing it, so if owner dies while
+    //committing, next owner of lock finishes commit (rolls it forward)
+    bool   committing;
+    size_t pending_size;
+
+    #ifdef STACK_HASH_PROTECTION
+        hash_t pending_data_hash;
+        hash_t data_hash;
+    #endif
+
+    //fields from capacity to structure_hash are covered by structure hash
+    size_t capacity;
+    size_t element_size;
+    size_t data_offset;
+    size_t right_canary_offset;
+    size_t segment_size;
+    size_t size;
+
+    #ifdef STACK_HASH_PROTECTION
+        hash_t structure_hash;
+    #endif
+
+    #ifdef STACK_CANARY_PROTECTION
+        canary_t structure_right_canary;
+    #endif
+};
+
+//==============================================================================
+//THE DEFINITION OF SHARED STACK HANDLE, IT IS LOCAL FOR EVERY PROCESS
+//==============================================================================
+struct stack_shared_t {
+    stack_shared_header_t *header;
+    char *                 data;
+    size_t                 segment_size;
+    int                    fd;
+    size_t                 id;
+
+    #ifdef STACK_WRITE_DUMP
+        stack_dump_sink_t *dump_sink;
+        const char *       initialized_file;
+        const char *       initialized_varname;
+        const char *       initialized_function;
+        size_t             initialized_line;
+        int              (*print_func)(FILE *, void *);
+    #endif
+};
+
+//==============================================================================
+//"SHRDSTCK" IN HEADER OF INITIALIZED SEGMENT
+//==============================================================================
+static const uint64_t SHARED_MAGIC = 0x4B43545344524853;
+
+//==============================================================================
+//PROCESS WHICH OPENS SEGMENT BEING CREATED WAITS THIS LONG FOR CREATOR,
+//CREATOR ONLY SIZES SEGMENT AND FILLS HEADER, SO SEGMENT WHICH IS NOT READY
+//AFTER IT WAS LEFT BY CREATOR WHICH DIED, IT IS CHECKED EVERY POLL INTERVAL
+//==============================================================================
+static const uint64_t SHARED_READY_TIMEOUT_NS = 1000000000;
+static const long     SHARED_READY_POLL_NS    = 100000;
+
+//==============================================================================
+//MACRO TO WRITE DUMP OF SHARED STACK WITH ERROR
+//==============================================================================
+#ifdef STACK_WRITE_DUMP
+    #define SHARED_DUMP(__stack, __error)    \
+        shared_dump((__stack),               \
+                    __FILE_NAME__,           \
+                    __PRETTY_FUNCTION__,     \
+                    __LINE__,                \
+                    (__error))
+#else
+    #define SHARED_DUMP(...)
+#endif
+
+//==============================================================================
+//FUNCTIONS PROTOTYPES
+//==============================================================================
+static stack_shared_t *shared_create       (STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                                const char *initialized_file,
+                                                                const char *initialized_varname,
+                                                                const char *initialized_function,
+                                                                size_t      initialized_line,
+                                                                int       (*print_func)(FILE *, void *),)
+                                            int    fd,
+                                            size_t capacity,
+                                            size_t element_size);
+static stack_shared_t *shared_map          (STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                                const char *initialized_file,
+                                                                const char *initialized_varname,
+                                                                const char *initialized_function,
+                                                                size_t      initialized_line,
+                                                                int       (*print_func)(FILE *, void *),)
+                                            int    fd,
+                                            size_t segment_size);
+static stack_error_t   shared_wait_ready   (int    fd,
+                                            size_t element_size);
+static void            shared_unlink_stale (const char *name,
+                                            int         fd);
+static uint64_t        shared_monotonic_ns (void);
+static size_t          shared_segment_size (size_t capacity,
+                                            size_t element_size,
+                                            size_t *data_offset,
+                                            size_t *right_canary_offset);
+static stack_error_t   shared_lock         (stack_shared_t *stack);
+static stack_error_t   shared_verify       (stack_shared_t *stack);
+static void            shared_commit       (stack_shared_t *stack,
+                                            size_t          new_size);
+static void            shared_roll_forward (stack_shared_header_t *header);
+static void            shared_release      (stack_shared_t *stack);
+
+#ifdef STACK_HASH_PROTECTION
+    static hash_t shared_structure_hash(const stack_shared_header_t *header);
+#endif
+
+#ifdef STACK_CANARY_PROTECTION
+    static canary_t shared_canary_value(const stack_shared_header_t *header,
+                                        const void *                 canary);
+#endif
+
+#ifdef STACK_WRITE_DUMP
+    static stack_error_t shared_dump(stack_shared_t *stack,
+                                     const char *    file_name,
+                                     const char *    function_name,
+                                     size_t          line,
+                                     stack_error_t   call_reason);
+#endif
+
+//==============================================================================
+//GLOBAL FUNCTION
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//OPENS NAMED SEGMENT OR CREATES ANONYMOUS ONE
+//EXISTING SEGMENT KEEPS ITS OWN CAPACITY, NAMED SEGMENT WHICH DOES NOT BECOME
+//READY WAS LEFT BY CREATOR WHICH DIED, ITS NAME IS REMOVED AND SEGMENT IS
+//CREATED AGAIN ONCE
+//------------------------------------------------------------------------------
+stack_shared_t *stack_shared_open(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                      const char *initialized_file,
+                                                      const char *initialized_varname,
+                                                      const char *initialized_function,
+                                                      size_t      initialized_line,
+                                                      int       (*print_func)(FILE *, void *),)
+                                  const char *name,
+                                  size_t      capacity,
+                                  size_t      element_size) {
+    C_ASSERT_ALWAYS(element_size != 0, return NULL);
+    C_ASSERT_ALWAYS(capacity     != 0, return NULL);
+
+    for(size_t attempt = 0; attempt < 2; attempt++) {
+        int fd = -1;
+        if(name == NULL)
+            fd = memfd_create("stack_shared", MFD_CLOEXEC);
+        else
+            fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+        stack_shared_t *stack = NULL;
+        if(fd >= 0) {
+            stack = shared_create(STACK_WRITE_DUMP_ON(dump_filename,
+                                                      initialized_file,
+                                                      initialized_varname,
+                                                      initialized_function,
+                                                      initialized_line,
+                                                      print_func,)
+                                  fd,
+                                  capacity,
+                                  element_size);
+            if(stack == NULL && name != NULL)
+                shm_unlink(name);
+        }
+        else if(name != NULL && errno == EEXIST) {
+            fd = shm_open(name, O_RDWR, 0600);
+            if(fd < 0)
+                return NULL;
+
+            stack_error_t ready_state = shared_wait_ready(fd, element_size);
+            if(ready_state == STACK_TIMEOUT) {
+                shared_unlink_stale(name, fd);
+                close(fd);
+                continue;
+            }
+            if(ready_state == STACK_SUCCESS)
+                stack = stack_shared_attach(STACK_WRITE_DUMP_ON(dump_filename,
+                                                                initialized_file,
+                                                                initialized_varname,
+                                                                initialized_function,
+                                                                initialized_line,
+                                                                print_func,)
+                                            fd,
+                                            element_size);
+        }
+
+        if(stack == NULL && fd >= 0)
+            close(fd);
+        return stack;
+    }
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+//MAPS SEGMENT FROM fd, WAITS FOR PROCESS WHICH IS CREATING IT
+//------------------------------------------------------------------------------
+stack_shared_t *stack_shared_attach(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                        const char *initialized_file,
+                                                        const char *initialized_varname,
+                                                        const char *initialized_function,
+                                                        size_t      initialized_line,
+                                                        int       (*print_func)(FILE *, void *),)
+                                    int    fd,
+                                    size_t element_size) {
+    C_ASSERT(fd >= 0, return NULL);
+
+    if(shared_wait_ready(fd, element_size) != STACK_SUCCESS)
+        return NULL;
+
+    stack_shared_header_t header = {};
+    if(pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+        return NULL;
+
+    size_t data_offset         = 0,
+           right_canary_offset = 0;
+    if(header.capacity == 0 ||
+       header.segment_size != shared_segment_size(header.capacity,
+                                                  element_size,
+                                                  &data_offset,
+                                                  &right_canary_offset))
+        return NULL;
+
+    stack_shared_t *stack = shared_map(STACK_WRITE_DUMP_ON(dump_filename,
+                                                           initialized_file,
+                                                           initialized_varname,
+                                                           initialized_function,
+                                                           initialized_line,
+                                                           print_func,)
+                                       fd,
+                                       header.segment_size);
+    if(stack == NULL)
+        return NULL;
+
+    if(shared_lock(stack) != STACK_SUCCESS) {
+        shared_release(stack);
+        return NULL;
+    }
+    stack_error_t verify_state = shared_verify(stack);
+    pthread_mutex_unlock(&stack->header->lock);
+
+    if(verify_state != STACK_SUCCESS) {
+        shared_release(stack);
+        return NULL;
+    }
+    return stack;
+}
+
+//------------------------------------------------------------------------------
+//RETURNS DESCRIPTOR OF SEGMENT, OTHER PROCESS ATTACHES TO IT BY COPY OF IT
+//------------------------------------------------------------------------------
+int stack_shared_fd(stack_shared_t *stack) {
+    C_ASSERT(stack != NULL, return -1);
+
+    return stack->fd;
+}
+
+//------------------------------------------------------------------------------
+//PUSHES ELEMENT IN SHARED STACK
+//------------------------------------------------------------------------------
+stack_error_t stack_shared_push(stack_shared_t *stack, const void *element) {
+    C_ASSERT(stack   != NULL, return STACK_NULL         );
+    C_ASSERT(element != NULL, return STACK_INVALID_INPUT);
+
+    stack_error_t error = shared_lock(stack);
+    if(error != STACK_SUCCESS)
+        return error;
+
+    stack_shared_header_t *header = stack->header;
+    error = shared_verify(stack);
+    if(error == STACK_SUCCESS && header->size == header->capacity)
+        error = STACK_FULL;
+
+    if(error == STACK_SUCCESS) {
+        memcpy(stack->data + header->size * header->element_size,
+               element,
+               header->element_size);
+        shared_commit(stack, header->size + 1);
+    }
+
+    pthread_mutex_unlock(&header->lock);
+    return error;
+}
+
+//------------------------------------------------------------------------------
+//POPS ELEMENT FROM SHARED STACK, WRITES ELEMENT TO OUTPUT
+//------------------------------------------------------------------------------
+stack_error_t stack_shared_pop(stack_shared_t *stack, void *output) {
+    C_ASSERT(stack  != NULL, return STACK_NULL          );
+    C_ASSERT(output != NULL, return STACK_INVALID_OUTPUT);
+
+    stack_error_t error = shared_lock(stack);
+    if(error != STACK_SUCCESS)
+        return error;
+
+    stack_shared_header_t *header = stack->header;
+    error = shared_verify(stack);
+    if(error == STACK_SUCCESS && header->size == 0)
+        error = STACK_EMPTY;
+
+    if(error == STACK_SUCCESS) {
+        char *top = stack->data + (header->size - 1) * header->element_size;
+        memcpy(output, top, header->element_size);
+        shared_commit(stack, header->size - 1);
+        memset(top, 0, header->element_size);
+    }
+
+    pthread_mutex_unlock(&header->lock);
+    return error;
+}
+
+//------------------------------------------------------------------------------
+//RETURNS NUMBER OF ELEMENTS WITHOUT TAKING LOCK
+//------------------------------------------------------------------------------
+size_t stack_shared_size(stack_shared_t *stack) {
+    C_ASSERT(stack != NULL, return 0);
+
+    return __atomic_load_n(&stack->header->size, __ATOMIC_ACQUIRE);
+}
+
+//------------------------------------------------------------------------------
+//UNMAPS SEGMENT AND CLOSES ITS DESCRIPTOR IN THIS PROCESS
+//------------------------------------------------------------------------------
+stack_error_t stack_shared_close(stack_shared_t **stack) {
+    C_ASSERT(stack != NULL, return STACK_NULL);
+    if(*stack == NULL)
+        return STACK_NULL;
+
+    int fd = (*stack)->fd;
+    shared_release(*stack);
+    close(fd);
+    *stack = NULL;
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//REMOVES NAME OF SEGMENT, PROCESSES WHICH HAVE MAPPED IT STILL USE IT
+//------------------------------------------------------------------------------
+stack_error_t stack_shared_unlink(const char *name) {
+    C_ASSERT(name != NULL, return STACK_INVALID_INPUT);
+
+    if(shm_unlink(name) != 0)
+        return errno == ENOENT ? STACK_NOT_FOUND : STACK_IO_ERROR;
+    return STACK_SUCCESS;
+}
+
+//==============================================================================
+//STATIC FUNCTIONS
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//INITIALIZES SEGMENT IN EMPTY fd, MAGIC IS WRITTEN WHEN SEGMENT IS READY
+//------------------------------------------------------------------------------
+stack_shared_t *shared_create(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                                  const char *initialized_file,
+                                                  const char *initialized_varname,
+                                                  const char *initialized_function,
+                                                  size_t      initialized_line,
+                                                  int       (*print_func)(FILE *, void *),)
+                              int    fd,
+                              size_t capacity,
+                              size_t element_size) {
+    size_t data_offset         = 0,
+           right_canary_offset = 0;
+    size_t segment_size = shared_segment_size(capacity,
+                                              element_size,
+                                              &data_offset,
+                                              &right_canary_offset);
+    if(ftruncate(fd, (off_t)segment_size) != 0)
+        return NULL;
+
+    stack_shared_t *stack = shared_map(STACK_WRITE_DUMP_ON(dump_filename,
+                                                           initialized_file,
+                                                           initialized_varname,
+                                                           initialized_function,
+                                                           initialized_line,
+                                                           print_func,)
+                                       fd,
+                                       segment_size);
+    if(stack == NULL)
+        return NULL;
+
+    stack_shared_header_t *header = stack->header;
+    pthread_mutexattr_t lock_attributes = {};
+    if(pthread_mutexattr_init(&lock_attributes) != 0) {
+        shared_release(stack);
+        return NULL;
+    }
+    pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust (&lock_attributes, PTHREAD_MUTEX_ROBUST);
+    int lock_state = pthread_mutex_init(&header->lock, &lock_attributes);
+    pthread_mutexattr_destroy(&lock_attributes);
+    if(lock_state != 0) {
+        shared_release(stack);
+        return NULL;
+    }
+
+    header->header_size         = sizeof(stack_shared_header_t);
+    header->capacity            = capacity;
+    header->element_size        = element_size;
+    header->data_offset         = data_offset;
+    header->right_canary_offset = right_canary_offset;
+    header->segment_size        = segment_size;
+    header->size                = 0;
+
+    #ifdef STACK_HASH_PROTECTION
+        header->data_hash      = hash_function(stack->data, stack->data);
+        header->structure_hash = shared_structure_hash(header);
+    #endif
+
+    #ifdef STACK_CANARY_PROTECTION
+        canary_t *data_left_canary  = (canary_t *)(stack->data - sizeof(canary_t));
+        canary_t *data_right_canary = (canary_t *)((char *)header + right_canary_offset);
+        *data_left_canary              = shared_canary_value(header, data_left_canary);
+        *data_right_canary             = shared_canary_value(header, data_right_canary);
+        header->structure_left_canary  = shared_canary_value(header,
+                                                             &header->structure_left_canary);
+        header->structure_right_canary = shared_canary_value(header,
+                                                             &header->structure_right_canary);
+    #endif
+
+    __atomic_store_n(&header->magic, SHARED_MAGIC, __ATOMIC_RELEASE);
+    return stack;
+}
+
+//------------------------------------------------------------------------------
+//MAPS SEGMENT AND CREATES HANDLE OF THIS PROCESS FOR IT
+//------------------------------------------------------------------------------
+stack_shared_t *shared_map(STACK_WRITE_DUMP_ON(const char *dump_filename,
+                                               const char *initialized_file,
+                                               const char *initialized_varname,
+                                               const char *initialized_function,
+                                               size_t      initialized_line,
+                                               int       (*print_func)(FILE *, void *),)
+                           int    fd,
+                           size_t segment_size) {
+    stack_shared_t *stack = (stack_shared_t *)_calloc(1, sizeof(stack_shared_t));
+    if(stack == NULL)
+        return NULL;
+
+    void *memory = mmap(NULL,
+                        segment_size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED,
+                        fd,
+                        0);
+    if(memory == MAP_FAILED) {
+        _free(stack);
+        return NULL;
+    }
+
+    size_t data_offset         = 0,
+           right_canary_offset = 0;
+    stack->header       = (stack_shared_header_t *)memory;
+    stack->segment_size = segment_size;
+    stack->fd           = fd;
+    stack->id           = stack_new_id();
+
+    //header may be not initialized yet, data offset is counted from layout
+    shared_segment_size(0, 1, &data_offset, &right_canary_offset);
+    stack->data = (char *)memory + data_offset;
+
+    #ifdef STACK_WRITE_DUMP
+        C_ASSERT(initialized_file     != NULL, {shared_release(stack); return NULL;});
+        C_ASSERT(initialized_varname  != NULL, {shared_release(stack); return NULL;});
+        C_ASSERT(initialized_function != NULL, {shared_release(stack); return NULL;});
+        C_ASSERT(print_func           != NULL, {shared_release(stack); return NULL;});
+
+        stack->initialized_file     = initialized_file;
+        stack->initialized_varname  = initialized_varname;
+        stack->initialized_function = initialized_function;
+        stack->initialized_line     = initialized_line;
+        stack->print_func           = print_func;
+        stack->dump_sink            = stack_dump_sink_acquire(dump_filename);
+        if(stack->dump_sink == NULL) {
+            shared_release(stack);
+            return NULL;
+        }
+    #endif
+
+    return stack;
+}
+
+//------------------------------------------------------------------------------
+//WAITS UNTIL CREATOR HAS SIZED SEGMENT AND WRITTEN MAGIC, RETURNS STACK_TIMEOUT
+//IF IT IS NOT WRITTEN IN SHARED_READY_TIMEOUT_NS, STACK_INVALID_DATA IF
+//SEGMENT WAS BUILT FOR OTHER ELEMENTS OR MODES
+//------------------------------------------------------------------------------
+stack_error_t shared_wait_ready(int    fd,
+                                size_t element_size) {
+    uint64_t deadline_ns = shared_monotonic_ns() + SHARED_READY_TIMEOUT_NS;
+    while(true) {
+        struct stat segment_info = {};
+        if(fstat(fd, &segment_info) != 0)
+            return STACK_IO_ERROR;
+
+        stack_shared_header_t header = {};
+        if((size_t)segment_info.st_size >= sizeof(header) &&
+           pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+           header.magic == SHARED_MAGIC) {
+            if(header.header_size  != sizeof(stack_shared_header_t) ||
+               header.element_size != element_size                 ||
+               header.segment_size >  (size_t)segment_info.st_size)
+                return STACK_INVALID_DATA;
+            return STACK_SUCCESS;
+        }
+
+        if(shared_monotonic_ns() >= deadline_ns)
+            return STACK_TIMEOUT;
+
+        struct timespec poll_interval = {0, SHARED_READY_POLL_NS};
+        nanosleep(&poll_interval, NULL);
+    }
+}
+
+//------------------------------------------------------------------------------
+//REMOVES NAME OF SEGMENT WHICH NEVER BECAME READY, NAME IS REMOVED ONLY IF IT
+//STILL REFERS TO SEGMENT OF fd, SO SEGMENT WHICH OTHER PROCESS HAS ALREADY
+//CREATED AGAIN IS KEPT
+//------------------------------------------------------------------------------
+void shared_unlink_stale(const char *name,
+                         int         fd) {
+    int named_fd = shm_open(name, O_RDONLY, 0);
+    if(named_fd < 0)
+        return ;
+
+    struct stat waited_info = {},
+                named_info  = {};
+    if(fstat(fd,       &waited_info) == 0 &&
+       fstat(named_fd, &named_info)  == 0 &&
+       waited_info.st_dev == named_info.st_dev &&
+       waited_info.st_ino == named_info.st_ino)
+        shm_unlink(name);
+    close(named_fd);
+}
+
+//------------------------------------------------------------------------------
+//RETURNS MONOTONIC TIME IN NANOSECONDS
+//------------------------------------------------------------------------------
+uint64_t shared_monotonic_ns(void) {
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+//COUNTS WHERE PARTS OF SEGMENT ARE PLACED, RETURNS SIZE OF SEGMENT
+//------------------------------------------------------------------------------
+size_t shared_segment_size(size_t  capacity,
+                           size_t  element_size,
+                           size_t *data_offset,
+                           size_t *right_canary_offset) {
+    size_t offset = sizeof(stack_shared_header_t);
+
+    #ifdef STACK_CANARY_PROTECTION
+        offset += sizeof(canary_t);
+    #endif
+
+    *data_offset = (offset + STACK_DEFAULT_ALIGNMENT - 1) /
+                   STACK_DEFAULT_ALIGNMENT * STACK_DEFAULT_ALIGNMENT;
+    *right_canary_offset = (*data_offset + capacity * element_size +
+                            sizeof(uint64_t) - 1) /
+                           sizeof(uint64_t) * sizeof(uint64_t);
+
+    size_t segment_size = *right_canary_offset;
+
+    #ifdef STACK_CANARY_PROTECTION
+        segment_size += sizeof(canary_t);
+    #endif
+
+    return segment_size;
+}
+
+//------------------------------------------------------------------------------
+//TAKES LOCK, FINISHES COMMIT OF PROCESS WHICH DIED WITH LOCK
+//------------------------------------------------------------------------------
+stack_error_t shared_lock(stack_shared_t *stack) {
+    int lock_state = pthread_mutex_lock(&stack->header->lock);
+    if(lock_state == EOWNERDEAD) {
+        shared_roll_forward(stack->header);
+        pthread_mutex_consistent(&stack->header->lock);
+        return STACK_SUCCESS;
+    }
+    if(lock_state != 0) {
+        SHARED_DUMP(stack, STACK_UNEXPECTED_ERROR);
+        return STACK_UNEXPECTED_ERROR;
+    }
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//CHECKS SEGMENT UNDER LOCK, WRITES DUMP ON ERROR
+//------------------------------------------------------------------------------
+stack_error_t shared_verify(stack_shared_t *stack) {
+    stack_shared_header_t *header = stack->header;
+    stack_error_t          error  = STACK_SUCCESS;
+
+    size_t data_offset         = 0,
+           right_canary_offset = 0;
+    size_t segment_size = shared_segment_size(header->capacity,
+                                              header->element_size,
+                                              &data_offset,
+                                              &right_canary_offset);
+
+    if(header->magic       != SHARED_MAGIC ||
+       header->header_size != sizeof(stack_shared_header_t))
+        error = STACK_INVALID_DATA;
+    else if(header->capacity == 0                  ||
+            header->segment_size != segment_size   ||
+            segment_size         != stack->segment_size)
+        error = STACK_INVALID_CAPACITY;
+    else if(header->data_offset         != data_offset ||
+            header->right_canary_offset != right_canary_offset)
+        error = STACK_INVALID_DATA;
+    else if(header->size > header->capacity)
+        error = STACK_INCORRECT_SIZE;
+
+    #ifdef STACK_CANARY_PROTECTION
+        else if(header->structure_left_canary !=
+                shared_canary_value(header, &header->structure_left_canary))
+            error = STACK_UNEXPECTED_LEFT_CANARY;
+        else if(header->structure_right_canary !=
+                shared_canary_value(header, &header->structure_right_canary))
+            error = STACK_UNEXPECTED_RIGHT_CANARY;
+        else if(*(canary_t *)(stack->data - sizeof(canary_t)) !=
+                shared_canary_value(header, stack->data - sizeof(canary_t)))
+            error = STACK_UNEXPECTED_DATA_LEFT_CANARY;
+        else if(*(canary_t *)((char *)header + right_canary_offset) !=
+                shared_canary_value(header, (char *)header + right_canary_offset))
+            error = STACK_UNEXPECTED_DATA_RIGHT_CANARY;
+    #endif
+
+    #ifdef STACK_HASH_PROTECTION
+        else if(header->structure_hash != shared_structure_hash(header))
+            error = STACK_UNEXPECTED_STRUCTURE_HASH;
+        else if(header->data_hash !=
+                hash_function(stack->data,
+                              stack->data + header->size * header->element_size))
+            error = STACK_UNEXPECTED_DATA_HASH;
+    #endif
+
+    if(error != STACK_SUCCESS) {
+        SHARED_DUMP(stack, error);
+    }
+    return error;
+}
+
+//------------------------------------------------------------------------------
+//CHANGES SIZE AFTER ELEMENTS ARE WRITTEN OR READ
+//PENDING STATE IS WRITTEN FIRST, SO COMMIT CAN BE FINISHED BY OTHER PROCESS
+//------------------------------------------------------------------------------
+void shared_commit(stack_shared_t *stack,
+                   size_t          new_size) {
+    stack_shared_header_t *header = stack->header;
+    header->pending_size = new_size;
+
+    #ifdef STACK_HASH_PROTECTION
+        header->pending_data_hash = hash_function(stack->data,
+                                                  stack->data +
+                                                  new_size * header->element_size);
+    #endif
+
+    __atomic_store_n(&header->committing, true, __ATOMIC_RELEASE);
+    shared_roll_forward(header);
+}
+
+//------------------------------------------------------------------------------
+//FINISHES STARTED COMMIT, DOES NOTHING IF THERE IS NO ONE
+//------------------------------------------------------------------------------
+void shared_roll_forward(stack_shared_header_t *header) {
+    if(!__atomic_load_n(&header->committing, __ATOMIC_ACQUIRE))
+        return ;
+
+    __atomic_store_n(&header->size, header->pending_size, __ATOMIC_RELEASE);
+
+    #ifdef STACK_HASH_PROTECTION
+        header->data_hash      = header->pending_data_hash;
+        header->structure_hash = shared_structure_hash(header);
+    #endif
+
+    __atomic_store_n(&header->committing, false, __ATOMIC_RELEASE);
+}
+
+//------------------------------------------------------------------------------
+//UNMAPS SEGMENT AND FREES HANDLE, fd IS LEFT TO CALLER
+//------------------------------------------------------------------------------
+void shared_release(stack_shared_t *stack) {
+    #ifdef STACK_WRITE_DUMP
+        if(stack->dump_sink != NULL)
+            stack_dump_sink_release(stack->dump_sink);
+    #endif
+
+    munmap(stack->header, stack->segment_size);
+    _free(stack);
+}
+
+#ifdef STACK_HASH_PROTECTION
+    //------------------------------------------------------------------------------
+    //HASH OF LAYOUT AND SIZE OF SEGMENT
+    //------------------------------------------------------------------------------
+    hash_t shared_structure_hash(const stack_shared_header_t *header) {
+        return hash_function(&header->capacity,
+                             &header->structure_hash);
+    }
+#endif
+
+#ifdef STACK_CANARY_PROTECTION
+    //------------------------------------------------------------------------------
+    //CANARY VALUE DEPENDS ON ITS OFFSET FROM SEGMENT START, NOT ON ITS ADDRESS
+    //------------------------------------------------------------------------------
+    canary_t shared_canary_value(const stack_shared_header_t *header,
+                                 const void *                 canary) {
+        return (canary_t)((const char *)canary -
+                          (const char *)header) ^ CANARY_HEX_SPEAK;
+    }
+#endif
+
+#ifdef STACK_WRITE_DUMP
+    //------------------------------------------------------------------------------
+    //WRITES SHARED STACK INFORMATION IN DUMP FILE OF THIS PROCESS
+    //------------------------------------------------------------------------------
+    stack_error_t shared_dump(stack_shared_t *stack,
+                              const char *    file_name,
+                              const char *    function_name,
+                              size_t          line,
+                              stack_error_t   call_reason) {
+        FILE *dump_file = NULL;
+        if(stack->dump_sink == NULL ||
+           (dump_file = stack_dump_sink_lock(stack->dump_sink)) == NULL) {
+            color_printf(RED_TEXT, BOLD_TEXT, DEFAULT_BACKGROUND,
+                         "MEMORY DUMP FILE ERROR\r\n"
+                         "called from: %s:%llu\r\n",
+                         file_name,
+                         line);
+            return STACK_DUMP_ERROR;
+        }
+
+        const char *error_definition = get_error_text(call_reason);
+        if(error_definition == NULL)
+            error_definition = "'unknown error'";
+
+        stack_shared_header_t *header = stack->header;
+        size_t size     = header->size,
+               capacity = header->capacity;
+
+        stack_error_t dump_state = STACK_SUCCESS;
+        if(fprintf(dump_file,
+                   "stack_shared_t #%zu [0x%p] initialized in %s:%zu as "
+                   "'stack_shared_t %s' in function '%s'\r\n"
+                   "dump called from %s:%zu '%s'\r\n"
+                   "ERROR = '%s'\r\n"
+                   "{\r\n"
+                   "\t\t---DEFAULT_INFO---\r\n"
+                   "\tsize              =   %zu;\r\n"
+                   "\tcapacity          =   %zu;\r\n"
+                   "\telement_size      =   %zu;\r\n"
+                   "\tsegment_size      =   %zu;\r\n"
+                   "\t\t---MEMBERS---\r\n",
+                   stack->id,
+                   header,
+                   stack->initialized_file,
+                   stack->initialized_line,
+                   stack->initialized_varname,
+                   stack->initialized_function,
+                   file_name,
+                   line,
+                   function_name,
+                   error_definition,
+                   size,
+                   capacity,
+                   header->element_size,
+                   stack->segment_size) < 0)
+            dump_state = STACK_DUMP_ERROR;
+
+        //elements are written only if they are surely inside of mapping
+        bool layout_valid = header->data_offset == (size_t)(stack->data - (char *)header) &&
+                            size <= capacity                                           &&
+                            header->data_offset + capacity * header->element_size <=
+                            stack->segment_size;
+        for(size_t index = 0;
+            dump_state == STACK_SUCCESS && layout_valid && index < size;
+            index++) {
+            if(fprintf(dump_file, "\t    [%zu] = ", index) < 0 ||
+               stack->print_func(dump_file,
+                                 stack->data + index * header->element_size) < 0 ||
+               fprintf(dump_file, ";\r\n") < 0)
+                dump_state = STACK_DUMP_ERROR;
+        }
+
+        if(dump_state == STACK_SUCCESS && fprintf(dump_file, "}\r\n\r\n") < 0)
+            dump_state = STACK_DUMP_ERROR;
+
+        stack_dump_sink_unlock(stack->dump_sink, true);
+        return dump_state;
+    }
+#endif
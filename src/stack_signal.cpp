@@ -0,0 +1,418 @@
+//<signal.h> defines POSIX stack_t (sigaltstack), it is renamed here, so it does
+//not clash with stack_t of this library, stack_t is not used from it
+#define stack_t signal_stack_t
+#include <signal.h>
+#undef stack_t
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "stack.h"
+#include "stack_internal.h"
+#include "stack_registry.h"
+#include "stack_signal.h"
+#include "custom_assert.h"
+
+//==============================================================================
+//SIGNALS WITH HANDLERS OF THIS MODULE, FIRST ONE REQUESTS DUMP, OTHERS ARE CRASHES
+//==============================================================================
+static const int    HANDLED_SIGNALS[]     = {SIGUSR1, SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+static const size_t HANDLED_SIGNALS_COUNT = sizeof(HANDLED_SIGNALS) / sizeof(HANDLED_SIGNALS[0]);
+
+//==============================================================================
+//STATE OF SIGNAL DUMPS, DUMP REQUESTS ARE SIGNALED WITH wakeup_fd (EVENTFD)
+//==============================================================================
+struct stack_signal_dumps_t {
+    pthread_t        thread;
+    bool             running;
+    int              wakeup_fd;
+    int              snapshot_fd; //-1 if snapshot file is not given
+    struct sigaction previous[HANDLED_SIGNALS_COUNT];
+};
+
+static stack_signal_dumps_t signal_dumps = {};
+
+//==============================================================================
+//SNAPSHOT WHICH IS WRITTEN BY stack_signal_snapshot, STACK BY STACK
+//==============================================================================
+struct snapshot_context_t {
+    int  fd;
+    bool written;
+};
+
+//==============================================================================
+//FUNCTIONS PROTOTYPES
+//==============================================================================
+static void *        signal_thread      (void *          argument);
+static void          dump_request       (int             signal_number);
+static void          crash_snapshot     (int             signal_number);
+static void          dump_all           (void);
+static bool          snapshot_write     (int             fd,
+                                         int             signal_number);
+static bool          snapshot_header    (int             fd,
+                                         int             signal_number,
+                                         size_t          count);
+static bool          snapshot_record    (int             fd,
+                                         const stack_t * stack);
+static stack_error_t snapshot_stack     (stack_t *       stack,
+                                         void *          context);
+static void          snapshot_fill      (stack_snapshot_record_t *record,
+                                         const stack_t *           stack);
+static bool          write_all          (int             fd,
+                                         const void *    buffer,
+                                         size_t          size);
+static stack_error_t set_handlers       (void);
+static void          restore_handlers   (void);
+static stack_error_t stop_thread        (void);
+
+#ifdef STACK_WRITE_DUMP
+    static stack_error_t dump_stack(stack_t *stack,
+                                    void *   context);
+#endif
+
+//==============================================================================
+//GLOBAL FUNCTION
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//OPENS SNAPSHOT FILE, STARTS THREAD WHICH DUMPS STACKS ON SIGUSR1 AND SETS
+//HANDLERS OF SIGNALS
+//------------------------------------------------------------------------------
+stack_error_t stack_signal_dumps_start(const char *snapshot_path) {
+    if(__atomic_load_n(&signal_dumps.running, __ATOMIC_ACQUIRE))
+        return STACK_UNEXPECTED_ERROR;
+
+    signal_dumps.snapshot_fd = -1;
+    if(snapshot_path != NULL) {
+        signal_dumps.snapshot_fd = open(snapshot_path,
+                                        O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                                        0644);
+        if(signal_dumps.snapshot_fd < 0)
+            return STACK_IO_ERROR;
+    }
+
+    signal_dumps.wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(signal_dumps.wakeup_fd < 0) {
+        if(signal_dumps.snapshot_fd >= 0)
+            close(signal_dumps.snapshot_fd);
+        return STACK_IO_ERROR;
+    }
+
+    __atomic_store_n(&signal_dumps.running, true, __ATOMIC_RELEASE);
+    if(pthread_create(&signal_dumps.thread, NULL, signal_thread, NULL) != 0) {
+        __atomic_store_n(&signal_dumps.running, false, __ATOMIC_RELEASE);
+        close(signal_dumps.wakeup_fd);
+        if(signal_dumps.snapshot_fd >= 0)
+            close(signal_dumps.snapshot_fd);
+        return STACK_UNEXPECTED_ERROR;
+    }
+
+    stack_error_t handlers_state = set_handlers();
+    if(handlers_state != STACK_SUCCESS) {
+        stop_thread();
+        return handlers_state;
+    }
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//RESTORES HANDLERS, STOPS DUMP THREAD AND CLOSES SNAPSHOT FILE
+//------------------------------------------------------------------------------
+stack_error_t stack_signal_dumps_stop(void) {
+    if(!__atomic_load_n(&signal_dumps.running, __ATOMIC_ACQUIRE))
+        return STACK_UNEXPECTED_ERROR;
+
+    restore_handlers();
+    return stop_thread();
+}
+
+//------------------------------------------------------------------------------
+//WRITES SNAPSHOT OF ALL STACKS UNDER REGISTRY LOCK, SO NO STACK IS ADDED OR
+//REMOVED, EVERY STACK IS READ UNDER LOCK OF ITS SLOT, SO IT IS NOT MOVED
+//------------------------------------------------------------------------------
+stack_error_t stack_signal_snapshot(void) {
+    int snapshot_fd = __atomic_load_n(&signal_dumps.snapshot_fd, __ATOMIC_ACQUIRE);
+    if(!__atomic_load_n(&signal_dumps.running, __ATOMIC_ACQUIRE) || snapshot_fd < 0)
+        return STACK_UNEXPECTED_ERROR;
+
+    snapshot_context_t snapshot = {};
+    snapshot.fd = snapshot_fd;
+
+    stack_registry_lock();
+    stack_registry_slot_t *const *slots = NULL;
+    snapshot.written = snapshot_header(snapshot_fd, 0, stack_registry_peek(&slots));
+    if(snapshot.written)
+        stack_registry_for_each_locked(snapshot_stack, &snapshot);
+    stack_registry_unlock();
+
+    return snapshot.written ? STACK_SUCCESS : STACK_IO_ERROR;
+}
+
+//==============================================================================
+//STATIC FUNCTIONS
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//DUMPS STACKS EVERY TIME SIGUSR1 HANDLER WAKES IT, UNTIL STOP
+//------------------------------------------------------------------------------
+void *signal_thread(void *) {
+    struct pollfd wakeup = {};
+    wakeup.fd     = signal_dumps.wakeup_fd;
+    wakeup.events = POLLIN;
+
+    while(__atomic_load_n(&signal_dumps.running, __ATOMIC_ACQUIRE)) {
+        if(poll(&wakeup, 1, -1) < 0)
+            continue;
+
+        uint64_t requests = 0;
+        if(read(signal_dumps.wakeup_fd, &requests, sizeof(requests)) != sizeof(requests))
+            continue;
+
+        if(__atomic_load_n(&signal_dumps.running, __ATOMIC_ACQUIRE))
+            dump_all();
+    }
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+//SIGUSR1 HANDLER, ONLY WAKES DUMP THREAD, BECAUSE stack_dump IS NOT
+//ASYNC-SIGNAL-SAFE
+//------------------------------------------------------------------------------
+void dump_request(int) {
+    int      saved_errno = errno;
+    uint64_t wakeup      = 1;
+
+    //write fails only if eventfd is full, then dump is requested already
+    ssize_t written = write(signal_dumps.wakeup_fd, &wakeup, sizeof(wakeup));
+    (void)written;
+    errno = saved_errno;
+}
+
+//------------------------------------------------------------------------------
+//CRASH HANDLER, REGISTRY IS READ WITHOUT LOCK, BECAUSE CRASHED THREAD MAY HOLD
+//IT, AFTER SNAPSHOT SIGNAL IS GIVEN TO PREVIOUS HANDLER
+//------------------------------------------------------------------------------
+void crash_snapshot(int signal_number) {
+    int snapshot_fd = __atomic_load_n(&signal_dumps.snapshot_fd, __ATOMIC_ACQUIRE);
+    if(snapshot_fd >= 0)
+        snapshot_write(snapshot_fd, signal_number);
+
+    //signal is blocked while handler runs, it is delivered to previous
+    //handler after return, faulting instruction also runs again
+    for(size_t index = 0; index < HANDLED_SIGNALS_COUNT; index++)
+        if(HANDLED_SIGNALS[index] == signal_number)
+            sigaction(signal_number, &signal_dumps.previous[index], NULL);
+    raise(signal_number);
+}
+
+//------------------------------------------------------------------------------
+//DUMPS KEYFRAMES OF ALL STACKS, WITHOUT DUMP MODE WRITES SNAPSHOT
+//STACKS ARE READ WHILE THEIR OWNERS MAY CHANGE THEM, AS SCRUBBER DOES
+//------------------------------------------------------------------------------
+void dump_all(void) {
+    #ifdef STACK_WRITE_DUMP
+        stack_registry_for_each(dump_stack, NULL);
+        stack_registry_flush();
+    #else
+        stack_signal_snapshot();
+    #endif
+}
+
+#ifdef STACK_WRITE_DUMP
+    //------------------------------------------------------------------------------
+    //DUMPS ONE STACK AS READ ONLY KEYFRAME, SO DUMPS OF ITS OWNER ARE NOT CHANGED,
+    //ERROR OF ONE DUMP DOES NOT STOP OTHERS
+    //------------------------------------------------------------------------------
+    stack_error_t dump_stack(stack_t *stack,
+                             void *) {
+        stack_dump_keyframe(stack,
+                            __FILE_NAME__,
+                            __PRETTY_FUNCTION__,
+                            __LINE__);
+        return STACK_SUCCESS;
+    }
+#endif
+
+//------------------------------------------------------------------------------
+//WRITES SNAPSHOT HEADER AND RECORD OF EVERY REGISTERED STACK WITH write ONLY,
+//SO IT CAN BE CALLED FROM SIGNAL HANDLER, REMOVED STACK GIVES ZERO RECORD
+//------------------------------------------------------------------------------
+bool snapshot_write(int fd,
+                    int signal_number) {
+    stack_registry_slot_t *const *slots = NULL;
+    size_t                        count = stack_registry_peek(&slots);
+
+    if(!snapshot_header(fd, signal_number, count))
+        return false;
+
+    for(size_t index = 0; index < count; index++) {
+        const stack_t *stack = slots != NULL ?
+                               stack_registry_slot_stack(slots, index) :
+                               NULL;
+        if(!snapshot_record(fd, stack))
+            return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+//WRITES SNAPSHOT HEADER FOR count STACKS
+//------------------------------------------------------------------------------
+bool snapshot_header(int    fd,
+                     int    signal_number,
+                     size_t count) {
+    stack_snapshot_header_t header = {};
+    header.magic       = STACK_SNAPSHOT_MAGIC;
+    header.record_size = sizeof(stack_snapshot_record_t);
+    header.signal      = signal_number;
+    header.pid         = getpid();
+    header.stacks      = count;
+    #ifdef STACK_HASH_PROTECTION
+        header.modes |= STACK_SNAPSHOT_HASH;
+    #endif
+    #ifdef STACK_CANARY_PROTECTION
+        header.modes |= STACK_SNAPSHOT_CANARY;
+    #endif
+    #ifdef STACK_WRITE_DUMP
+        header.modes |= STACK_SNAPSHOT_DUMP;
+    #endif
+
+    return write_all(fd, &header, sizeof(header));
+}
+
+//------------------------------------------------------------------------------
+//WRITES RECORD OF ONE STACK, NULL STACK GIVES ZERO RECORD
+//------------------------------------------------------------------------------
+bool snapshot_record(int            fd,
+                     const stack_t *stack) {
+    stack_snapshot_record_t record = {};
+    if(stack != NULL)
+        snapshot_fill(&record, stack);
+
+    return write_all(fd, &record, sizeof(record));
+}
+
+//------------------------------------------------------------------------------
+//WRITES RECORD OF VISITED STACK, RECORDS AFTER FIRST WRITE ERROR ARE SKIPPED
+//------------------------------------------------------------------------------
+stack_error_t snapshot_stack(stack_t *stack,
+                             void *   context) {
+    snapshot_context_t *snapshot = (snapshot_context_t *)context;
+    if(snapshot->written)
+        snapshot->written = snapshot_record(snapshot->fd, stack);
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//COPIES HEADER AND CANARIES OF STACK, DATA CANARIES ARE READ ONLY IF THEIR
+//POINTERS ARE INSIDE OF STACK MEMORY
+//------------------------------------------------------------------------------
+void snapshot_fill(stack_snapshot_record_t *record,
+                   const stack_t *           stack) {
+    record->address      = (uintptr_t)stack;
+    record->id           = stack->id;
+    record->size         = stack->size;
+    record->capacity     = stack->capacity;
+    record->element_size = stack->element_size;
+    record->alignment    = stack->alignment;
+    record->version      = stack->version;
+
+    #ifdef STACK_HASH_PROTECTION
+        record->structure_hash = stack->structure_hash;
+        record->data_hash      = stack->data_hash;
+    #endif
+
+    #ifdef STACK_CANARY_PROTECTION
+        record->structure_left_canary  = stack->structure_left_canary;
+        record->structure_right_canary = stack->structure_right_canary;
+
+        const char *start = (const char *)stack,
+                   *end   = start + calculate_allocation_size(stack->capacity,
+                                                              stack->element_size,
+                                                              stack->alignment);
+        const char *left  = (const char *)stack->data_left_canary,
+                   *right = (const char *)stack->data_right_canary;
+        if(left  >= start && left  + sizeof(canary_t) <= end)
+            record->data_left_canary  = *stack->data_left_canary;
+        if(right >= start && right + sizeof(canary_t) <= end)
+            record->data_right_canary = *stack->data_right_canary;
+    #endif
+}
+
+//------------------------------------------------------------------------------
+//WRITES WHOLE BUFFER, RETRIES SHORT WRITES AND INTERRUPTS
+//------------------------------------------------------------------------------
+bool write_all(int         fd,
+               const void *buffer,
+               size_t      size) {
+    const char *bytes = (const char *)buffer;
+    while(size != 0) {
+        ssize_t written = write(fd, bytes, size);
+        if(written < 0 && errno == EINTR)
+            continue;
+        if(written <= 0)
+            return false;
+        bytes += written;
+        size  -= (size_t)written;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+//SETS HANDLERS AND KEEPS PREVIOUS ONES, CRASH HANDLERS RUN ON ALTERNATE SIGNAL
+//STACK IF THREAD HAS IT
+//------------------------------------------------------------------------------
+stack_error_t set_handlers(void) {
+    for(size_t index = 0; index < HANDLED_SIGNALS_COUNT; index++) {
+        struct sigaction action = {};
+        sigemptyset(&action.sa_mask);
+        if(HANDLED_SIGNALS[index] == SIGUSR1) {
+            action.sa_handler = dump_request;
+            action.sa_flags   = SA_RESTART;
+        }
+        else {
+            action.sa_handler = crash_snapshot;
+            action.sa_flags   = SA_ONSTACK;
+        }
+
+        if(sigaction(HANDLED_SIGNALS[index], &action, &signal_dumps.previous[index]) != 0) {
+            for(size_t set = 0; set < index; set++)
+                sigaction(HANDLED_SIGNALS[set], &signal_dumps.previous[set], NULL);
+            return STACK_UNEXPECTED_ERROR;
+        }
+    }
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//GIVES SIGNALS BACK TO HANDLERS WHICH WERE SET BEFORE START
+//------------------------------------------------------------------------------
+void restore_handlers(void) {
+    for(size_t index = 0; index < HANDLED_SIGNALS_COUNT; index++)
+        sigaction(HANDLED_SIGNALS[index], &signal_dumps.previous[index], NULL);
+}
+
+//------------------------------------------------------------------------------
+//STOPS DUMP THREAD AND CLOSES FILES, HANDLERS ARE ALREADY RESTORED
+//------------------------------------------------------------------------------
+stack_error_t stop_thread(void) {
+    __atomic_store_n(&signal_dumps.running, false, __ATOMIC_RELEASE);
+    uint64_t wakeup = 1;
+    if(write(signal_dumps.wakeup_fd, &wakeup, sizeof(wakeup)) != sizeof(wakeup))
+        return STACK_IO_ERROR;
+
+    pthread_join(signal_dumps.thread, NULL);
+    close(signal_dumps.wakeup_fd);
+
+    int snapshot_fd = signal_dumps.snapshot_fd;
+    __atomic_store_n(&signal_dumps.snapshot_fd, -1, __ATOMIC_RELEASE);
+    if(snapshot_fd >= 0)
+        close(snapshot_fd);
+    return STACK_SUCCESS;
+}
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "stack_trace.h"
+#include "custom_assert.h"
+
+//==============================================================================
+//TRACE FORMAT
+//SIGNATURE, THEN RECORDS: OPERATION BYTE AND LEB128 NUMBERS
+//STACK ID, ELEMENT SIZE, (CAPACITY FOR INIT ONLY), NANOSECONDS FROM LAST RECORD
+//==============================================================================
+static const char   TRACE_SIGNATURE[] = "STKTRC01";
+static const size_t TRACE_SIGNATURE_LENGTH = sizeof(TRACE_SIGNATURE) - 1;
+static const size_t TRACE_MAX_RECORD_LENGTH = 1 + 4 * 10;
+
+FILE *          stack_trace_file = NULL;
+static uint64_t last_timestamp   = 0;
+
+//==============================================================================
+//FUNCTIONS PROTOTYPES
+//==============================================================================
+static uint64_t      current_time_ns(void);
+static size_t        write_number   (unsigned char *buffer,
+                                     uint64_t       number);
+static stack_error_t read_number    (FILE *    trace,
+                                     uint64_t *number);
+
+//==============================================================================
+//GLOBAL FUNCTION
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//STARTS WRITING ALL STACK OPERATIONS TO TRACE FILE
+//------------------------------------------------------------------------------
+stack_error_t stack_trace_start(const char *filename) {
+    C_ASSERT(filename != NULL, return STACK_INVALID_INPUT);
+
+    if(stack_trace_file != NULL)
+        stack_trace_stop();
+
+    FILE *trace = fopen(filename, "wb");
+    if(trace == NULL)
+        return STACK_IO_ERROR;
+
+    if(fwrite(TRACE_SIGNATURE, 1, TRACE_SIGNATURE_LENGTH, trace) !=
+       TRACE_SIGNATURE_LENGTH) {
+        fclose(trace);
+        return STACK_IO_ERROR;
+    }
+
+    last_timestamp   = current_time_ns();
+    stack_trace_file = trace;
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//STOPS TRACING, MUST NOT BE CALLED WHILE STACKS ARE USED BY OTHER THREADS
+//------------------------------------------------------------------------------
+void stack_trace_stop(void) {
+    if(stack_trace_file == NULL)
+        return ;
+
+    FILE *trace = stack_trace_file;
+    stack_trace_file = NULL;
+    fclose(trace);
+}
+
+//------------------------------------------------------------------------------
+//WRITES OPERATION TO TRACE IF TRACING IS ON
+//------------------------------------------------------------------------------
+void stack_trace_record(stack_trace_op_t op,
+                        size_t           stack_id,
+                        size_t           element_size,
+                        size_t           capacity) {
+    FILE *trace = stack_trace_file;
+    if(trace == NULL)
+        return ;
+
+    unsigned char record[TRACE_MAX_RECORD_LENGTH] = {};
+    size_t length = 0;
+
+    flockfile(trace);
+
+    uint64_t timestamp = current_time_ns();
+    uint64_t delta     = timestamp - last_timestamp;
+    last_timestamp     = timestamp;
+
+    record[length++] = (unsigned char)op;
+    length += write_number(record + length, stack_id);
+    length += write_number(record + length, element_size);
+    if(op == STACK_TRACE_INIT)
+        length += write_number(record + length, capacity);
+    length += write_number(record + length, delta);
+
+    fwrite(record, 1, length, trace);
+
+    funlockfile(trace);
+}
+
+//------------------------------------------------------------------------------
+//CHECKS SIGNATURE OF TRACE WHICH IS READ
+//------------------------------------------------------------------------------
+stack_error_t stack_trace_open(FILE *trace) {
+    C_ASSERT(trace != NULL, return STACK_INVALID_INPUT);
+
+    char signature[sizeof(TRACE_SIGNATURE)] = {};
+    if(fread(signature, 1, TRACE_SIGNATURE_LENGTH, trace) != TRACE_SIGNATURE_LENGTH ||
+       memcmp(signature, TRACE_SIGNATURE, TRACE_SIGNATURE_LENGTH) != 0)
+        return STACK_INVALID_DATA;
+
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//READS NEXT RECORD, RETURNS STACK_EMPTY AT THE END OF TRACE
+//------------------------------------------------------------------------------
+stack_error_t stack_trace_read(FILE *                trace,
+                               stack_trace_record_t *record) {
+    C_ASSERT(trace  != NULL, return STACK_INVALID_INPUT );
+    C_ASSERT(record != NULL, return STACK_INVALID_OUTPUT);
+
+    int op = fgetc(trace);
+    if(op == EOF)
+        return STACK_EMPTY;
+    if(op > STACK_TRACE_ROLLBACK)
+        return STACK_INVALID_DATA;
+
+    memset(record, 0, sizeof(*record));
+    record->op = (stack_trace_op_t)op;
+
+    if(read_number(trace, &record->stack_id    ) != STACK_SUCCESS ||
+       read_number(trace, &record->element_size) != STACK_SUCCESS)
+        return STACK_INVALID_DATA;
+
+    if(record->op == STACK_TRACE_INIT &&
+       read_number(trace, &record->capacity) != STACK_SUCCESS)
+        return STACK_INVALID_DATA;
+
+    if(read_number(trace, &record->delta_ns) != STACK_SUCCESS)
+        return STACK_INVALID_DATA;
+
+    return STACK_SUCCESS;
+}
+
+//==============================================================================
+//STATIC FUNCTIONS
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//RETURNS MONOTONIC TIME IN NANOSECONDS
+//------------------------------------------------------------------------------
+uint64_t current_time_ns(void) {
+    struct timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+//WRITES NUMBER IN LEB128, RETURNS NUMBER OF WRITTEN BYTES
+//------------------------------------------------------------------------------
+size_t write_number(unsigned char *buffer,
+                    uint64_t       number) {
+    size_t length = 0;
+    while(number >= 0x80) {
+        buffer[length++] = (unsigned char)(number | 0x80);
+        number >>= 7;
+    }
+    buffer[length++] = (unsigned char)number;
+    return length;
+}
+
+//------------------------------------------------------------------------------
+//READS NUMBER IN LEB128
+//------------------------------------------------------------------------------
+stack_error_t read_number(FILE *    trace,
+                          uint64_t *number) {
+    *number = 0;
+    for(unsigned shift = 0; shift < 64; shift += 7) {
+        int byte = fgetc(trace);
+        if(byte == EOF)
+            return STACK_INVALID_DATA;
+
+        *number |= (uint64_t)(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0)
+            return STACK_SUCCESS;
+    }
+    return STACK_INVALID_DATA;
+}
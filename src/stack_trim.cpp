@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+
+#include "stack.h"
+#include "stack_internal.h"
+#include "stack_trim.h"
+#include "custom_assert.h"
+
+//==============================================================================
+//STATE OF ONE stack_trim_all CALL
+//==============================================================================
+struct trim_pass_t {
+    uint64_t now_ns;
+    uint64_t idle_ns;
+    size_t   candidates;
+    bool     barrier_failed;
+    size_t   released_bytes;
+    size_t   page_size;
+};
+
+//==============================================================================
+//TRIMMER STATE, STOP AND MEMORY PRESSURE ARE SIGNALED WITH wakeup_fd (EVENTFD)
+//==============================================================================
+struct stack_trimmer_t {
+    pthread_t thread;
+    bool      running;
+    int       wakeup_fd;
+    int       pressure_fd; //-1 if pressure file is not watched
+    size_t    idle_ms;
+    size_t    interval_ms;
+};
+
+static stack_trimmer_t trimmer = {};
+
+//==============================================================================
+//MEMBARRIER IS REGISTERED BY FIRST stack_trim_all, REGISTRY LOCK GUARDS IT
+//==============================================================================
+static bool membarrier_registered = false;
+
+//==============================================================================
+//FUNCTIONS PROTOTYPES
+//==============================================================================
+static stack_error_t trim_mark     (stack_t *stack,
+                                    void *   context);
+static stack_error_t trim_release  (stack_t *stack,
+                                    void *   context);
+static size_t        release_pages (char *   start,
+                                    char *   end,
+                                    size_t   page_size);
+static bool          trim_barrier  (void);
+static uint64_t      monotonic_ns  (void);
+static void *        trimmer_thread(void *   argument);
+
+//==============================================================================
+//GLOBAL FUNCTION
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//RELEASES PAGES OF IDLE STACKS IN THREE STEPS UNDER REGISTRY LOCK:
+//IDLE STACKS ARE MARKED AS TRIMMING, MEMBARRIER MAKES WRITERS WHICH HAVE
+//STARTED VISIBLE, PAGES OF STACKS WHICH ARE STILL NOT CHANGED ARE RELEASED
+//------------------------------------------------------------------------------
+stack_error_t stack_trim_all(size_t  idle_ms,
+                             size_t *released_bytes) {
+    trim_pass_t pass = {};
+    pass.now_ns    = monotonic_ns();
+    pass.idle_ns   = (uint64_t)idle_ms * 1000000;
+    pass.page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+    stack_registry_lock();
+    stack_registry_for_each_locked(trim_mark, &pass);
+    if(pass.candidates != 0) {
+        pass.barrier_failed = !trim_barrier();
+        stack_registry_for_each_locked(trim_release, &pass);
+    }
+    stack_registry_unlock();
+
+    if(released_bytes != NULL)
+        *released_bytes = pass.released_bytes;
+    return pass.barrier_failed ? STACK_UNEXPECTED_ERROR : STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//STARTS TRIMMER THREAD, IT WATCHES PRESSURE FILE IF IT IS GIVEN
+//------------------------------------------------------------------------------
+stack_error_t stack_trimmer_start(size_t      idle_ms,
+                                  size_t      interval_ms,
+                                  const char *pressure_file,
+                                  const char *pressure_trigger) {
+    C_ASSERT_ALWAYS(interval_ms != 0, return STACK_INVALID_INPUT);
+    C_ASSERT(pressure_file == NULL || pressure_trigger != NULL,
+             return STACK_INVALID_INPUT);
+
+    if(__atomic_load_n(&trimmer.running, __ATOMIC_ACQUIRE))
+        return STACK_UNEXPECTED_ERROR;
+
+    trimmer.pressure_fd = -1;
+    if(pressure_file != NULL) {
+        trimmer.pressure_fd = open(pressure_file, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if(trimmer.pressure_fd < 0)
+            return STACK_IO_ERROR;
+
+        size_t trigger_length = strlen(pressure_trigger) + 1;
+        if(write(trimmer.pressure_fd,
+                 pressure_trigger,
+                 trigger_length) != (ssize_t)trigger_length) {
+            close(trimmer.pressure_fd);
+            return STACK_IO_ERROR;
+        }
+    }
+
+    trimmer.wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(trimmer.wakeup_fd < 0) {
+        if(trimmer.pressure_fd >= 0)
+            close(trimmer.pressure_fd);
+        return STACK_IO_ERROR;
+    }
+
+    trimmer.idle_ms     = idle_ms;
+    trimmer.interval_ms = interval_ms;
+    __atomic_store_n(&trimmer.running, true, __ATOMIC_RELEASE);
+
+    if(pthread_create(&trimmer.thread, NULL, trimmer_thread, NULL) != 0) {
+        __atomic_store_n(&trimmer.running, false, __ATOMIC_RELEASE);
+        close(trimmer.wakeup_fd);
+        if(trimmer.pressure_fd >= 0)
+            close(trimmer.pressure_fd);
+        return STACK_UNEXPECTED_ERROR;
+    }
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//STOPS TRIMMER THREAD
+//------------------------------------------------------------------------------
+stack_error_t stack_trimmer_stop(void) {
+    if(!__atomic_load_n(&trimmer.running, __ATOMIC_ACQUIRE))
+        return STACK_UNEXPECTED_ERROR;
+
+    __atomic_store_n(&trimmer.running, false, __ATOMIC_RELEASE);
+    uint64_t wakeup = 1;
+    if(write(trimmer.wakeup_fd, &wakeup, sizeof(wakeup)) != sizeof(wakeup))
+        return STACK_IO_ERROR;
+
+    pthread_join(trimmer.thread, NULL);
+    close(trimmer.wakeup_fd);
+    if(trimmer.pressure_fd >= 0)
+        close(trimmer.pressure_fd);
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//WAKES TRIMMER, IT TRIMS ALL STACKS AT ONCE, ONLY write IS CALLED HERE,
+//SO IT CAN BE CALLED FROM SIGNAL HANDLER OR OTHER PRESSURE MONITOR
+//------------------------------------------------------------------------------
+stack_error_t stack_memory_pressure(void) {
+    if(!__atomic_load_n(&trimmer.running, __ATOMIC_ACQUIRE))
+        return STACK_UNEXPECTED_ERROR;
+
+    uint64_t wakeup = 1;
+    if(write(trimmer.wakeup_fd, &wakeup, sizeof(wakeup)) != sizeof(wakeup))
+        return STACK_IO_ERROR;
+    return STACK_SUCCESS;
+}
+
+//==============================================================================
+//FUNCTIONS SHARED BETWEEN STACK MODULES
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//WAITS UNTIL stack_trim_all HAS RELEASED PAGES OF STACK
+//------------------------------------------------------------------------------
+void stack_wait_trim(stack_t *stack) {
+    while(__atomic_load_n(&stack->trimming, __ATOMIC_ACQUIRE))
+        sched_yield();
+}
+
+//==============================================================================
+//STATIC FUNCTIONS
+//==============================================================================
+
+//------------------------------------------------------------------------------
+//REMEMBERS VERSION OF STACK, MARKS STACK WHICH HAS NOT CHANGED FOR idle_ns
+//------------------------------------------------------------------------------
+stack_error_t trim_mark(stack_t *stack,
+                        void *   context) {
+    trim_pass_t *pass    = (trim_pass_t *)context;
+    size_t       version = __atomic_load_n(&stack->version, __ATOMIC_ACQUIRE);
+
+    //pages of custom allocator (hugepage pool, arena) are managed by it
+    if(stack->allocator.allocate != NULL)
+        return STACK_SUCCESS;
+
+    if(version != stack->trim_version) {
+        stack->trim_version  = version;
+        stack->idle_since_ns = pass->now_ns;
+        stack->trimmed       = false;
+    }
+
+    if(version % 2 != 0 || stack->trimmed ||
+       pass->now_ns - stack->idle_since_ns < pass->idle_ns)
+        return STACK_SUCCESS;
+
+    __atomic_store_n(&stack->trimming, true, __ATOMIC_RELAXED);
+    pass->candidates++;
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//RELEASES PAGES AFTER max(size, init_capacity) ELEMENTS OF MARKED STACK,
+//STACK WHICH WAS CHANGED AFTER trim_mark IS LEFT FOR NEXT PASS
+//------------------------------------------------------------------------------
+stack_error_t trim_release(stack_t *stack,
+                           void *   context) {
+    trim_pass_t *pass = (trim_pass_t *)context;
+    if(!__atomic_load_n(&stack->trimming, __ATOMIC_RELAXED))
+        return STACK_SUCCESS;
+
+    if(!pass->barrier_failed &&
+       __atomic_load_n(&stack->version, __ATOMIC_ACQUIRE) == stack->trim_version) {
+        size_t kept = stack->size > stack->init_capacity ? stack->size :
+                                                           stack->init_capacity;
+        size_t used = kept            * stack->element_size,
+               all  = stack->capacity * stack->element_size;
+
+        if(used < all) {
+            pass->released_bytes += release_pages(stack->data + used,
+                                                  stack->data + all,
+                                                  pass->page_size);
+            if(stack->aggregates != NULL)
+                pass->released_bytes += release_pages(stack->aggregates + used,
+                                                      stack->aggregates + all,
+                                                      pass->page_size);
+        }
+        stack->trimmed = true;
+    }
+
+    __atomic_store_n(&stack->trimming, false, __ATOMIC_RELEASE);
+    return STACK_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//RELEASES WHOLE PAGES BETWEEN start AND end, THEY ARE READ AS ZEROES LATER,
+//SAME AS SLOTS WHICH ARE NOT USED
+//------------------------------------------------------------------------------
+size_t release_pages(char * start,
+                     char * end,
+                     size_t page_size) {
+    uintptr_t first = ((uintptr_t)start + page_size - 1) / page_size * page_size,
+              last  = (uintptr_t)end / page_size * page_size;
+    if(last <= first)
+        return 0;
+
+    if(madvise((void *)first, last - first, MADV_DONTNEED) != 0)
+        return 0;
+    return last - first;
+}
+
+//------------------------------------------------------------------------------
+//EXECUTES MEMORY BARRIER ON ALL THREADS OF PROCESS, SO WRITERS DO NOT NEED
+//REAL FENCE BETWEEN VERSION STORE AND trimming LOAD
+//------------------------------------------------------------------------------
+bool trim_barrier(void) {
+    if(!membarrier_registered) {
+        if(syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) != 0)
+            return false;
+        membarrier_registered = true;
+    }
+    return syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) == 0;
+}
+
+//------------------------------------------------------------------------------
+//RETURNS MONOTONIC TIME IN NANOSECONDS
+//------------------------------------------------------------------------------
+uint64_t monotonic_ns(void) {
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+//TRIMS IDLE STACKS EVERY INTERVAL AND ALL STACKS ON MEMORY PRESSURE
+//------------------------------------------------------------------------------
+void *trimmer_thread(void *) {
+    while(__atomic_load_n(&trimmer.running, __ATOMIC_ACQUIRE)) {
+        struct pollfd watched[2] = {};
+        watched[0].fd     = trimmer.wakeup_fd;
+        watched[0].events = POLLIN;
+        watched[1].fd     = trimmer.pressure_fd;
+        watched[1].events = POLLPRI;
+
+        nfds_t watched_count = trimmer.pressure_fd >= 0 ? 2 : 1;
+        int    ready         = poll(watched, watched_count, (int)trimmer.interval_ms);
+        if(!__atomic_load_n(&trimmer.running, __ATOMIC_ACQUIRE))
+            break;
+
+        bool pressure = false;
+        if(ready > 0 && (watched[0].revents & POLLIN) != 0) {
+            uint64_t wakeups = 0;
+            if(read(trimmer.wakeup_fd, &wakeups, sizeof(wakeups)) == sizeof(wakeups))
+                pressure = true;
+        }
+        if(ready > 0 && watched_count == 2) {
+            if((watched[1].revents & POLLPRI) != 0)
+                pressure = true;
+            //pressure file was removed (cgroup is gone), only idle time is left
+            if((watched[1].revents & (POLLERR | POLLNVAL)) != 0) {
+                close(trimmer.pressure_fd);
+                trimmer.pressure_fd = -1;
+            }
+        }
+
+        stack_trim_all(pressure ? 0 : trimmer.idle_ms, NULL);
+    }
+    return NULL;
+}
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "stack.h"
+#include "stack_combining.h"
+
+static const size_t THREADS    = 4;
+static const size_t PER_THREAD = 5000;
+static const size_t POPPED     = PER_THREAD / 2; //every thread pops after each second push
+
+struct thread_state_t {
+    stack_combining_t *stack;
+    size_t             index;
+    uint64_t *         popped; //POPPED values which this thread got
+    bool               failed;
+};
+
+int fprintf_value(FILE *file, void *value);
+
+int fprintf_value(FILE *file, void *value) {
+    return fprintf(file, "%llx", (unsigned long long)*(uint64_t *)value);
+}
+
+static void *push_and_pop(void *argument);
+static bool  account     (bool *seen, uint64_t value);
+
+// EVERY VALUE PUSHED BY MANY THREADS IS POPPED EXACTLY ONCE
+int main(void) {
+    stack_combining_t *stack = stack_combining_init(DUMP_INIT("test_combining.log", stack, fprintf_value)
+                                                    4, sizeof(uint64_t));
+    uint64_t *popped = (uint64_t *)calloc(THREADS * POPPED, sizeof(uint64_t));
+    bool *    seen   = (bool *)    calloc(THREADS * PER_THREAD, sizeof(bool));
+    if(stack == NULL || popped == NULL || seen == NULL) {
+        printf("Initializing error\n");
+        return EXIT_FAILURE;
+    }
+
+    //stack starts small, so combiners also grow it while others wait
+    pthread_t      threads[THREADS] = {};
+    thread_state_t states [THREADS] = {};
+    for(size_t index = 0; index < THREADS; index++) {
+        states[index] = {stack, index, popped + index * POPPED, false};
+        if(pthread_create(&threads[index], NULL, push_and_pop, &states[index]) != 0) {
+            printf("Thread creating error\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    for(size_t index = 0; index < THREADS; index++) {
+        pthread_join(threads[index], NULL);
+        if(states[index].failed) {
+            printf("Thread %zu got error from combining stack\n", index);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for(size_t index = 0; index < THREADS * POPPED; index++) {
+        if(!account(seen, popped[index])) {
+            printf("Value %llx was popped twice or was never pushed\n",
+                   (unsigned long long)popped[index]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    //values which are left in stack are popped by one thread
+    size_t   left  = 0;
+    uint64_t value = 0;
+    while(stack_combining_pop(stack, &value) == STACK_SUCCESS) {
+        if(!account(seen, value)) {
+            printf("Value %llx was popped twice or was never pushed\n",
+                   (unsigned long long)value);
+            return EXIT_FAILURE;
+        }
+        left++;
+    }
+    if(left != THREADS * (PER_THREAD - POPPED)) {
+        printf("%zu values were left in stack instead of %zu\n",
+               left, THREADS * (PER_THREAD - POPPED));
+        return EXIT_FAILURE;
+    }
+
+    if(stack_combining_destroy(&stack) != STACK_SUCCESS) {
+        printf("Destroying error\n");
+        return EXIT_FAILURE;
+    }
+
+    free(popped);
+    free(seen);
+    printf("test_combining passed\n");
+    return EXIT_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//PUSHES PER_THREAD VALUES OF THREAD, POPS ONE VALUE AFTER EVERY SECOND PUSH,
+//SO STACK IS NEVER EMPTY WHEN THREAD POPS
+//------------------------------------------------------------------------------
+void *push_and_pop(void *argument) {
+    thread_state_t *state = (thread_state_t *)argument;
+
+    size_t popped = 0;
+    for(size_t element = 0; element < PER_THREAD; element++) {
+        uint64_t value = state->index * PER_THREAD + element;
+        if(stack_combining_push(state->stack, &value) != STACK_SUCCESS) {
+            state->failed = true;
+            return NULL;
+        }
+
+        if(element % 2 == 1) {
+            if(stack_combining_pop(state->stack, &state->popped[popped++]) != STACK_SUCCESS) {
+                state->failed = true;
+                return NULL;
+            }
+        }
+    }
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+//MARKS VALUE AS POPPED, RETURNS FALSE IF IT WAS NOT PUSHED OR WAS POPPED BEFORE
+//------------------------------------------------------------------------------
+bool account(bool *seen, uint64_t value) {
+    if(value >= THREADS * PER_THREAD || seen[value])
+        return false;
+
+    seen[value] = true;
+    return true;
+}
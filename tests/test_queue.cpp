@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "stack.h"
+#include "queue.h"
+
+static const size_t CAPACITY = 6; //rounded up to 8
+static const size_t VALUES   = 20000;
+static const size_t BATCH    = 5;
+
+int fprintf_value(FILE *file, void *value);
+
+int fprintf_value(FILE *file, void *value) {
+    return fprintf(file, "%llu", (unsigned long long)*(uint64_t *)value);
+}
+
+static void *produce(void *argument);
+
+// VALUES ARE DEQUEUED IN ORDER IN WHICH OTHER THREAD ENQUEUED THEM
+int main(void) {
+    queue_t *queue = queue_init(DUMP_INIT("test_queue.log", queue, fprintf_value) CAPACITY, sizeof(uint64_t));
+    if(queue == NULL) {
+        printf("Queue initializing error\n");
+        return EXIT_FAILURE;
+    }
+
+    //full and empty queue give errors and keep their elements
+    uint64_t value = 0;
+    if(queue_dequeue(queue, &value) != STACK_EMPTY) {
+        printf("Empty queue was dequeued\n");
+        return EXIT_FAILURE;
+    }
+    for(value = 0; queue_enqueue(queue, &value) == STACK_SUCCESS; value++)
+        ;
+    if(value != 8 || queue_size(queue) != 8) {
+        printf("Queue took %llu values instead of 8\n", (unsigned long long)value);
+        return EXIT_FAILURE;
+    }
+    for(uint64_t expected = 0; expected < 8; expected++) {
+        if(queue_dequeue(queue, &value) != STACK_SUCCESS || value != expected) {
+            printf("Value %llu was dequeued out of order\n", (unsigned long long)expected);
+            return EXIT_FAILURE;
+        }
+    }
+
+    //producer is faster than one element at a time, so queue gets full often
+    pthread_t producer = {};
+    if(pthread_create(&producer, NULL, produce, queue) != 0) {
+        printf("Thread creating error\n");
+        return EXIT_FAILURE;
+    }
+
+    uint64_t expected     = 0;
+    uint64_t batch[BATCH] = {};
+    while(expected < VALUES) {
+        size_t        dequeued      = 0;
+        stack_error_t dequeue_state = STACK_SUCCESS;
+        if(expected % 2 == 0) {
+            dequeue_state = queue_dequeue(queue, batch);
+            dequeued      = dequeue_state == STACK_SUCCESS ? 1 : 0;
+        }
+        else
+            dequeue_state = queue_dequeue_batch(queue, batch, BATCH, &dequeued);
+
+        if(dequeue_state != STACK_SUCCESS && dequeue_state != STACK_EMPTY) {
+            printf("Dequeue error %d\n", dequeue_state);
+            return EXIT_FAILURE;
+        }
+        if(dequeued == 0) {
+            sched_yield();
+            continue;
+        }
+        for(size_t index = 0; index < dequeued; index++, expected++) {
+            if(batch[index] != expected) {
+                printf("Value %llu was dequeued instead of %llu\n",
+                       (unsigned long long)batch[index], (unsigned long long)expected);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    void *produce_state = NULL;
+    pthread_join(producer, &produce_state);
+    if(produce_state != NULL || queue_size(queue) != 0) {
+        printf("Producer got error or queue is not empty\n");
+        return EXIT_FAILURE;
+    }
+
+    if(queue_destroy(&queue) != STACK_SUCCESS) {
+        printf("Destroying error\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("test_queue passed\n");
+    return EXIT_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//ENQUEUES VALUES 0, 1, ... ONE BY ONE AND IN BATCHES, WAITS WHILE QUEUE IS FULL
+//RETURNS NON NULL ON ERROR
+//------------------------------------------------------------------------------
+void *produce(void *argument) {
+    queue_t *queue = (queue_t *)argument;
+
+    uint64_t batch[BATCH] = {};
+    uint64_t next         = 0;
+    while(next < VALUES) {
+        size_t count = VALUES - next < BATCH ? VALUES - next : BATCH;
+        for(size_t index = 0; index < count; index++)
+            batch[index] = next + index;
+
+        size_t        enqueued      = 0;
+        stack_error_t enqueue_state = STACK_SUCCESS;
+        if(next % 3 == 0) {
+            enqueue_state = queue_enqueue(queue, batch);
+            enqueued      = enqueue_state == STACK_SUCCESS ? 1 : 0;
+        }
+        else
+            enqueue_state = queue_enqueue_batch(queue, batch, count, &enqueued);
+
+        if(enqueue_state != STACK_SUCCESS && enqueue_state != STACK_FULL)
+            return argument;
+        if(enqueued == 0)
+            sched_yield();
+        next += enqueued;
+    }
+    return NULL;
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stack.h"
+
+int fprintf_byte(FILE *file, void *byte);
+
+int fprintf_byte(FILE *file, void *byte) {
+    return fprintf(file, "%02x", *(unsigned char *)byte);
+}
+
+// ROLLBACK OF STACK OF ELEMENTS WITH DIFFERENT SIZES ACCEPTS ONLY RECORD BOUNDARIES
+int main(void) {
+    stack_t *stack = stack_init_bytes(DUMP_INIT("test_rollback.log", stack, fprintf_byte) 64);
+    if(stack == NULL) {
+        printf("Stack initializing error\n");
+        return EXIT_FAILURE;
+    }
+
+    char first[] = "first";
+    if(stack_push_bytes(&stack, first, sizeof(first)) != STACK_SUCCESS) {
+        printf("Push error\n");
+        return EXIT_FAILURE;
+    }
+
+    stack_mark_t mark = 0;
+    if(stack_mark(&stack, &mark) != STACK_SUCCESS) {
+        printf("Mark error\n");
+        return EXIT_FAILURE;
+    }
+
+    char second[] = "second record";
+    char third[]  = "3";
+    if(stack_push_bytes(&stack, second, sizeof(second)) != STACK_SUCCESS ||
+       stack_push_bytes(&stack, third,  sizeof(third))  != STACK_SUCCESS) {
+        printf("Push error\n");
+        return EXIT_FAILURE;
+    }
+
+    //marks inside records and inside length footers are rejected, stack is kept
+    stack_mark_t broken_marks[] = {mark + 1, mark + sizeof(second), mark + sizeof(second) + 3};
+    for(size_t index = 0; index < sizeof(broken_marks) / sizeof(broken_marks[0]); index++) {
+        if(stack_rollback(&stack, broken_marks[index]) != STACK_INVALID_INPUT || stack == NULL) {
+            printf("Rollback to %zu inside record was not rejected\n", broken_marks[index]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    char   output[32] = {};
+    size_t length     = sizeof(output);
+    if(stack_pop_bytes(&stack, output, &length) != STACK_SUCCESS ||
+       length != sizeof(third) || memcmp(output, third, length) != 0) {
+        printf("Stack was changed by rejected rollback\n");
+        return EXIT_FAILURE;
+    }
+
+    if(stack_push_bytes(&stack, third, sizeof(third)) != STACK_SUCCESS ||
+       stack_rollback(&stack, mark) != STACK_SUCCESS) {
+        printf("Rollback to record boundary error\n");
+        return EXIT_FAILURE;
+    }
+
+    length = sizeof(output);
+    if(stack_pop_bytes(&stack, output, &length) != STACK_SUCCESS ||
+       length != sizeof(first) || memcmp(output, first, length) != 0) {
+        printf("Record below mark was changed by rollback\n");
+        return EXIT_FAILURE;
+    }
+
+    length = sizeof(output);
+    if(stack_pop_bytes(&stack, output, &length) != STACK_EMPTY) {
+        printf("Stack is not empty after rollback and pop\n");
+        return EXIT_FAILURE;
+    }
+
+    if(stack_destroy(&stack) != STACK_SUCCESS) {
+        printf("Destroying error\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("test_rollback passed\n");
+    return EXIT_SUCCESS;
+}
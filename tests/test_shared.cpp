@@ -0,0 +1,90 @@
+//<sys/wait.h> includes <signal.h>, which defines POSIX stack_t (sigaltstack),
+//it is renamed here, so it does not clash with stack_t of this library
+#define stack_t signal_stack_t
+#include <sys/wait.h>
+#undef stack_t
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "stack.h"
+#include "stack_shared.h"
+
+static const size_t CAPACITY = 128;
+static const size_t PUSHED   = 100;
+
+int fprintf_value(FILE *file, void *value);
+
+int fprintf_value(FILE *file, void *value) {
+    return fprintf(file, "%llu", (unsigned long long)*(uint64_t *)value);
+}
+
+// SEGMENT LEFT BY DEAD CREATOR IS CREATED AGAIN, OTHER PROCESS ATTACHES BY NAME
+int main(void) {
+    char name[64] = {};
+    snprintf(name, sizeof(name), "/test_shared_%d", (int)getpid());
+
+    //creator which died after sizing segment never wrote its magic
+    int stale_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(stale_fd < 0 || ftruncate(stale_fd, 4096) != 0) {
+        printf("Stale segment creating error\n");
+        return EXIT_FAILURE;
+    }
+    close(stale_fd);
+
+    stack_shared_t *stack = stack_shared_open(DUMP_INIT("test_shared.log", stack, fprintf_value)
+                                              name, CAPACITY, sizeof(uint64_t));
+    if(stack == NULL || stack_shared_size(stack) != 0) {
+        printf("Stale segment was not created again\n");
+        stack_shared_unlink(name);
+        return EXIT_FAILURE;
+    }
+
+    //child opens segment by name while parent keeps it mapped
+    pid_t child = fork();
+    if(child < 0) {
+        printf("Fork error\n");
+        stack_shared_unlink(name);
+        return EXIT_FAILURE;
+    }
+    if(child == 0) {
+        stack_shared_t *child_stack = stack_shared_open(DUMP_INIT("test_shared.log", child_stack, fprintf_value)
+                                                        name, CAPACITY, sizeof(uint64_t));
+        if(child_stack == NULL)
+            _exit(EXIT_FAILURE);
+        for(uint64_t value = 0; value < PUSHED; value++)
+            if(stack_shared_push(child_stack, &value) != STACK_SUCCESS)
+                _exit(EXIT_FAILURE);
+        _exit(stack_shared_close(&child_stack) == STACK_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status = 0;
+    if(waitpid(child, &status, 0) != child || !WIFEXITED(status) ||
+       WEXITSTATUS(status) != EXIT_SUCCESS) {
+        printf("Child could not push to segment\n");
+        stack_shared_unlink(name);
+        return EXIT_FAILURE;
+    }
+
+    for(uint64_t expected = PUSHED; expected-- > 0;) {
+        uint64_t value = 0;
+        if(stack_shared_pop(stack, &value) != STACK_SUCCESS || value != expected) {
+            printf("Value %llu pushed by child was lost\n", (unsigned long long)expected);
+            stack_shared_unlink(name);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(stack_shared_unlink(name) != STACK_SUCCESS ||
+       stack_shared_close(&stack) != STACK_SUCCESS) {
+        printf("Closing error\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("test_shared passed\n");
+    return EXIT_SUCCESS;
+}
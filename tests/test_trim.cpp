@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stack.h"
+#include "stack_trim.h"
+
+static const size_t STACKS        = 3;
+static const size_t INIT_CAPACITY = 4;
+static const size_t PUSHED        = 37; //stack grows twice from 4 to 64 elements
+static const size_t CAPACITY      = 64;
+
+int fprintf_page(FILE *file, void *page);
+
+int fprintf_page(FILE *file, void *page) {
+    return fprintf(file, "%02x", *(unsigned char *)page);
+}
+
+static void fill_page(char *page, size_t page_size, size_t stack_index, size_t element_index);
+static bool push_pages(stack_t **stack, char *page, size_t page_size, size_t stack_index,
+                       size_t first, size_t last);
+
+// PAGES AFTER SIZE OF IDLE STACKS ARE RELEASED, ELEMENTS ARE KEPT
+int main(void) {
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    char * page      = (char *)calloc(2, page_size);
+    char * popped    = page + page_size;
+    if(page == NULL) {
+        printf("Page allocating error\n");
+        return EXIT_FAILURE;
+    }
+
+    //every element is one page, stacks never shrink, so pages after size stay
+    //allocated until they are trimmed
+    stack_t *stacks[STACKS] = {};
+    for(size_t index = 0; index < STACKS; index++) {
+        stacks[index] = stack_init(DUMP_INIT("test_trim.log", stacks[index], fprintf_page) INIT_CAPACITY, page_size);
+        if(stacks[index] == NULL ||
+           stack_set_growth_policy(&stacks[index], 2, 0, 2) != STACK_SUCCESS ||
+           !push_pages(&stacks[index], page, page_size, index, 0, PUSHED)) {
+            printf("Stack filling error\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    //data of stack starts after its header, so first unused page may be cut
+    size_t released_bytes = 0;
+    if(stack_trim_all(0, &released_bytes) != STACK_SUCCESS) {
+        printf("Trim error\n");
+        return EXIT_FAILURE;
+    }
+    if(released_bytes < STACKS * (CAPACITY - PUSHED - 1) * page_size ||
+       released_bytes > STACKS * (CAPACITY - PUSHED)     * page_size) {
+        printf("Trim released %zu bytes\n", released_bytes);
+        return EXIT_FAILURE;
+    }
+
+    if(stack_trim_all(0, &released_bytes) != STACK_SUCCESS || released_bytes != 0) {
+        printf("Trimmed stacks were trimmed again, %zu bytes\n", released_bytes);
+        return EXIT_FAILURE;
+    }
+
+    //simulated memory pressure trims changed stacks without waiting idle time
+    if(stack_trimmer_start(3600000, 3600000, NULL, NULL) != STACK_SUCCESS) {
+        printf("Trimmer starting error\n");
+        return EXIT_FAILURE;
+    }
+    for(size_t index = 0; index < STACKS; index++) {
+        if(!push_pages(&stacks[index], page, page_size, index, PUSHED, PUSHED + 1)) {
+            printf("Push error\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if(stack_memory_pressure() != STACK_SUCCESS) {
+        printf("Memory pressure error\n");
+        return EXIT_FAILURE;
+    }
+    usleep(200000);
+    if(stack_trimmer_stop() != STACK_SUCCESS) {
+        printf("Trimmer stopping error\n");
+        return EXIT_FAILURE;
+    }
+
+    if(stack_trim_all(0, &released_bytes) != STACK_SUCCESS || released_bytes != 0) {
+        printf("Memory pressure did not trim stacks, %zu bytes left\n", released_bytes);
+        return EXIT_FAILURE;
+    }
+
+    for(size_t index = 0; index < STACKS; index++) {
+        for(size_t element = PUSHED + 1; element-- > 0;) {
+            fill_page(page, page_size, index, element);
+            if(stack_pop(&stacks[index], popped) != STACK_SUCCESS ||
+               memcmp(page, popped, page_size) != 0) {
+                printf("Element %zu of stack %zu was lost\n", element, index);
+                return EXIT_FAILURE;
+            }
+        }
+
+        if(stack_destroy(&stacks[index]) != STACK_SUCCESS) {
+            printf("Destroying error\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    free(page);
+    printf("test_trim passed\n");
+    return EXIT_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+//FILLS ELEMENT WITH BYTES WHICH DEPEND ON STACK AND ELEMENT
+//------------------------------------------------------------------------------
+void fill_page(char *page, size_t page_size, size_t stack_index, size_t element_index) {
+    for(size_t byte = 0; byte < page_size; byte++)
+        page[byte] = (char)(stack_index * 131 + element_index * 7 + byte);
+}
+
+//------------------------------------------------------------------------------
+//PUSHES ELEMENTS [first, last) OF STACK
+//------------------------------------------------------------------------------
+bool push_pages(stack_t **stack, char *page, size_t page_size, size_t stack_index,
+                size_t first, size_t last) {
+    for(size_t element = first; element < last; element++) {
+        fill_page(page, page_size, stack_index, element);
+        if(stack_push(stack, page) != STACK_SUCCESS)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,466 @@
+//<sys/wait.h> includes <signal.h>, which defines POSIX stack_t (sigaltstack),
+//it is renamed here, so it does not clash with stack_t of this library
+#define stack_t signal_stack_t
+#include <sys/wait.h>
+#undef stack_t
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "stack.h"
+#include "stack_trace.h"
+
+//==============================================================================
+//REPLAYS TRACE WRITTEN BY stack_trace_start AGAINST CURRENT BUILD OF STACK
+//PROTECTION MODES ARE CHOSEN WHEN LIBRARY IS BUILT (-DSTACK_NO_<MODE>),
+//GROWTH POLICY AND ALLOCATOR ARE PASSED IN ARGUMENTS, TRACE IS REPLAYED ONCE
+//WITH EVERY CHOSEN ALLOCATOR, EVERY REPLAY RUNS IN ITS OWN CHILD PROCESS, SO
+//PEAK MEMORY IS MEASURED FOR EACH ALLOCATOR SEPARATELY
+//
+//usage: replay.exe trace_file [grow_factor shrink_threshold shrink_factor]
+//                             [default | arena | all]
+//==============================================================================
+
+struct replay_trace_t {
+    stack_trace_record_t *records;
+    size_t                count;
+    size_t                stacks_number;
+    size_t                max_element_size;
+};
+
+struct replay_policy_t {
+    size_t grow_factor;
+    size_t shrink_threshold;
+    size_t shrink_factor;
+};
+
+struct replay_latencies_t {
+    uint64_t *values;
+    size_t    count;
+};
+
+//==============================================================================
+//ARENA ALLOCATOR, MEMORY IS TAKEN FROM BLOCKS BY MOVING POINTER, RELEASE DOES
+//NOTHING, ALL BLOCKS ARE FREED AFTER REPLAY
+//==============================================================================
+static const size_t ARENA_BLOCK_SIZE = 1 << 24;
+
+struct replay_arena_block_t {
+    replay_arena_block_t *next;
+    size_t                size;
+    size_t                used;
+};
+
+struct replay_arena_t {
+    replay_arena_block_t *blocks;
+    size_t                reserved;
+};
+
+struct replay_allocator_t {
+    const char *name;
+    bool        arena; //stacks are created with stack_init_allocator
+};
+
+static const replay_allocator_t REPLAY_ALLOCATORS[] = {
+    {"default", false},
+    {"arena"  , true },
+};
+
+static int      print_byte       (FILE *file, void *byte);
+static int      read_trace       (const char *filename, replay_trace_t *trace);
+static int      replay_allocator (const replay_trace_t *    trace,
+                                  const replay_policy_t *   policy,
+                                  const replay_allocator_t *choice,
+                                  replay_latencies_t *      push_latencies,
+                                  replay_latencies_t *      pop_latencies);
+static int      replay           (const replay_trace_t *    trace,
+                                  const replay_policy_t *   policy,
+                                  const stack_allocator_t * allocator,
+                                  replay_latencies_t *      push_latencies,
+                                  replay_latencies_t *      pop_latencies,
+                                  uint64_t *                total_ns);
+static void *   arena_allocate   (void *context, size_t size, size_t alignment);
+static void     arena_release    (void *context, void *memory);
+static void     arena_free       (replay_arena_t *arena);
+static uint64_t current_time_ns  (void);
+static int      compare_latencies(const void *first, const void *second);
+static void     print_latencies  (const char *name, replay_latencies_t *latencies);
+
+int main(int argc, const char *argv[]) {
+    if(argc != 2 && argc != 3 && argc != 5 && argc != 6) {
+        printf("usage: %s trace_file [grow_factor shrink_threshold shrink_factor]\n"
+               "                       [default | arena | all]\n",
+               argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    replay_policy_t policy = {2, 4, 4};
+    if(argc >= 5) {
+        policy.grow_factor      = strtoull(argv[2], NULL, 10);
+        policy.shrink_threshold = strtoull(argv[3], NULL, 10);
+        policy.shrink_factor    = strtoull(argv[4], NULL, 10);
+    }
+
+    const char *allocator_name = argc == 3 || argc == 6 ? argv[argc - 1] : "all";
+    size_t allocators_number = sizeof(REPLAY_ALLOCATORS) / sizeof(REPLAY_ALLOCATORS[0]);
+    bool   allocator_found   = strcmp(allocator_name, "all") == 0;
+    for(size_t index = 0; index < allocators_number; index++)
+        if(strcmp(allocator_name, REPLAY_ALLOCATORS[index].name) == 0)
+            allocator_found = true;
+    if(!allocator_found) {
+        printf("Unknown allocator '%s'\n", allocator_name);
+        return EXIT_FAILURE;
+    }
+
+    replay_trace_t trace = {};
+    if(read_trace(argv[1], &trace) != 0) {
+        printf("Error reading trace '%s'\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    replay_latencies_t push_latencies = {(uint64_t *)calloc(trace.count + 1, sizeof(uint64_t)), 0};
+    replay_latencies_t pop_latencies  = {(uint64_t *)calloc(trace.count + 1, sizeof(uint64_t)), 0};
+    if(push_latencies.values == NULL || pop_latencies.values == NULL) {
+        printf("Memory error\n");
+        return EXIT_FAILURE;
+    }
+
+    for(size_t index = 0; index < allocators_number; index++) {
+        const replay_allocator_t *choice = REPLAY_ALLOCATORS + index;
+        if(strcmp(allocator_name, "all") != 0 &&
+           strcmp(allocator_name, choice->name) != 0)
+            continue;
+
+        //peak of child starts from pages of trace which it shares with
+        //parent, so it is same for all allocators, buffered output is
+        //written before fork, so child does not write it again
+        fflush(stdout);
+        pid_t child = fork();
+        if(child < 0) {
+            printf("Error starting replay with %s allocator\n", choice->name);
+            return EXIT_FAILURE;
+        }
+        if(child == 0) {
+            int replay_state = replay_allocator(&trace, &policy, choice,
+                                                &push_latencies, &pop_latencies);
+            fflush(stdout);
+            _exit(replay_state == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+
+        int           status = 0;
+        struct rusage usage  = {};
+        if(wait4(child, &status, 0, &usage) != child ||
+           !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            printf("Error replaying trace with %s allocator\n", choice->name);
+            return EXIT_FAILURE;
+        }
+
+        //stacks with variable size elements always use default allocator
+        printf("peak memory:     %ld KiB\n\n", usage.ru_maxrss);
+    }
+
+    free(push_latencies.values);
+    free(pop_latencies.values);
+    free(trace.records);
+    return EXIT_SUCCESS;
+}
+
+int print_byte(FILE *file, void *byte) {
+    return fprintf(file, "%02x", *(unsigned char *)byte);
+}
+
+//------------------------------------------------------------------------------
+//READS WHOLE TRACE TO MEMORY, SO FILE READING IS NOT MEASURED
+//------------------------------------------------------------------------------
+int read_trace(const char *filename, replay_trace_t *trace) {
+    FILE *file = fopen(filename, "rb");
+    if(file == NULL)
+        return -1;
+
+    if(stack_trace_open(file) != STACK_SUCCESS) {
+        fclose(file);
+        return -1;
+    }
+
+    size_t allocated = 1024;
+    trace->records = (stack_trace_record_t *)calloc(allocated, sizeof(stack_trace_record_t));
+    if(trace->records == NULL) {
+        fclose(file);
+        return -1;
+    }
+
+    stack_trace_record_t record = {};
+    stack_error_t read_state = STACK_SUCCESS;
+    while((read_state = stack_trace_read(file, &record)) == STACK_SUCCESS) {
+        if(trace->count == allocated) {
+            allocated *= 2;
+            stack_trace_record_t *records = (stack_trace_record_t *)realloc(trace->records,
+                                                                            allocated * sizeof(stack_trace_record_t));
+            if(records == NULL) {
+                fclose(file);
+                return -1;
+            }
+            trace->records = records;
+        }
+        trace->records[trace->count++] = record;
+
+        if(record.stack_id + 1 > trace->stacks_number)
+            trace->stacks_number = record.stack_id + 1;
+        if(record.op != STACK_TRACE_ROLLBACK &&
+           record.element_size > trace->max_element_size)
+            trace->max_element_size = record.element_size;
+    }
+    fclose(file);
+
+    if(read_state != STACK_EMPTY)
+        return -1;
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+//REPLAYS TRACE WITH ONE ALLOCATOR AND PRINTS ITS TIMES, RUNS IN CHILD PROCESS
+//------------------------------------------------------------------------------
+int replay_allocator(const replay_trace_t *    trace,
+                     const replay_policy_t *   policy,
+                     const replay_allocator_t *choice,
+                     replay_latencies_t *      push_latencies,
+                     replay_latencies_t *      pop_latencies) {
+    //arena does not reallocate, library allocates, copies and releases
+    replay_arena_t    arena     = {};
+    stack_allocator_t allocator = {arena_allocate, NULL, arena_release, &arena};
+
+    push_latencies->count = 0;
+    pop_latencies->count  = 0;
+    uint64_t total_ns = 0;
+    if(replay(trace, policy, choice->arena ? &allocator : NULL,
+              push_latencies, pop_latencies, &total_ns) != 0) {
+        arena_free(&arena);
+        return -1;
+    }
+
+    double seconds = (double)total_ns / 1e9;
+    printf("allocator:       %s\n"
+           "operations:      %zu\n"
+           "time:            %.6f s\n"
+           "throughput:      %.0f ops/s\n",
+           choice->name,
+           push_latencies->count + pop_latencies->count,
+           seconds,
+           seconds > 0 ? (double)(push_latencies->count + pop_latencies->count) / seconds : 0);
+    print_latencies("push", push_latencies);
+    print_latencies("pop ", pop_latencies);
+    if(choice->arena)
+        printf("arena reserved:  %zu KiB\n", arena.reserved / 1024);
+    arena_free(&arena);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+//RUNS ALL OPERATIONS FROM TRACE, MEASURES EVERY PUSH AND POP
+//------------------------------------------------------------------------------
+int replay(const replay_trace_t *    trace,
+           const replay_policy_t *   policy,
+           const stack_allocator_t * allocator,
+           replay_latencies_t *      push_latencies,
+           replay_latencies_t *      pop_latencies,
+           uint64_t *                total_ns) {
+    stack_t **stacks = (stack_t **)calloc(trace->stacks_number + 1, sizeof(stack_t *));
+    char *element = (char *)calloc(trace->max_element_size + 1, 1);
+    if(stacks == NULL || element == NULL) {
+        free(stacks);
+        free(element);
+        return -1;
+    }
+    memset(element, 0x5a, trace->max_element_size);
+
+    for(size_t index = 0; index < trace->count; index++) {
+        const stack_trace_record_t *record = trace->records + index;
+        stack_t **stack = stacks + record->stack_id;
+
+        switch(record->op) {
+            case STACK_TRACE_INIT: {
+                if(record->element_size == 0)
+                    *stack = stack_init_bytes(DUMP_INIT("replay.log", stack, print_byte)
+                                              record->capacity);
+                else
+                    *stack = stack_init_allocator(DUMP_INIT("replay.log", stack, print_byte)
+                                                  record->capacity,
+                                                  record->element_size,
+                                                  allocator);
+                if(*stack == NULL ||
+                   stack_set_growth_policy(stack,
+                                           policy->grow_factor,
+                                           policy->shrink_threshold,
+                                           policy->shrink_factor) != STACK_SUCCESS) {
+                    free(stacks);
+                    free(element);
+                    return -1;
+                }
+                break;
+            }
+            case STACK_TRACE_PUSH: {
+                if(*stack == NULL)
+                    break;
+                uint64_t start = current_time_ns();
+                stack_push(stack, element);
+                uint64_t latency = current_time_ns() - start;
+
+                push_latencies->values[push_latencies->count++] = latency;
+                *total_ns += latency;
+                break;
+            }
+            case STACK_TRACE_POP: {
+                if(*stack == NULL)
+                    break;
+                uint64_t start = current_time_ns();
+                stack_pop(stack, element);
+                uint64_t latency = current_time_ns() - start;
+
+                pop_latencies->values[pop_latencies->count++] = latency;
+                *total_ns += latency;
+                break;
+            }
+            case STACK_TRACE_PUSH_BYTES: {
+                if(*stack == NULL)
+                    break;
+                uint64_t start = current_time_ns();
+                stack_push_bytes(stack, element, record->element_size);
+                uint64_t latency = current_time_ns() - start;
+
+                push_latencies->values[push_latencies->count++] = latency;
+                *total_ns += latency;
+                break;
+            }
+            case STACK_TRACE_POP_BYTES: {
+                if(*stack == NULL)
+                    break;
+                size_t length = trace->max_element_size;
+                uint64_t start = current_time_ns();
+                stack_pop_bytes(stack, element, &length);
+                uint64_t latency = current_time_ns() - start;
+
+                pop_latencies->values[pop_latencies->count++] = latency;
+                *total_ns += latency;
+                break;
+            }
+            case STACK_TRACE_ROLLBACK: {
+                if(*stack == NULL)
+                    break;
+                uint64_t start = current_time_ns();
+                stack_rollback(stack, record->element_size);
+                uint64_t latency = current_time_ns() - start;
+
+                pop_latencies->values[pop_latencies->count++] = latency;
+                *total_ns += latency;
+                break;
+            }
+            case STACK_TRACE_DESTROY: {
+                if(*stack != NULL)
+                    stack_destroy(stack);
+                break;
+            }
+            default: {
+                free(stacks);
+                free(element);
+                return -1;
+            }
+        }
+    }
+
+    for(size_t stack = 0; stack < trace->stacks_number; stack++)
+        if(stacks[stack] != NULL)
+            stack_destroy(stacks + stack);
+
+    free(stacks);
+    free(element);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+//TAKES MEMORY FROM LAST BLOCK OF ARENA, ADDS NEW BLOCK IF IT DOES NOT FIT
+//------------------------------------------------------------------------------
+void *arena_allocate(void *context, size_t size, size_t alignment) {
+    replay_arena_t *      arena = (replay_arena_t *)context;
+    replay_arena_block_t *block = arena->blocks;
+
+    size_t start = 0;
+    if(block != NULL) {
+        uintptr_t free_memory = (uintptr_t)(block + 1) + block->used;
+        start = (free_memory + alignment - 1) / alignment * alignment -
+                (uintptr_t)(block + 1);
+    }
+
+    if(block == NULL || start + size > block->size) {
+        size_t block_size = size + alignment > ARENA_BLOCK_SIZE ? size + alignment :
+                                                                  ARENA_BLOCK_SIZE;
+        block = (replay_arena_block_t *)malloc(sizeof(replay_arena_block_t) + block_size);
+        if(block == NULL)
+            return NULL;
+
+        block->next      = arena->blocks;
+        block->size      = block_size;
+        block->used      = 0;
+        arena->blocks    = block;
+        arena->reserved += block_size;
+
+        uintptr_t free_memory = (uintptr_t)(block + 1);
+        start = (free_memory + alignment - 1) / alignment * alignment - free_memory;
+    }
+
+    block->used = start + size;
+    return (char *)(block + 1) + start;
+}
+
+//------------------------------------------------------------------------------
+//MEMORY OF ARENA IS FREED ONLY WITH WHOLE ARENA
+//------------------------------------------------------------------------------
+void arena_release(void *, void *) {
+}
+
+//------------------------------------------------------------------------------
+//FREES ALL BLOCKS OF ARENA, STACKS WHICH USED IT ARE DESTROYED BEFORE
+//------------------------------------------------------------------------------
+void arena_free(replay_arena_t *arena) {
+    while(arena->blocks != NULL) {
+        replay_arena_block_t *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    arena->reserved = 0;
+}
+
+uint64_t current_time_ns(void) {
+    struct timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+}
+
+int compare_latencies(const void *first, const void *second) {
+    uint64_t first_value  = *(const uint64_t *)first;
+    uint64_t second_value = *(const uint64_t *)second;
+    return (first_value > second_value) - (first_value < second_value);
+}
+
+void print_latencies(const char *name, replay_latencies_t *latencies) {
+    if(latencies->count == 0) {
+        printf("%s latency ns: no operations\n", name);
+        return ;
+    }
+
+    qsort(latencies->values, latencies->count, sizeof(uint64_t), compare_latencies);
+
+    const uint64_t *values = latencies->values;
+    size_t last = latencies->count - 1;
+    printf("%s latency ns: p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu\n",
+           name,
+           (unsigned long long)values[last * 50  / 100 ],
+           (unsigned long long)values[last * 90  / 100 ],
+           (unsigned long long)values[last * 99  / 100 ],
+           (unsigned long long)values[last * 999 / 1000],
+           (unsigned long long)values[last]);
+}